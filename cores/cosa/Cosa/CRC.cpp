@@ -0,0 +1,128 @@
+/**
+ * @file Cosa/CRC.cpp
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#include "Cosa/CRC.hh"
+
+const uint8_t CRC::Dallas::s_nibble[16] __PROGMEM = {
+  0x00, 0x9d, 0x23, 0xbe, 0x46, 0xdb, 0x65, 0xf8,
+  0x8c, 0x11, 0xaf, 0x32, 0xca, 0x57, 0xe9, 0x74
+};
+
+const uint16_t CRC::CCITT::s_nibble[16] __PROGMEM = {
+  0x0000, 0x1081, 0x2102, 0x3183, 0x4204, 0x5285, 0x6306, 0x7387,
+  0x8408, 0x9489, 0xa50a, 0xb58b, 0xc60c, 0xd68d, 0xe70e, 0xf78f
+};
+
+const uint16_t CRC::XModem::s_nibble[16] __PROGMEM = {
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+  0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef
+};
+
+const uint16_t CRC::Modbus::s_nibble[16] __PROGMEM = {
+  0x0000, 0xcc01, 0xd801, 0x1400, 0xf001, 0x3c00, 0x2800, 0xe401,
+  0xa001, 0x6c00, 0x7800, 0xb401, 0x5000, 0x9c01, 0x8801, 0x4400
+};
+
+const uint32_t CRC::IEEE::s_nibble[16] __PROGMEM = {
+  0x00000000UL, 0x1db71064UL, 0x3b6e20c8UL, 0x26d930acUL,
+  0x76dc4190UL, 0x6b6b51f4UL, 0x4db26158UL, 0x5005713cUL,
+  0xedb88320UL, 0xf00f9344UL, 0xd6d6a3e8UL, 0xcb61b38cUL,
+  0x9b64c2b0UL, 0x86d3d2d4UL, 0xa00ae278UL, 0xbdbdf21cUL
+};
+
+uint8_t
+CRC::Dallas::update(uint8_t crc, const void* buf, size_t size)
+{
+  const uint8_t* bp = (const uint8_t*) buf;
+  while (size--) crc = update(crc, *bp++);
+  return (crc);
+}
+
+uint8_t
+CRC::Dallas::update(uint8_t crc, const iovec_t* vec)
+{
+  for (const iovec_t* vp = vec; vp->buf != NULL; vp++)
+    crc = update(crc, vp->buf, vp->size);
+  return (crc);
+}
+
+uint16_t
+CRC::CCITT::update(uint16_t crc, const void* buf, size_t size)
+{
+  const uint8_t* bp = (const uint8_t*) buf;
+  while (size--) crc = update(crc, *bp++);
+  return (crc);
+}
+
+uint16_t
+CRC::CCITT::update(uint16_t crc, const iovec_t* vec)
+{
+  for (const iovec_t* vp = vec; vp->buf != NULL; vp++)
+    crc = update(crc, vp->buf, vp->size);
+  return (crc);
+}
+
+uint16_t
+CRC::XModem::update(uint16_t crc, const void* buf, size_t size)
+{
+  const uint8_t* bp = (const uint8_t*) buf;
+  while (size--) crc = update(crc, *bp++);
+  return (crc);
+}
+
+uint16_t
+CRC::XModem::update(uint16_t crc, const iovec_t* vec)
+{
+  for (const iovec_t* vp = vec; vp->buf != NULL; vp++)
+    crc = update(crc, vp->buf, vp->size);
+  return (crc);
+}
+
+uint16_t
+CRC::Modbus::update(uint16_t crc, const void* buf, size_t size)
+{
+  const uint8_t* bp = (const uint8_t*) buf;
+  while (size--) crc = update(crc, *bp++);
+  return (crc);
+}
+
+uint16_t
+CRC::Modbus::update(uint16_t crc, const iovec_t* vec)
+{
+  for (const iovec_t* vp = vec; vp->buf != NULL; vp++)
+    crc = update(crc, vp->buf, vp->size);
+  return (crc);
+}
+
+uint32_t
+CRC::IEEE::update(uint32_t crc, const void* buf, size_t size)
+{
+  const uint8_t* bp = (const uint8_t*) buf;
+  while (size--) crc = update(crc, *bp++);
+  return (crc);
+}
+
+uint32_t
+CRC::IEEE::update(uint32_t crc, const iovec_t* vec)
+{
+  for (const iovec_t* vp = vec; vp->buf != NULL; vp++)
+    crc = update(crc, vp->buf, vp->size);
+  return (crc);
+}
@@ -0,0 +1,533 @@
+/**
+ * @file Cosa/CRC.hh
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#ifndef COSA_CRC_HH
+#define COSA_CRC_HH
+
+#include "Cosa/Types.h"
+
+/**
+ * CRC implementation variants. Bitwise uses no table, nibble uses
+ * a 16 entry table and table a 256 entry table in program memory.
+ */
+#define CRC_BITWISE 0
+#define CRC_NIBBLE 1
+#define CRC_TABLE 2
+
+/**
+ * CRC implementation variant per width; selected per build. Default
+ * nibble table.
+ */
+#if !defined(COSA_CRC8_VARIANT)
+#define COSA_CRC8_VARIANT CRC_NIBBLE
+#endif
+#if !defined(COSA_CRC16_VARIANT)
+#define COSA_CRC16_VARIANT CRC_NIBBLE
+#endif
+#if !defined(COSA_CRC32_VARIANT)
+#define COSA_CRC32_VARIANT CRC_NIBBLE
+#endif
+
+/**
+ * CRC-16 CCITT implementation variant. Default bitwise as the
+ * shift and xor formulation is faster than the nibble table.
+ */
+#if !defined(COSA_CRC_CCITT_VARIANT)
+#define COSA_CRC_CCITT_VARIANT CRC_BITWISE
+#endif
+
+/**
+ * Cyclic Redundancy Check (CRC) algorithms. Each algorithm has a
+ * bitwise, nibble table and byte table implementation of the checksum
+ * update. The variant used by update() is selected per build with
+ * the variant configuration, above. The checksum is updated
+ * incrementally per byte, buffer or io vector. The initial value is
+ * given by INIT.
+ */
+class CRC {
+public:
+  /**
+   * CRC-8 Dallas/Maxim (1-Wire); polynomial x^8+x^5+x^4+1 (0x31,
+   * reflected 0x8c). Same as avr-libc _crc_ibutton_update(). Zero
+   * remainder when the checksum is included in the update.
+   */
+  class Dallas {
+  public:
+    /** Initial value. */
+    static const uint8_t INIT = 0;
+
+    /**
+     * Return updated checksum with given data (bitwise).
+     * @param[in] crc current checksum.
+     * @param[in] data to update with.
+     * @return checksum.
+     */
+    static uint8_t bitwise(uint8_t crc, uint8_t data)
+    {
+      crc ^= data;
+      for (uint8_t i = 0; i < CHARBITS; i++)
+	crc = (crc & 0x01) ? (crc >> 1) ^ 0x8c : (crc >> 1);
+      return (crc);
+    }
+
+    /**
+     * Return updated checksum with given data (nibble table).
+     * @param[in] crc current checksum.
+     * @param[in] data to update with.
+     * @return checksum.
+     */
+    static uint8_t nibble(uint8_t crc, uint8_t data)
+    {
+      crc ^= data;
+      crc = (crc >> 4) ^ pgm_read_byte(&s_nibble[crc & 0x0f]);
+      crc = (crc >> 4) ^ pgm_read_byte(&s_nibble[crc & 0x0f]);
+      return (crc);
+    }
+
+    /**
+     * Return updated checksum with given data (byte table).
+     * @param[in] crc current checksum.
+     * @param[in] data to update with.
+     * @return checksum.
+     */
+    static uint8_t table(uint8_t crc, uint8_t data)
+    {
+      return (pgm_read_byte(&s_table[crc ^ data]));
+    }
+
+    /**
+     * Return updated checksum with given data. Variant is selected
+     * with COSA_CRC8_VARIANT.
+     * @param[in] crc current checksum.
+     * @param[in] data to update with.
+     * @return checksum.
+     */
+    static uint8_t update(uint8_t crc, uint8_t data)
+    {
+#if (COSA_CRC8_VARIANT == CRC_TABLE)
+      return (table(crc, data));
+#elif (COSA_CRC8_VARIANT == CRC_NIBBLE)
+      return (nibble(crc, data));
+#else
+      return (bitwise(crc, data));
+#endif
+    }
+
+    /**
+     * Return updated checksum with given buffer.
+     * @param[in] crc current checksum.
+     * @param[in] buf buffer pointer.
+     * @param[in] size number of bytes in buffer.
+     * @return checksum.
+     */
+    static uint8_t update(uint8_t crc, const void* buf, size_t size);
+
+    /**
+     * Return updated checksum with given null terminated io vector.
+     * @param[in] crc current checksum.
+     * @param[in] vec io vector.
+     * @return checksum.
+     */
+    static uint8_t update(uint8_t crc, const iovec_t* vec);
+
+  protected:
+    /** Nibble table. */
+    static const uint8_t s_nibble[16];
+
+    /** Byte table. */
+    static const uint8_t s_table[256];
+  };
+
+  /**
+   * CRC-16 CCITT (Kermit); polynomial x^16+x^12+x^5+1 (0x1021,
+   * reflected 0x8408). Same as avr-libc _crc_ccitt_update(). With
+   * INIT and the complemented checksum appended (X.25, low byte
+   * first) the update over message and checksum is RESIDUE.
+   */
+  class CCITT {
+  public:
+    /** Initial value. */
+    static const uint16_t INIT = 0xffff;
+
+    /** Remainder of message and complemented checksum. */
+    static const uint16_t RESIDUE = 0xf0b8;
+
+    /**
+     * Return updated checksum with given data (bitwise; shift and
+     * xor formulation).
+     * @param[in] crc current checksum.
+     * @param[in] data to update with.
+     * @return checksum.
+     */
+    static uint16_t bitwise(uint16_t crc, uint8_t data)
+    {
+      data ^= (crc & 0xff);
+      data ^= (data << 4);
+      return ((((uint16_t) data << 8) | (crc >> 8))
+	      ^ (uint8_t) (data >> 4)
+	      ^ ((uint16_t) data << 3));
+    }
+
+    /**
+     * Return updated checksum with given data (nibble table).
+     * @param[in] crc current checksum.
+     * @param[in] data to update with.
+     * @return checksum.
+     */
+    static uint16_t nibble(uint16_t crc, uint8_t data)
+    {
+      crc ^= data;
+      crc = (crc >> 4) ^ pgm_read_word(&s_nibble[crc & 0x0f]);
+      crc = (crc >> 4) ^ pgm_read_word(&s_nibble[crc & 0x0f]);
+      return (crc);
+    }
+
+    /**
+     * Return updated checksum with given data (byte table).
+     * @param[in] crc current checksum.
+     * @param[in] data to update with.
+     * @return checksum.
+     */
+    static uint16_t table(uint16_t crc, uint8_t data)
+    {
+      return ((crc >> 8) ^ pgm_read_word(&s_table[(crc ^ data) & 0xff]));
+    }
+
+    /**
+     * Return updated checksum with given data. Variant is selected
+     * with COSA_CRC_CCITT_VARIANT.
+     * @param[in] crc current checksum.
+     * @param[in] data to update with.
+     * @return checksum.
+     */
+    static uint16_t update(uint16_t crc, uint8_t data)
+    {
+#if (COSA_CRC_CCITT_VARIANT == CRC_TABLE)
+      return (table(crc, data));
+#elif (COSA_CRC_CCITT_VARIANT == CRC_NIBBLE)
+      return (nibble(crc, data));
+#else
+      return (bitwise(crc, data));
+#endif
+    }
+
+    /**
+     * Return updated checksum with given buffer.
+     * @param[in] crc current checksum.
+     * @param[in] buf buffer pointer.
+     * @param[in] size number of bytes in buffer.
+     * @return checksum.
+     */
+    static uint16_t update(uint16_t crc, const void* buf, size_t size);
+
+    /**
+     * Return updated checksum with given null terminated io vector.
+     * @param[in] crc current checksum.
+     * @param[in] vec io vector.
+     * @return checksum.
+     */
+    static uint16_t update(uint16_t crc, const iovec_t* vec);
+
+  protected:
+    /** Nibble table. */
+    static const uint16_t s_nibble[16];
+
+    /** Byte table. */
+    static const uint16_t s_table[256];
+  };
+
+  /**
+   * CRC-16 XModem; polynomial x^16+x^12+x^5+1 (0x1021), not
+   * reflected. Same as avr-libc _crc_xmodem_update(). Zero remainder
+   * when the checksum is included in the update (high byte first).
+   */
+  class XModem {
+  public:
+    /** Initial value. */
+    static const uint16_t INIT = 0;
+
+    /**
+     * Return updated checksum with given data (bitwise).
+     * @param[in] crc current checksum.
+     * @param[in] data to update with.
+     * @return checksum.
+     */
+    static uint16_t bitwise(uint16_t crc, uint8_t data)
+    {
+      crc ^= ((uint16_t) data << 8);
+      for (uint8_t i = 0; i < CHARBITS; i++)
+	crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+      return (crc);
+    }
+
+    /**
+     * Return updated checksum with given data (nibble table).
+     * @param[in] crc current checksum.
+     * @param[in] data to update with.
+     * @return checksum.
+     */
+    static uint16_t nibble(uint16_t crc, uint8_t data)
+    {
+      crc ^= ((uint16_t) data << 8);
+      crc = (crc << 4) ^ pgm_read_word(&s_nibble[crc >> 12]);
+      crc = (crc << 4) ^ pgm_read_word(&s_nibble[crc >> 12]);
+      return (crc);
+    }
+
+    /**
+     * Return updated checksum with given data (byte table).
+     * @param[in] crc current checksum.
+     * @param[in] data to update with.
+     * @return checksum.
+     */
+    static uint16_t table(uint16_t crc, uint8_t data)
+    {
+      return ((crc << 8) ^ pgm_read_word(&s_table[(crc >> 8) ^ data]));
+    }
+
+    /**
+     * Return updated checksum with given data. Variant is selected
+     * with COSA_CRC16_VARIANT.
+     * @param[in] crc current checksum.
+     * @param[in] data to update with.
+     * @return checksum.
+     */
+    static uint16_t update(uint16_t crc, uint8_t data)
+    {
+#if (COSA_CRC16_VARIANT == CRC_TABLE)
+      return (table(crc, data));
+#elif (COSA_CRC16_VARIANT == CRC_NIBBLE)
+      return (nibble(crc, data));
+#else
+      return (bitwise(crc, data));
+#endif
+    }
+
+    /**
+     * Return updated checksum with given buffer.
+     * @param[in] crc current checksum.
+     * @param[in] buf buffer pointer.
+     * @param[in] size number of bytes in buffer.
+     * @return checksum.
+     */
+    static uint16_t update(uint16_t crc, const void* buf, size_t size);
+
+    /**
+     * Return updated checksum with given null terminated io vector.
+     * @param[in] crc current checksum.
+     * @param[in] vec io vector.
+     * @return checksum.
+     */
+    static uint16_t update(uint16_t crc, const iovec_t* vec);
+
+  protected:
+    /** Nibble table. */
+    static const uint16_t s_nibble[16];
+
+    /** Byte table. */
+    static const uint16_t s_table[256];
+  };
+
+  /**
+   * CRC-16 Modbus; polynomial x^16+x^15+x^2+1 (0x8005, reflected
+   * 0xa001). Same as avr-libc _crc16_update(). Zero remainder when
+   * the checksum is included in the update (low byte first).
+   */
+  class Modbus {
+  public:
+    /** Initial value. */
+    static const uint16_t INIT = 0xffff;
+
+    /**
+     * Return updated checksum with given data (bitwise).
+     * @param[in] crc current checksum.
+     * @param[in] data to update with.
+     * @return checksum.
+     */
+    static uint16_t bitwise(uint16_t crc, uint8_t data)
+    {
+      crc ^= data;
+      for (uint8_t i = 0; i < CHARBITS; i++)
+	crc = (crc & 0x0001) ? (crc >> 1) ^ 0xa001 : (crc >> 1);
+      return (crc);
+    }
+
+    /**
+     * Return updated checksum with given data (nibble table).
+     * @param[in] crc current checksum.
+     * @param[in] data to update with.
+     * @return checksum.
+     */
+    static uint16_t nibble(uint16_t crc, uint8_t data)
+    {
+      crc ^= data;
+      crc = (crc >> 4) ^ pgm_read_word(&s_nibble[crc & 0x0f]);
+      crc = (crc >> 4) ^ pgm_read_word(&s_nibble[crc & 0x0f]);
+      return (crc);
+    }
+
+    /**
+     * Return updated checksum with given data (byte table).
+     * @param[in] crc current checksum.
+     * @param[in] data to update with.
+     * @return checksum.
+     */
+    static uint16_t table(uint16_t crc, uint8_t data)
+    {
+      return ((crc >> 8) ^ pgm_read_word(&s_table[(crc ^ data) & 0xff]));
+    }
+
+    /**
+     * Return updated checksum with given data. Variant is selected
+     * with COSA_CRC16_VARIANT.
+     * @param[in] crc current checksum.
+     * @param[in] data to update with.
+     * @return checksum.
+     */
+    static uint16_t update(uint16_t crc, uint8_t data)
+    {
+#if (COSA_CRC16_VARIANT == CRC_TABLE)
+      return (table(crc, data));
+#elif (COSA_CRC16_VARIANT == CRC_NIBBLE)
+      return (nibble(crc, data));
+#else
+      return (bitwise(crc, data));
+#endif
+    }
+
+    /**
+     * Return updated checksum with given buffer.
+     * @param[in] crc current checksum.
+     * @param[in] buf buffer pointer.
+     * @param[in] size number of bytes in buffer.
+     * @return checksum.
+     */
+    static uint16_t update(uint16_t crc, const void* buf, size_t size);
+
+    /**
+     * Return updated checksum with given null terminated io vector.
+     * @param[in] crc current checksum.
+     * @param[in] vec io vector.
+     * @return checksum.
+     */
+    static uint16_t update(uint16_t crc, const iovec_t* vec);
+
+  protected:
+    /** Nibble table. */
+    static const uint16_t s_nibble[16];
+
+    /** Byte table. */
+    static const uint16_t s_table[256];
+  };
+
+  /**
+   * CRC-32 IEEE 802.3 (Ethernet, ZIP, PNG); polynomial 0x04c11db7
+   * (reflected 0xedb88320). The checksum is the complement of the
+   * updated value.
+   */
+  class IEEE {
+  public:
+    /** Initial value. */
+    static const uint32_t INIT = 0xffffffffUL;
+
+    /**
+     * Return updated checksum with given data (bitwise).
+     * @param[in] crc current checksum.
+     * @param[in] data to update with.
+     * @return checksum.
+     */
+    static uint32_t bitwise(uint32_t crc, uint8_t data)
+    {
+      crc ^= data;
+      for (uint8_t i = 0; i < CHARBITS; i++)
+	crc = (crc & 0x00000001UL) ? (crc >> 1) ^ 0xedb88320UL : (crc >> 1);
+      return (crc);
+    }
+
+    /**
+     * Return updated checksum with given data (nibble table).
+     * @param[in] crc current checksum.
+     * @param[in] data to update with.
+     * @return checksum.
+     */
+    static uint32_t nibble(uint32_t crc, uint8_t data)
+    {
+      crc ^= data;
+      crc = (crc >> 4) ^ pgm_read_dword(&s_nibble[crc & 0x0f]);
+      crc = (crc >> 4) ^ pgm_read_dword(&s_nibble[crc & 0x0f]);
+      return (crc);
+    }
+
+    /**
+     * Return updated checksum with given data (byte table).
+     * @param[in] crc current checksum.
+     * @param[in] data to update with.
+     * @return checksum.
+     */
+    static uint32_t table(uint32_t crc, uint8_t data)
+    {
+      return ((crc >> 8) ^ pgm_read_dword(&s_table[(crc ^ data) & 0xff]));
+    }
+
+    /**
+     * Return updated checksum with given data. Variant is selected
+     * with COSA_CRC32_VARIANT.
+     * @param[in] crc current checksum.
+     * @param[in] data to update with.
+     * @return checksum.
+     */
+    static uint32_t update(uint32_t crc, uint8_t data)
+    {
+#if (COSA_CRC32_VARIANT == CRC_TABLE)
+      return (table(crc, data));
+#elif (COSA_CRC32_VARIANT == CRC_NIBBLE)
+      return (nibble(crc, data));
+#else
+      return (bitwise(crc, data));
+#endif
+    }
+
+    /**
+     * Return updated checksum with given buffer.
+     * @param[in] crc current checksum.
+     * @param[in] buf buffer pointer.
+     * @param[in] size number of bytes in buffer.
+     * @return checksum.
+     */
+    static uint32_t update(uint32_t crc, const void* buf, size_t size);
+
+    /**
+     * Return updated checksum with given null terminated io vector.
+     * @param[in] crc current checksum.
+     * @param[in] vec io vector.
+     * @return checksum.
+     */
+    static uint32_t update(uint32_t crc, const iovec_t* vec);
+
+  protected:
+    /** Nibble table. */
+    static const uint32_t s_nibble[16];
+
+    /** Byte table. */
+    static const uint32_t s_table[256];
+  };
+};
+
+#endif
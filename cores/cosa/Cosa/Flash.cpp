@@ -0,0 +1,132 @@
+/**
+ * @file Cosa/Flash.cpp
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#include "Cosa/Flash.hh"
+
+int
+Flash::Buffer::read(void* dest, uint32_t src, size_t size)
+{
+  int res = (int) size;
+
+  // Read flash contents; large reads directly and small reads through
+  // the read-ahead cache
+  if (size >= CACHE_MAX) {
+    res = m_device->read(dest, src, size);
+    if (UNLIKELY(res < 0)) return (res);
+  }
+  else {
+    if ((src < m_cache_addr) || (src - m_cache_addr + size > m_cache_size)) {
+      m_misses += 1;
+      m_cache_size = 0;
+      size_t count = CACHE_MAX;
+      if (src + count > DEVICE_BYTES) count = DEVICE_BYTES - src;
+      if (UNLIKELY(count < size)) return (EINVAL);
+      int n = m_device->read(m_cache, src, count);
+      if (UNLIKELY(n < 0)) return (n);
+      m_cache_addr = src;
+      m_cache_size = n;
+    }
+    else {
+      m_hits += 1;
+    }
+    memcpy(dest, m_cache + (src - m_cache_addr), size);
+  }
+  if (m_page == NO_PAGE) return (res);
+
+  // Combine with buffered data in the range
+  uint32_t first = m_page + m_first;
+  uint32_t last = m_page + m_last;
+  if ((src + size <= first) || (src >= last)) return (res);
+  uint8_t* dp = (uint8_t*) dest;
+  uint32_t addr = (src > first ? src : first);
+  uint32_t end = (src + size < last ? src + size : last);
+  for (; addr < end; addr++) dp[addr - src] &= m_buf[addr - m_page];
+  return (res);
+}
+
+int
+Flash::Buffer::erase(uint32_t dest, uint8_t size)
+{
+  // Invalidate the read-ahead cache
+  m_cache_size = 0;
+
+  // Discard buffered page in erased block (or chip erase)
+  if (m_page != NO_PAGE) {
+    uint32_t mask = (size == 255) ? 0L : ~((size * 1024L) - 1);
+    if ((m_page & mask) == (dest & mask)) m_page = NO_PAGE;
+  }
+  return (m_device->erase(dest, size));
+}
+
+int
+Flash::Buffer::flush()
+{
+  if (m_page == NO_PAGE) return (0);
+
+  // Program the written range of the page
+  uint32_t page = m_page;
+  m_page = NO_PAGE;
+  size_t count = m_last - m_first;
+
+  // Invalidate the read-ahead cache if the range overlaps
+  uint32_t first = page + m_first;
+  if ((first < m_cache_addr + m_cache_size)
+      && (first + count > m_cache_addr))
+    m_cache_size = 0;
+  int res = m_device->write(page + m_first, m_buf + m_first, count);
+  return (res == (int) count ? 0 : EIO);
+}
+
+int
+Flash::Buffer::write(uint32_t dest, const void* src, size_t size, bool progmem)
+{
+  const uint8_t* sp = (const uint8_t*) src;
+  int res = (int) size;
+
+  while (size != 0) {
+    // Check if a new page should be buffered
+    uint32_t page = dest & ~PAGE_MASK;
+    if (page != m_page) {
+      if (UNLIKELY(flush() < 0)) return (EIO);
+      memset(m_buf, 0xff, sizeof(m_buf));
+      m_page = page;
+      m_first = PAGE_MAX;
+      m_last = 0;
+    }
+
+    // Combine source with page buffer; programming only clears bits
+    uint16_t offset = dest & PAGE_MASK;
+    size_t count = PAGE_MAX - offset;
+    if (count > size) count = size;
+    if (offset < m_first) m_first = offset;
+    if (offset + count > m_last) m_last = offset + count;
+    uint8_t* bp = m_buf + offset;
+    for (size_t i = 0; i < count; i++)
+      *bp++ &= (progmem ? pgm_read_byte(sp++) : *sp++);
+    dest += count;
+    size -= count;
+
+    // Program the page when the end of the page is written
+    if ((dest & PAGE_MASK) == 0) {
+      if (UNLIKELY(flush() < 0)) return (EIO);
+    }
+  }
+  return (res);
+}
@@ -135,6 +135,210 @@ public:
      * @return number of bytes written or EOF(-1).
      */
     virtual int write_P(uint32_t dest, const void* scr, size_t size) = 0;
+
+    /**
+     * @override{Flash::Device}
+     * Write any buffered data to the flash memory. Return zero(0) if
+     * successful otherwise a negative error code.
+     * @return zero or negative error code.
+     */
+    virtual int flush()
+    {
+      return (0);
+    }
+  };
+
+  /**
+   * Flash memory write-back page buffer and read-ahead cache. Writes
+   * to the given device are collected in a page buffer and programmed
+   * when the page is filled, on write to another page, on flush() or
+   * end(). Small writes, such as putchar(), are programmed as a single
+   * page program instead of one program sequence per write. Reads
+   * return the flash contents with the buffered data. Programming may
+   * only clear bits and the buffered data is combined in the same
+   * way. Small reads are served from a read-ahead cache of CACHE_MAX
+   * bytes; a miss reads CACHE_MAX bytes from the requested address.
+   * The cache is invalidated by program and erase.
+   */
+  class Buffer : public Device {
+  public:
+    /** Size of program page in bytes. */
+    static const size_t PAGE_MAX = 256;
+
+    /** Page address mask. */
+    static const uint32_t PAGE_MASK = PAGE_MAX - 1;
+
+    /** Size of read-ahead cache in bytes. */
+    static const size_t CACHE_MAX = 128;
+
+    /**
+     * Construct write-back page buffer for given flash memory device.
+     * @param[in] device flash memory device.
+     */
+    Buffer(Device* device) :
+      Device(device->SECTOR_BYTES, device->SECTOR_MAX),
+      m_device(device),
+      m_page(NO_PAGE),
+      m_cache_addr(0L),
+      m_cache_size(0),
+      m_hits(0L),
+      m_misses(0L)
+    {}
+
+    /**
+     * @override{Flash::Device}
+     * Initiate the flash memory device. Return true(1) if the
+     * successful otherwise false(0).
+     * @return bool.
+     */
+    virtual bool begin()
+    {
+      m_page = NO_PAGE;
+      m_cache_size = 0;
+      return (m_device->begin());
+    }
+
+    /**
+     * @override{Flash::Device}
+     * Write buffered data and terminate the flash memory device.
+     * Return true(1) if the successful otherwise false(0).
+     * @return bool.
+     */
+    virtual bool end()
+    {
+      if (flush() < 0) return (false);
+      return (m_device->end());
+    }
+
+    /**
+     * @override{Flash::Device}
+     * Return true(1) if the device is ready, write cycle is completed,
+     * otherwise false(0).
+     * @return bool.
+     */
+    virtual bool is_ready()
+    {
+      return (m_device->is_ready());
+    }
+
+    /**
+     * @override{Flash::Device}
+     * Read flash block with the given size into the buffer from the
+     * source address. Buffered data is included. Return number of
+     * bytes read or negative error code.
+     * @param[in] dest buffer to read from flash into.
+     * @param[in] src address in flash to read from.
+     * @param[in] size number of bytes to read.
+     * @return number of bytes or negative error code.
+     */
+    virtual int read(void* dest, uint32_t src, size_t size);
+
+    /**
+     * @override{Flash::Device}
+     * Erase given flash block for given byte address. Buffered data
+     * in the erased block is discarded. Returs zero(0) if successful
+     * otherwise an negative error code.
+     * @param[in] dest destination block byte address to erase.
+     * @param[in] size of sector to erase in Kbyte.
+     * @return zero or negative error code.
+     */
+    virtual int erase(uint32_t dest, uint8_t size);
+
+    /**
+     * @override{Flash::Device}
+     * Write the contents of the source buffer to the page buffer for
+     * the given destination address. Return number of bytes written
+     * or negative error code.
+     * @param[in] dest address in flash to write to.
+     * @param[in] src buffer to write to flash.
+     * @param[in] size number of bytes to write.
+     * @return number of bytes or negative error code.
+     */
+    virtual int write(uint32_t dest, const void* src, size_t size)
+    {
+      return (write(dest, src, size, false));
+    }
+
+    /**
+     * @override{Flash::Device}
+     * Write the contents of the source buffer in program memory to the
+     * page buffer for the given destination address. Return number of
+     * bytes written or negative error code.
+     * @param[in] dest address in flash to write to.
+     * @param[in] src buffer in program memory to write to flash.
+     * @param[in] size number of bytes to write.
+     * @return number of bytes written or negative error code.
+     */
+    virtual int write_P(uint32_t dest, const void* src, size_t size)
+    {
+      return (write(dest, src, size, true));
+    }
+
+    /**
+     * @override{Flash::Device}
+     * Program the buffered page. Return zero(0) if successful
+     * otherwise a negative error code.
+     * @return zero or negative error code.
+     */
+    virtual int flush();
+
+    /**
+     * Return number of reads served from the read-ahead cache.
+     * @return number of hits.
+     */
+    uint32_t hits() const
+    {
+      return (m_hits);
+    }
+
+    /**
+     * Return number of reads that filled the read-ahead cache.
+     * @return number of misses.
+     */
+    uint32_t misses() const
+    {
+      return (m_misses);
+    }
+
+  protected:
+    /** No page buffered. */
+    static const uint32_t NO_PAGE = 0xffffffffL;
+
+    /** Flash memory device. */
+    Device* m_device;
+
+    /** Address of buffered page. */
+    uint32_t m_page;
+
+    /** Offset of first and last+1 buffered byte in page. */
+    uint16_t m_first;
+    uint16_t m_last;
+
+    /** Page buffer; unwritten bytes are 0xff. */
+    uint8_t m_buf[PAGE_MAX];
+
+    /** Address and number of bytes in read-ahead cache. */
+    uint32_t m_cache_addr;
+    uint16_t m_cache_size;
+
+    /** Read-ahead cache statistics. */
+    uint32_t m_hits;
+    uint32_t m_misses;
+
+    /** Read-ahead cache. */
+    uint8_t m_cache[CACHE_MAX];
+
+    /**
+     * Write the contents of the source buffer in data or program
+     * memory to the page buffer. Return number of bytes written or
+     * negative error code.
+     * @param[in] dest address in flash to write to.
+     * @param[in] src buffer to write to flash.
+     * @param[in] size number of bytes to write.
+     * @param[in] progmem source in data(false) or program memory(true).
+     * @return number of bytes written or negative error code.
+     */
+    int write(uint32_t dest, const void* src, size_t size, bool progmem);
   };
 };
 
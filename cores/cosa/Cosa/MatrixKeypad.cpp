@@ -0,0 +1,114 @@
+/**
+ * @file Cosa/MatrixKeypad.cpp
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#include "Cosa/MatrixKeypad.hh"
+
+/**
+ * Return bit position of given single bit mask.
+ * @param[in] mask bit mask.
+ * @return bit position.
+ */
+static uint8_t
+bit(uint8_t mask)
+{
+  uint8_t res = 0;
+  while (mask >>= 1) res++;
+  return (res);
+}
+
+MatrixKeypad::MatrixKeypad(Job::Scheduler* scheduler,
+			   Board::DigitalPin column, uint8_t columns,
+			   Board::DigitalPin row, uint8_t rows,
+			   uint16_t ms) :
+  Periodic(scheduler, ms),
+  m_column_sfr(GPIO::PIN(column)),
+  m_row_sfr(GPIO::PIN(row)),
+  m_column_mask(((1 << (columns > COLUMN_MAX ? COLUMN_MAX : columns)) - 1)
+		* GPIO::MASK(column)),
+  m_row_mask(((1 << (rows > ROW_MAX ? ROW_MAX : rows)) - 1)
+	     * GPIO::MASK(row)),
+  m_column_bit(bit(GPIO::MASK(column))),
+  m_row_bit(bit(GPIO::MASK(row))),
+  m_columns(columns > COLUMN_MAX ? COLUMN_MAX : columns),
+  m_rows(rows > ROW_MAX ? ROW_MAX : rows)
+{
+  // Columns are inputs without pullup until driven low. Rows are
+  // inputs with pullup
+  synchronized {
+    m_column_sfr[1] &= ~m_column_mask;
+    m_column_sfr[2] &= ~m_column_mask;
+    m_row_sfr[1] &= ~m_row_mask;
+    m_row_sfr[2] |= m_row_mask;
+  }
+  memset(m_state, 0, sizeof(m_state));
+  memset(m_cnt0, 0, sizeof(m_cnt0));
+  memset(m_cnt1, 0, sizeof(m_cnt1));
+}
+
+void
+MatrixKeypad::on_change(const uint8_t* down, const uint8_t* up)
+{
+  uint8_t nr = 0;
+  for (uint8_t column = 0; column < m_columns; column++) {
+    uint8_t pressed = down[column];
+    uint8_t released = up[column];
+    for (uint8_t row = 0; row < m_rows; row++, nr++) {
+      if (pressed & 1) on_key_down(nr);
+      if (released & 1) on_key_up(nr);
+      pressed >>= 1;
+      released >>= 1;
+    }
+  }
+}
+
+void
+MatrixKeypad::run()
+{
+  volatile uint8_t* ddr = m_column_sfr + 1;
+  uint8_t down[COLUMN_MAX];
+  uint8_t up[COLUMN_MAX];
+  uint8_t changed = 0;
+
+  for (uint8_t column = 0; column < m_columns; column++) {
+    // Drive the column low (output) and read all rows in one go;
+    // pressed keys read as zero
+    uint8_t mask = _BV(m_column_bit + column);
+    synchronized *ddr = (*ddr & ~m_column_mask) | mask;
+    DELAY(1);
+    uint8_t sample = ((~*m_row_sfr) & m_row_mask) >> m_row_bit;
+
+    // Vertical counter debounce; a key toggles state after four
+    // consecutive samples that differ from the debounced state
+    uint8_t delta = sample ^ m_state[column];
+    m_cnt1[column] = (m_cnt1[column] ^ m_cnt0[column]) & delta;
+    m_cnt0[column] = ~m_cnt0[column] & delta;
+    uint8_t toggle = delta & ~(m_cnt0[column] | m_cnt1[column]);
+    m_state[column] ^= toggle;
+    down[column] = toggle & m_state[column];
+    up[column] = toggle & ~m_state[column];
+    changed |= toggle;
+  }
+
+  // Release the columns (high impedance)
+  synchronized *ddr &= ~m_column_mask;
+
+  // Deliver all changes in the scan as a batch
+  if (changed) on_change(down, up);
+}
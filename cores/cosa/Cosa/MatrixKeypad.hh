@@ -0,0 +1,181 @@
+/**
+ * @file Cosa/MatrixKeypad.hh
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#ifndef COSA_MATRIX_KEYPAD_HH
+#define COSA_MATRIX_KEYPAD_HH
+
+#include "Cosa/Types.h"
+#include "Cosa/GPIO.hh"
+#include "Cosa/Periodic.hh"
+
+/**
+ * Handling of digital matrix keypads (up to 8x8). Periodically scans
+ * the matrix; each column is driven low with a single port write and
+ * all rows are read with a single port read. The whole matrix bitmap
+ * is debounced with vertical counters (four stable samples) and all
+ * key changes detected in a scan are delivered as a batch to
+ * on_change(). Any number of keys may be pressed at the same time
+ * (N-key rollover requires diodes in the matrix).
+ *
+ * The column pins must be consecutive bits on one port and the row
+ * pins consecutive bits on one port. Rows use the internal pullup
+ * resistors. Idle columns are left as inputs (high impedance).
+ *
+ * @section Circuit
+ * @code
+ *                          4x4 Keypad
+ *                       +------------+
+ * (D8)----------------1-|C0          |
+ * (D9)----------------2-|C1          |
+ * (D10)---------------3-|C2          |
+ * (D11)---------------4-|C3          |
+ * (D4)----------------5-|R0          |
+ * (D5)----------------6-|R1          |
+ * (D6)----------------7-|R2          |
+ * (D7)----------------8-|R3          |
+ *                       +------------+
+ * @endcode
+ */
+class MatrixKeypad : public Periodic {
+public:
+  /** Max number of columns. */
+  static const uint8_t COLUMN_MAX = 8;
+
+  /** Max number of rows. */
+  static const uint8_t ROW_MAX = 8;
+
+  /**
+   * Construct matrix keypad handler with given column and row
+   * pins. The pins are given as the first pin and number of
+   * consecutive pins (port bits).
+   * @param[in] scheduler periodic job handler.
+   * @param[in] column first column pin.
+   * @param[in] columns number of columns (1..COLUMN_MAX).
+   * @param[in] row first row pin.
+   * @param[in] rows number of rows (1..ROW_MAX).
+   * @param[in] ms scan period (default SAMPLE_MS).
+   */
+  MatrixKeypad(Job::Scheduler* scheduler,
+	       Board::DigitalPin column, uint8_t columns,
+	       Board::DigitalPin row, uint8_t rows,
+	       uint16_t ms = SAMPLE_MS);
+
+  /**
+   * Return number of columns.
+   * @return columns.
+   */
+  uint8_t columns() const
+  {
+    return (m_columns);
+  }
+
+  /**
+   * Return number of rows.
+   * @return rows.
+   */
+  uint8_t rows() const
+  {
+    return (m_rows);
+  }
+
+  /**
+   * Return debounced state of the given column; bit per row, set when
+   * the key is pressed.
+   * @param[in] column index.
+   * @return row bitset.
+   */
+  uint8_t state(uint8_t column) const
+  {
+    return (column < m_columns ? m_state[column] : 0);
+  }
+
+  /**
+   * Return true(1) if the given key is pressed (debounced) otherwise
+   * false(0).
+   * @param[in] nr key number (column * rows + row).
+   * @return bool.
+   */
+  bool is_pressed(uint8_t nr) const
+  {
+    return ((state(nr / m_rows) & _BV(nr % m_rows)) != 0);
+  }
+
+  /**
+   * @override{MatrixKeypad}
+   * Callback method when one or more keys have changed in a scan.
+   * The bitsets contain a row bitset per column for keys that have
+   * been pressed (down) and released (up). Default implementation
+   * calls on_key_down() and on_key_up() for each changed key.
+   * @param[in] down pressed keys bitset per column.
+   * @param[in] up released keys bitset per column.
+   */
+  virtual void on_change(const uint8_t* down, const uint8_t* up);
+
+  /**
+   * @override{MatrixKeypad}
+   * Callback method when a key down is detected. Default is null
+   * function.
+   * @param[in] nr key number (column * rows + row).
+   */
+  virtual void on_key_down(uint8_t nr)
+  {
+    UNUSED(nr);
+  }
+
+  /**
+   * @override{MatrixKeypad}
+   * Callback method when a key up is detected. Default is null
+   * function.
+   * @param[in] nr key number (column * rows + row).
+   */
+  virtual void on_key_up(uint8_t nr)
+  {
+    UNUSED(nr);
+  }
+
+protected:
+  /** Default scan period. */
+  static const uint16_t SAMPLE_MS = 16;
+
+  /** Column and row port registers. */
+  volatile uint8_t* const m_column_sfr;
+  volatile uint8_t* const m_row_sfr;
+
+  /** Column and row port masks; column bit position and rows shift. */
+  const uint8_t m_column_mask;
+  const uint8_t m_row_mask;
+  const uint8_t m_column_bit;
+  const uint8_t m_row_bit;
+  const uint8_t m_columns;
+  const uint8_t m_rows;
+
+  /** Debounced state and vertical counters per column. */
+  uint8_t m_state[COLUMN_MAX];
+  uint8_t m_cnt0[COLUMN_MAX];
+  uint8_t m_cnt1[COLUMN_MAX];
+
+  /**
+   * @override{Job}
+   * Periodic scan of the keypad matrix.
+   */
+  virtual void run();
+};
+
+#endif
@@ -0,0 +1,112 @@
+/**
+ * @file CosaBenchmarkCRC.ino
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * @section Description
+ * Cosa CRC Benchmark; number of micro-seconds and clock cycles per
+ * byte for the bitwise, nibble and byte table implementation of the
+ * CRC algorithms. The avr-libc CRC-16 update functions are measured
+ * as reference. The checksum is printed to allow verification of the
+ * variants.
+ *
+ * @section Circuit
+ * This example requires no special circuit. Uses serial output,
+ * internal timer for RTC and watchdog.
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#include "Cosa/CRC.hh"
+#include "Cosa/Memory.h"
+#include "Cosa/RTT.hh"
+#include "Cosa/Watchdog.hh"
+#include "Cosa/Trace.hh"
+#include "Cosa/UART.hh"
+#include <util/crc16.h>
+
+// Benchmark buffer and number of rounds
+static uint8_t buf[256];
+static const uint8_t ROUNDS = 16;
+
+#define MEASURE_CRC(type,fn)						\
+  do {									\
+    type crc = 0;							\
+    trace.flush();							\
+    uint32_t start = RTT::micros();					\
+    for (uint8_t n = 0; n < ROUNDS; n++)				\
+      for (uint16_t i = 0; i < sizeof(buf); i++)			\
+	crc = fn(crc, buf[i]);						\
+    uint32_t us = RTT::micros() - start;				\
+    trace << PSTR(#fn ":crc=") << hex << (uint32_t) crc			\
+	  << PSTR(":") << us << PSTR(" us:")				\
+	  << (us * I_CPU) / (ROUNDS * sizeof(buf))			\
+	  << PSTR(" cycles/byte") << endl;				\
+  } while (0)
+
+void setup()
+{
+  // Start the timers
+  Watchdog::begin();
+  RTT::begin();
+
+  // Start the trace output stream on the serial port
+  uart.begin(9600);
+  trace.begin(&uart, PSTR("CosaBenchmarkCRC: started"));
+
+  // Check amount of free memory
+  TRACE(free_memory());
+
+  // Print CPU clock and instructions per 1MHZ
+  TRACE(F_CPU);
+  TRACE(I_CPU);
+
+  // Fill the benchmark buffer
+  for (uint16_t i = 0; i < sizeof(buf); i++) buf[i] = rand();
+}
+
+void loop()
+{
+  MEASURE_CRC(uint8_t, _crc_ibutton_update);
+  MEASURE_CRC(uint8_t, CRC::Dallas::bitwise);
+  MEASURE_CRC(uint8_t, CRC::Dallas::nibble);
+  MEASURE_CRC(uint8_t, CRC::Dallas::table);
+  trace << endl;
+
+  MEASURE_CRC(uint16_t, _crc_ccitt_update);
+  MEASURE_CRC(uint16_t, CRC::CCITT::bitwise);
+  MEASURE_CRC(uint16_t, CRC::CCITT::nibble);
+  MEASURE_CRC(uint16_t, CRC::CCITT::table);
+  trace << endl;
+
+  MEASURE_CRC(uint16_t, _crc_xmodem_update);
+  MEASURE_CRC(uint16_t, CRC::XModem::bitwise);
+  MEASURE_CRC(uint16_t, CRC::XModem::nibble);
+  MEASURE_CRC(uint16_t, CRC::XModem::table);
+  trace << endl;
+
+  MEASURE_CRC(uint16_t, _crc16_update);
+  MEASURE_CRC(uint16_t, CRC::Modbus::bitwise);
+  MEASURE_CRC(uint16_t, CRC::Modbus::nibble);
+  MEASURE_CRC(uint16_t, CRC::Modbus::table);
+  trace << endl;
+
+  MEASURE_CRC(uint32_t, CRC::IEEE::bitwise);
+  MEASURE_CRC(uint32_t, CRC::IEEE::nibble);
+  MEASURE_CRC(uint32_t, CRC::IEEE::table);
+  trace << endl;
+
+  ASSERT(true == false);
+}
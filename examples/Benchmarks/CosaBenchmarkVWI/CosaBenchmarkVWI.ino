@@ -0,0 +1,191 @@
+/**
+ * @file CosaBenchmarkVWI.ino
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * @section Description
+ * Cosa VWI Receiver Benchmark; number of clock cycles per sample for
+ * the receiver phase locked loop with the generic receiver (virtual
+ * codec member functions) and the receiver specialized for the codec
+ * class (CodecReceiver). A message is encoded by the transmitter and
+ * the symbols are fed to the receivers, eight samples per bit, as the
+ * interrupt handler does. The sample loop overhead is measured and
+ * removed. The max bit rate is the limit given by the phase locked
+ * loop alone; the interrupt handler overhead is not included.
+ *
+ * @section Circuit
+ * This example requires no special circuit. Uses serial output,
+ * internal timer for RTC and watchdog.
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#include <VWI.h>
+#include <VirtualWireCodec.h>
+
+#include "Cosa/Memory.h"
+#include "Cosa/RTT.hh"
+#include "Cosa/Watchdog.hh"
+#include "Cosa/Trace.hh"
+#include "Cosa/UART.hh"
+
+// Codec to benchmark
+VirtualWireCodec codec;
+
+// Number of samples per bit, payload bytes and rounds
+static const uint8_t SAMPLES_PER_BIT = 8;
+static const uint8_t PAYLOAD = 30;
+static const uint8_t ROUNDS = 4;
+
+/**
+ * Transmitter with access to the encoded message symbols.
+ */
+class Transmitter : public VWI::Transmitter {
+public:
+  Transmitter(Board::DigitalPin pin, VWI::Codec* codec) :
+    VWI::Transmitter(pin, codec)
+  {}
+
+  uint8_t symbol(uint8_t ix) const { return (m_buffer[ix]); }
+  uint8_t length() const { return (m_length); }
+};
+
+/**
+ * Receiver sampling as the interrupt handler; RECEIVER is the
+ * generic or codec specialized receiver class.
+ */
+template<class RECEIVER>
+class Sampler : public RECEIVER {
+public:
+  Sampler(Board::DigitalPin pin, VirtualWireCodec* codec) :
+    RECEIVER(pin, codec)
+  {}
+
+  void reset()
+  {
+    this->begin();
+    this->m_done = false;
+    this->m_pll_ramp = 0;
+    this->m_integrator = 0;
+  }
+
+  void sample(uint8_t value)
+  {
+    this->m_sample = value;
+    if (this->m_pll == NULL)
+      this->PLL();
+    else
+      this->m_pll(this);
+  }
+};
+
+/**
+ * Null receiver; measures the sample loop overhead.
+ */
+class NullReceiver {
+public:
+  void reset() {}
+  void sample(uint8_t value) { m_sample = value; }
+  bool available() const { return (true); }
+protected:
+  volatile uint8_t m_sample;
+};
+
+Transmitter tx(Board::D7, &codec);
+Sampler<VWI::Receiver> rx(Board::D8, &codec);
+Sampler<VWI::CodecReceiver<VirtualWireCodec> > codec_rx(Board::D8, &codec);
+NullReceiver null_rx;
+VWI rf(0xC05A, 0x01, 4000, &tx);
+
+/**
+ * Feed the transmitter symbols to the given receiver. Return number
+ * of micro-seconds.
+ * @param[in] RECEIVER receiver class.
+ * @param[in] receiver to sample.
+ * @param[out] samples number of samples.
+ * @return micro-seconds.
+ */
+template<class RECEIVER>
+uint32_t run(RECEIVER& receiver, uint32_t& samples)
+{
+  uint32_t start = RTT::micros();
+  samples = 0;
+  for (uint8_t n = 0; n < ROUNDS; n++) {
+    receiver.reset();
+    for (uint8_t ix = 0; ix < tx.length(); ix++) {
+      uint8_t symbol = tx.symbol(ix);
+      for (uint8_t bit = 0; bit < VirtualWireCodec::BITS_PER_SYMBOL; bit++) {
+	uint8_t value = (symbol >> bit) & 1;
+	for (uint8_t i = 0; i < SAMPLES_PER_BIT; i++)
+	  receiver.sample(value);
+      }
+      samples += VirtualWireCodec::BITS_PER_SYMBOL * SAMPLES_PER_BIT;
+    }
+    for (uint8_t i = 0; i < SAMPLES_PER_BIT * 2; i++) receiver.sample(0);
+    samples += SAMPLES_PER_BIT * 2;
+    ASSERT(receiver.available());
+  }
+  return (RTT::micros() - start);
+}
+
+#define MEASURE_PLL(receiver)						\
+  do {									\
+    uint32_t samples;							\
+    trace.flush();							\
+    uint32_t us = run(receiver, samples) - overhead;			\
+    uint32_t cycles = (us * I_CPU) / samples;				\
+    trace << PSTR(#receiver ":") << us << PSTR(" us:")			\
+	  << cycles << PSTR(" cycles/sample:max ")			\
+	  << F_CPU / (cycles * SAMPLES_PER_BIT)				\
+	  << PSTR(" bps") << endl;					\
+  } while (0)
+
+void setup()
+{
+  // Start the timers
+  Watchdog::begin();
+  RTT::begin();
+
+  // Start the trace output stream on the serial port
+  uart.begin(9600);
+  trace.begin(&uart, PSTR("CosaBenchmarkVWI: started"));
+
+  // Check amount of free memory
+  TRACE(free_memory());
+
+  // Print CPU clock and instructions per 1MHZ
+  TRACE(F_CPU);
+  TRACE(I_CPU);
+
+  // Encode a message; the interrupt handler is not started
+  uint8_t msg[PAYLOAD];
+  for (uint8_t i = 0; i < sizeof(msg); i++) msg[i] = rand();
+  tx.send(0xff, 0, msg, sizeof(msg));
+  tx.end();
+}
+
+void loop()
+{
+  // Measure the sample loop overhead
+  uint32_t samples;
+  trace.flush();
+  uint32_t overhead = run(null_rx, samples);
+
+  MEASURE_PLL(rx);
+  MEASURE_PLL(codec_rx);
+  trace << endl;
+
+  ASSERT(true == false);
+}
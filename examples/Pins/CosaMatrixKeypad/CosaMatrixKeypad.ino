@@ -0,0 +1,86 @@
+/**
+ * @file CosaMatrixKeypad.ino
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * @section Description
+ * Cosa demonstration of the digital Matrix Keypad handler; trace of
+ * batched key changes and key down/up callbacks.
+ *
+ * @section Circuit
+ * @code
+ *                          4x4 Keypad
+ *                       +------------+
+ * (D8)----------------1-|C0          |
+ * (D9)----------------2-|C1          |
+ * (D10)---------------3-|C2          |
+ * (D11)---------------4-|C3          |
+ * (D4)----------------5-|R0          |
+ * (D5)----------------6-|R1          |
+ * (D6)----------------7-|R2          |
+ * (D7)----------------8-|R3          |
+ *                       +------------+
+ * @endcode
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#include "Cosa/MatrixKeypad.hh"
+#include "Cosa/Watchdog.hh"
+#include "Cosa/Trace.hh"
+#include "Cosa/UART.hh"
+
+class KeypadTrace : public MatrixKeypad {
+public:
+  KeypadTrace(Job::Scheduler* scheduler) :
+    MatrixKeypad(scheduler, Board::D8, 4, Board::D4, 4)
+  {}
+
+  virtual void on_change(const uint8_t* down, const uint8_t* up)
+  {
+    trace << PSTR("change:");
+    for (uint8_t column = 0; column < columns(); column++)
+      trace << ' ' << hex << down[column] << '/' << hex << up[column];
+    trace << endl;
+    MatrixKeypad::on_change(down, up);
+  }
+
+  virtual void on_key_down(uint8_t nr)
+  {
+    trace << PSTR("down:") << nr << endl;
+  }
+
+  virtual void on_key_up(uint8_t nr)
+  {
+    trace << PSTR("up:") << nr << endl;
+  }
+};
+
+Watchdog::Scheduler scheduler;
+KeypadTrace keypad(&scheduler);
+
+void setup()
+{
+  uart.begin(9600);
+  trace.begin(&uart, PSTR("CosaMatrixKeypad: started"));
+  Watchdog::begin();
+  Watchdog::job(&scheduler);
+  keypad.start();
+}
+
+void loop()
+{
+  Event::service();
+}
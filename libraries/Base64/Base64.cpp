@@ -106,75 +106,19 @@ Base64::encode_P(char* dest, const void* src, size_t size)
 int
 Base64::encode(IOStream::Device* dest, const void* src, size_t size)
 {
-  const uint8_t* sp = (const uint8_t*) src;
-  base64_t temp;
-  int res = 0;
-
-  // Encode three byte blocks with line break every 64 characters
-  while (size > 2) {
-    temp.d[2] = *sp++;
-    temp.d[1] = *sp++;
-    temp.d[0] = *sp++;
-    size = size - 3;
-    dest->putchar(encode(temp.c3));
-    dest->putchar(encode(temp.c2));
-    dest->putchar(encode(temp.c1));
-    dest->putchar(encode(temp.c0));
-    res = res + 4;
-    if ((res & 0x3f) == 0) dest->puts((str_P) IOStream::CRLF);
-  }
-
-  // Pad and encode any remaining bytes with possible line break
-  if (size != 0) {
-    temp.d[2] = *sp++;
-    temp.d[1] = size > 1 ? *sp : 0;
-    temp.d[0] = 0;
-    dest->putchar(encode(temp.c3));
-    dest->putchar(encode(temp.c2));
-    dest->putchar(size > 1 ? encode(temp.c1) : PAD);
-    dest->putchar(PAD);
-    res = res + 4;
-    if ((res & 0x3f) == 0) dest->puts((str_P) IOStream::CRLF);
-  }
-
-  return (res);
+  Encoder encoder(dest);
+  encoder.write(src, size);
+  encoder.flush();
+  return (encoder.length());
 }
 
 int
 Base64::encode_P(IOStream::Device* dest, const void* src, size_t size)
 {
-  const uint8_t* sp = (const uint8_t*) src;
-  base64_t temp;
-  int res = 0;
-
-  // Encode three byte blocks with line break every 64 characters
-  while (size > 2) {
-    temp.d[2] = pgm_read_byte(sp++);
-    temp.d[1] = pgm_read_byte(sp++);
-    temp.d[0] = pgm_read_byte(sp++);
-    size = size - 3;
-    dest->putchar(encode(temp.c3));
-    dest->putchar(encode(temp.c2));
-    dest->putchar(encode(temp.c1));
-    dest->putchar(encode(temp.c0));
-    res = res + 4;
-    if ((res & 0x3f) == 0) dest->puts((str_P) IOStream::CRLF);
-  }
-
-  // Pad and encode any remaining bytes with possible line break
-  if (size != 0) {
-    temp.d[2] = pgm_read_byte(sp++);
-    temp.d[1] = size > 1 ? pgm_read_byte(sp) : 0;
-    temp.d[0] = 0;
-    dest->putchar(encode(temp.c3));
-    dest->putchar(encode(temp.c2));
-    dest->putchar(size > 1 ? encode(temp.c1) : PAD);
-    dest->putchar(PAD);
-    res = res + 4;
-    if ((res & 0x3f) == 0) dest->puts((str_P) IOStream::CRLF);
-  }
-
-  return (res);
+  Encoder encoder(dest);
+  encoder.write_P(src, size);
+  encoder.flush();
+  return (encoder.length());
 }
 
 int
@@ -204,3 +148,173 @@ Base64::decode(void* dest, const char* src, size_t size)
   // Return number of bytes
   return (res);
 }
+
+void
+Base64::Encoder::encode(const uint8_t* src, uint8_t count)
+{
+  // Map three bytes to four characters; pad if less than three bytes.
+  // Write line when full
+  char* dp = &m_line[m_pos];
+  *dp++ = Base64::encode(src[0] >> 2);
+  *dp++ = Base64::encode(((src[0] & 0x03) << 4) | (src[1] >> 4));
+  *dp++ = count > 1 ? Base64::encode(((src[1] & 0x0f) << 2) | (src[2] >> 6)) : PAD;
+  *dp++ = count > 2 ? Base64::encode(src[2] & 0x3f) : PAD;
+  m_pos += 4;
+  m_col += 4;
+  m_length += 4;
+  if (m_col < LINE_MAX) return;
+  *dp++ = '\r';
+  *dp++ = '\n';
+  m_dev->write(m_line, m_pos + 2);
+  m_pos = 0;
+  m_col = 0;
+}
+
+int
+Base64::Encoder::putchar(char c)
+{
+  m_block[m_count++] = c;
+  if (m_count == sizeof(m_block)) {
+    encode(m_block);
+    m_count = 0;
+  }
+  return (c & 0xff);
+}
+
+int
+Base64::Encoder::write(const void* buf, size_t size)
+{
+  const uint8_t* bp = (const uint8_t*) buf;
+  size_t n = size;
+
+  // Complete partial block
+  while ((m_count != 0) && (n != 0)) {
+    putchar(*bp++);
+    n -= 1;
+  }
+
+  // Encode three byte blocks directly from buffer
+  while (n > 2) {
+    encode(bp);
+    bp += 3;
+    n -= 3;
+  }
+
+  // Keep any remaining bytes
+  while (n != 0) {
+    m_block[m_count++] = *bp++;
+    n -= 1;
+  }
+  return (size);
+}
+
+int
+Base64::Encoder::write_P(const void* buf, size_t size)
+{
+  const uint8_t* bp = (const uint8_t*) buf;
+  size_t n = size;
+  while (n != 0) {
+    uint8_t block[3 * 4];
+    size_t count = (n < sizeof(block)) ? n : sizeof(block);
+    memcpy_P(block, bp, count);
+    write(block, count);
+    bp += count;
+    n -= count;
+  }
+  return (size);
+}
+
+int
+Base64::Encoder::flush()
+{
+  // Pad and encode any remaining bytes
+  if (m_count != 0) {
+    for (uint8_t i = m_count; i < sizeof(m_block); i++) m_block[i] = 0;
+    encode(m_block, m_count);
+    m_count = 0;
+  }
+
+  // Write pending characters
+  if (m_pos == 0) return (0);
+  int res = m_dev->write(m_line, m_pos);
+  m_pos = 0;
+  return (res < 0 ? res : 0);
+}
+
+void
+Base64::Decoder::block()
+{
+  // Map four characters to three bytes; less if padded
+  uint8_t count = (m_pad == 0) ? 3 : m_count - 1;
+  if (m_pos + 3 > BUF_MAX) {
+    m_dev->write(m_buf, m_pos);
+    m_pos = 0;
+  }
+  uint8_t* dp = &m_buf[m_pos];
+  *dp++ = m_bits >> 16;
+  if (count > 1) *dp++ = m_bits >> 8;
+  if (count > 2) *dp++ = m_bits;
+  m_pos += count;
+  m_length += count;
+  m_bits = 0L;
+  m_count = 0;
+  m_pad = 0;
+}
+
+int
+Base64::Decoder::putchar(char c)
+{
+  int res = write(&c, 1);
+  return (res < 0 ? res : c & 0xff);
+}
+
+int
+Base64::Decoder::write(const void* buf, size_t size)
+{
+  const char* sp = (const char*) buf;
+  size_t n = size;
+  while (n != 0) {
+    // Decode four character blocks directly from buffer
+    if ((m_count == 0) && (n > 3)) {
+      uint8_t c0 = lookup(sp[0]);
+      uint8_t c1 = lookup(sp[1]);
+      uint8_t c2 = lookup(sp[2]);
+      uint8_t c3 = lookup(sp[3]);
+      if (((c0 | c1 | c2 | c3) & 0xc0) == 0) {
+	m_bits = ((uint32_t) c0 << 18) | ((uint32_t) c1 << 12) | (c2 << 6) | c3;
+	m_count = 4;
+	block();
+	sp += 4;
+	n -= 4;
+	continue;
+      }
+    }
+
+    // Skip white space; accumulate characters and padding
+    char c = *sp++;
+    n -= 1;
+    if (c == ' ' || c == '\t' || c == '\r' || c == '\n') continue;
+    if (c == PAD) {
+      if (UNLIKELY(m_count < 2)) return (EINVAL);
+      m_pad += 1;
+    }
+    else {
+      uint8_t bits = lookup(c);
+      if (UNLIKELY((bits == ILLEGAL) || (m_pad != 0))) return (EINVAL);
+      m_bits |= (uint32_t) bits << (18 - 6 * m_count);
+      m_count += 1;
+    }
+    if (m_count + m_pad == 4) block();
+  }
+  return (size);
+}
+
+int
+Base64::Decoder::flush()
+{
+  if (UNLIKELY(m_count + m_pad != 0)) return (EINVAL);
+  if (m_pos == 0) return (0);
+  int res = m_dev->write(m_buf, m_pos);
+  m_pos = 0;
+  return (res < 0 ? res : 0);
+}
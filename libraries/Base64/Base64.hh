@@ -29,6 +29,8 @@
  * 4 printable characters, 32-bits. Allows encoding directly to an
  * IOStream::Device such as the UART. Long string to an device is
  * broken into multiple lines with a max length of 64 characters.
+ * The streaming Encoder and Decoder are IOStream::Devices and
+ * handle data in arbitrary fragments.
  *
  * @section Acknowledgements
  * Inspired by implementation method by Bob Trower and Arduino Forum
@@ -98,6 +100,191 @@ public:
    */
   static int decode(void* dest, const char* src, size_t size);
 
+  /**
+   * Streaming Base64 encoder. Binary data written to the encoder is
+   * encoded and written to the output device in lines of 64
+   * characters. Data may be written in arbitrary fragments; a partial
+   * three byte block is kept until completed or flushed.
+   */
+  class Encoder : public IOStream::Device {
+  public:
+    /** Max number of characters per line. */
+    static const uint8_t LINE_MAX = 64;
+
+    /**
+     * Construct streaming encoder for given output device.
+     * @param[in] dev output device.
+     */
+    Encoder(IOStream::Device* dev) :
+      IOStream::Device(),
+      m_dev(dev)
+    {
+      reset();
+    }
+
+    /**
+     * Reset encoder state. Pending data is discarded.
+     */
+    void reset()
+    {
+      m_count = 0;
+      m_pos = 0;
+      m_col = 0;
+      m_length = 0;
+    }
+
+    /**
+     * Return number of encoded characters (excluding line breaks).
+     * @return length.
+     */
+    size_t length() const
+    {
+      return (m_length);
+    }
+
+    /**
+     * @override{IOStream::Device}
+     * Write character to encoder.
+     * @param[in] c character to write.
+     * @return character written.
+     */
+    virtual int putchar(char c);
+
+    /**
+     * @override{IOStream::Device}
+     * Write data from buffer with given size to encoder.
+     * @param[in] buf buffer to write.
+     * @param[in] size number of bytes to write.
+     * @return number of bytes written.
+     */
+    virtual int write(const void* buf, size_t size);
+
+    /**
+     * @override{IOStream::Device}
+     * Write data from buffer in program memory with given size to
+     * encoder.
+     * @param[in] buf buffer to write.
+     * @param[in] size number of bytes to write.
+     * @return number of bytes written.
+     */
+    virtual int write_P(const void* buf, size_t size);
+
+    /**
+     * @override{IOStream::Device}
+     * Encode any remaining bytes with padding and write the encoded
+     * characters to the output device. Should be called at end of
+     * data.
+     * @return zero(0) or negative error code.
+     */
+    virtual int flush();
+
+  protected:
+    IOStream::Device* m_dev;		//!< Output device.
+    uint8_t m_block[3];			//!< Partial block.
+    uint8_t m_count;			//!< Bytes in partial block.
+    char m_line[LINE_MAX + 2];		//!< Line buffer (with CRLF).
+    uint8_t m_pos;			//!< Characters in line buffer.
+    uint8_t m_col;			//!< Column in current line.
+    size_t m_length;			//!< Number of encoded characters.
+
+    /**
+     * Encode given three byte block to the line buffer. The block is
+     * padded if the given number of bytes is less than three. The
+     * line is written to the output device when full.
+     * @param[in] src block.
+     * @param[in] count number of bytes in block (default 3).
+     */
+    void encode(const uint8_t* src, uint8_t count = 3);
+  };
+
+  /**
+   * Streaming Base64 decoder. Characters written to the decoder are
+   * decoded and the binary data is written to the output device in
+   * blocks. Characters may be written in arbitrary fragments, e.g.
+   * directly from a Socket or the UART. White space and line breaks
+   * are skipped.
+   */
+  class Decoder : public IOStream::Device {
+  public:
+    /** Size of output buffer. */
+    static const uint8_t BUF_MAX = 48;
+
+    /**
+     * Construct streaming decoder for given output device.
+     * @param[in] dev output device.
+     */
+    Decoder(IOStream::Device* dev) :
+      IOStream::Device(),
+      m_dev(dev)
+    {
+      reset();
+    }
+
+    /**
+     * Reset decoder state. Pending data is discarded.
+     */
+    void reset()
+    {
+      m_bits = 0L;
+      m_count = 0;
+      m_pad = 0;
+      m_pos = 0;
+      m_length = 0;
+    }
+
+    /**
+     * Return number of decoded bytes.
+     * @return length.
+     */
+    size_t length() const
+    {
+      return (m_length);
+    }
+
+    /**
+     * @override{IOStream::Device}
+     * Write character to decoder.
+     * @param[in] c character to write.
+     * @return character written or negative error code (EINVAL).
+     */
+    virtual int putchar(char c);
+
+    /**
+     * @override{IOStream::Device}
+     * Write characters from buffer with given size to decoder.
+     * Returns number of characters or negative error code (EINVAL
+     * for illegal characters or padding).
+     * @param[in] buf buffer to write.
+     * @param[in] size number of characters to write.
+     * @return number of characters written or negative error code.
+     */
+    virtual int write(const void* buf, size_t size);
+
+    /**
+     * @override{IOStream::Device}
+     * Write the decoded data to the output device. Returns zero(0) or
+     * negative error code (EINVAL if a four character block is not
+     * completed).
+     * @return zero(0) or negative error code.
+     */
+    virtual int flush();
+
+  protected:
+    IOStream::Device* m_dev;		//!< Output device.
+    uint32_t m_bits;			//!< Partial block (6-bit groups).
+    uint8_t m_count;			//!< Characters in partial block.
+    uint8_t m_pad;			//!< Padding characters.
+    uint8_t m_buf[BUF_MAX];		//!< Output buffer.
+    uint8_t m_pos;			//!< Bytes in output buffer.
+    size_t m_length;			//!< Number of decoded bytes.
+
+    /**
+     * Write decoded bytes of the completed block to the output
+     * buffer. The buffer is written to the output device when full.
+     */
+    void block();
+  };
+
 private:
   /** Padding character for last encoded block */
   static const char PAD = '=';
@@ -142,6 +329,22 @@ private:
     uint8_t bits = pgm_read_byte(&DECODE[c - 43]);
     return (bits == '$' ? 0 : bits - 62);
   }
+
+  /** Illegal character marker for lookup(). */
+  static const uint8_t ILLEGAL = 0xff;
+
+  /**
+   * Decode given character to 6-bit number or ILLEGAL.
+   * @param[in] c character to decode.
+   * @return 6-bit representation or ILLEGAL.
+   */
+  static uint8_t lookup(char c)
+    __attribute__((always_inline))
+  {
+    if (UNLIKELY(c < 43 || c > 122)) return (ILLEGAL);
+    uint8_t bits = pgm_read_byte(&DECODE[c - 43]);
+    return (bits == '$' ? ILLEGAL : bits - 62);
+  }
 };
 
 #endif
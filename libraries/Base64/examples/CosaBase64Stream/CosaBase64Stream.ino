@@ -0,0 +1,107 @@
+/**
+ * @file CosaBase64Stream.ino
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * @section Description
+ * Demonstration and benchmark of the Base64 streaming encoder and
+ * decoder. A binary dump (program memory) is encoded in fragments to
+ * a buffer, decoded in fragments and verified. Prints the encode and
+ * decode time per byte. The encoded dump is also written to the UART.
+ *
+ * @section Circuit
+ * No special circuit. Uses UART, RTC/Timer and Watchdog.
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#include <Base64.h>
+
+#include "Cosa/IOBuffer.hh"
+#include "Cosa/RTT.hh"
+#include "Cosa/Watchdog.hh"
+#include "Cosa/Trace.hh"
+#include "Cosa/UART.hh"
+
+// Output device that verifies the decoded data against program memory
+class Verify : public IOStream::Device {
+public:
+  Verify(const uint8_t* src) : IOStream::Device(), m_src(src), errors(0) {}
+  virtual int write(const void* buf, size_t size)
+  {
+    const uint8_t* bp = (const uint8_t*) buf;
+    for (size_t i = 0; i < size; i++)
+      if (*bp++ != pgm_read_byte(m_src++)) errors += 1;
+    return (size);
+  }
+  const uint8_t* m_src;
+  uint16_t errors;
+};
+
+// Size of binary dump and fragments
+static const size_t DUMP_MAX = 360;
+static const size_t FRAGMENT_MAX = 17;
+
+void setup()
+{
+  uart.begin(57600);
+  trace.begin(&uart, PSTR("CosaBase64Stream: started"));
+  Watchdog::begin();
+  RTT::begin();
+}
+
+void loop()
+{
+  const uint8_t* dump = (const uint8_t*) 0;
+  IOBuffer<512> buffer;
+  uint32_t start, us;
+
+  // Encode the binary dump in fragments to the buffer
+  Base64::Encoder encoder(&buffer);
+  start = RTT::micros();
+  for (size_t pos = 0; pos < DUMP_MAX; pos += FRAGMENT_MAX) {
+    size_t size = DUMP_MAX - pos;
+    if (size > FRAGMENT_MAX) size = FRAGMENT_MAX;
+    encoder.write_P(dump + pos, size);
+  }
+  encoder.flush();
+  us = RTT::micros() - start;
+  trace << encoder.length() << PSTR(":encode:") << us << PSTR(" us, ")
+	<< (float) us / DUMP_MAX << PSTR(" us/byte")
+	<< endl;
+
+  // Decode the characters in fragments from the buffer and verify
+  Verify verify(dump);
+  Base64::Decoder decoder(&verify);
+  char fragment[FRAGMENT_MAX];
+  int n;
+  start = RTT::micros();
+  while ((n = buffer.read(fragment, sizeof(fragment))) > 0)
+    ASSERT(decoder.write(fragment, n) == n);
+  ASSERT(decoder.flush() == 0);
+  us = RTT::micros() - start;
+  trace << decoder.length() << PSTR(":decode:") << us << PSTR(" us, ")
+	<< (float) us / DUMP_MAX << PSTR(" us/byte, ")
+	<< verify.errors << PSTR(" errors")
+	<< endl;
+
+  // Encode the binary dump directly to the UART
+  Base64::Encoder uart_encoder(&uart);
+  uart_encoder.write_P(dump, DUMP_MAX);
+  uart_encoder.flush();
+  trace << endl;
+
+  sleep(5);
+}
@@ -29,12 +29,24 @@
  */
 class BitstuffingCodec : public VWI::Codec {
 public:
+  /** Bits per symbol. */
+  static const uint8_t BITS_PER_SYMBOL = 5;
+
+  /** Start symbol. */
+  static const uint16_t START_SYMBOL = 0x34a;
+
+  /** Symbol mask. */
+  static const uint8_t SYMBOL_MASK = (1 << BITS_PER_SYMBOL) - 1;
+
+  /** Symbol MSB. */
+  static const uint16_t BITS_MSB = 1 << (BITS_PER_SYMBOL * 2 - 1);
+
   /**
    * Construct fixed bitstuffing codec with given bits per symbol,
    * start symbol, and preamble size.
    */
   BitstuffingCodec() :
-    VWI::Codec(5, 0x34a, 8)
+    VWI::Codec(BITS_PER_SYMBOL, START_SYMBOL, 8)
   {
   }
 
@@ -29,12 +29,24 @@
  */
 class Block4B5BCodec : public VWI::Codec {
 public:
+  /** Bits per symbol. */
+  static const uint8_t BITS_PER_SYMBOL = 5;
+
+  /** Start symbol. */
+  static const uint16_t START_SYMBOL = 0x238;
+
+  /** Symbol mask. */
+  static const uint8_t SYMBOL_MASK = (1 << BITS_PER_SYMBOL) - 1;
+
+  /** Symbol MSB. */
+  static const uint16_t BITS_MSB = 1 << (BITS_PER_SYMBOL * 2 - 1);
+
   /**
    * Construct block 4b5b codec with given bits per symbol,
    * start symbol, and preamble size.
    */
   Block4B5BCodec() :
-    VWI::Codec(5, 0x238, 8)
+    VWI::Codec(BITS_PER_SYMBOL, START_SYMBOL, 8)
   {
   }
 
@@ -22,6 +22,33 @@
 
 Flash::Device* CFFS::device = NULL;
 uint32_t CFFS::current_dir_addr = 0L;
+BitSet<CFFS::SECTOR_MAX> CFFS::free_sector;
+BitSet<CFFS::SECTOR_MAX> CFFS::deleted_sector;
+uint8_t CFFS::wear[CFFS::SECTOR_MAX];
+uint32_t CFFS::wear_base = 0L;
+uint16_t CFFS::free_hint = 1;
+uint8_t CFFS::open_files = 0;
+uint32_t CFFS::dirty_dir = CFFS::NULL_REF;
+uint32_t CFFS::compact_dir = CFFS::NULL_REF;
+uint32_t CFFS::compact_spare = CFFS::NULL_REF;
+uint8_t CFFS::dir_hash[CFFS::DIR_ENTRY_MAX];
+uint32_t CFFS::dir_hash_addr = CFFS::NULL_REF;
+uint8_t CFFS::dir_hash_count = 0;
+
+/**
+ * Return true if the given buffer is erased (all bytes 0xff)
+ * otherwise false.
+ * @param[in] buf buffer to check.
+ * @param[in] size of buffer.
+ * @return bool.
+ */
+static bool
+is_erased(const void* buf, size_t size)
+{
+  const uint8_t* bp = (const uint8_t*) buf;
+  while (size--) if (*bp++ != 0xff) return (false);
+  return (true);
+}
 
 int
 CFFS::File::open(const char* filename, uint8_t oflag)
@@ -37,6 +64,10 @@ CFFS::File::open(const char* filename, uint8_t oflag)
     m_current_addr = m_entry.ref + sizeof(CFFS::descr_t);
     m_current_pos = 0L;
     m_file_size = 0L;
+    m_hint_addr = m_entry.ref;
+    m_hint_slot = 0;
+    m_hint_pos = m_current_addr;
+    index_reset();
   }
 
   // Check that the file exists; open file
@@ -44,7 +75,8 @@ CFFS::File::open(const char* filename, uint8_t oflag)
     if ((oflag & O_WRITE) == 0) oflag |= O_READ;
     int res = lookup(filename, m_entry, m_entry_addr);
     if (res < 0) return (res);
-    res = find_end_of_file(m_entry.ref, m_current_addr, m_file_size);
+    index_reset();
+    res = find_end();
     if (res < 0) return (res);
     m_current_pos = m_file_size;
   }
@@ -53,10 +85,12 @@ CFFS::File::open(const char* filename, uint8_t oflag)
   if (((oflag & O_RDWR) == O_READ) || (oflag & O_CREAT)) {
     m_current_addr = m_entry.ref + sizeof(CFFS::descr_t);
     m_current_pos = 0L;
+    m_current_block = 0;
   }
 
   // Save flags
   m_flags = oflag;
+  open_files += 1;
   return (0);
 }
 
@@ -65,6 +99,7 @@ CFFS::File::remove()
 {
   if (m_flags == 0) return (ENXIO);
   m_flags = 0;
+  open_files -= 1;
   return (CFFS::remove(m_entry_addr, FILE_ENTRY_TYPE));
 }
 
@@ -72,8 +107,14 @@ int
 CFFS::File::close()
 {
   if (m_flags == 0) return (ENXIO);
+  int res = 0;
+  if (m_flags & O_WRITE) {
+    res = write_hint();
+    if (res == 0) res = flush();
+  }
   m_flags = 0;
-  return (0);
+  open_files -= 1;
+  return (res);
 }
 
 int
@@ -86,33 +127,15 @@ CFFS::File::seek(uint32_t pos, uint8_t whence)
   // Fix: Should implement all seek variants
   if (whence != SEEK_SET) return (EINVAL);
 
-  // Find sector and position in sector
-  descr_t entry;
-  uint32_t addr = m_entry.ref;
+  // Find block and position in block
+  const uint32_t BLOCK_DATA = device->SECTOR_BYTES - sizeof(descr_t);
+  uint16_t block = pos / BLOCK_DATA;
+  uint32_t addr;
+  int res = find_block(block, addr);
+  if (res < 0) return (res);
+  m_current_block = block;
+  m_current_addr = addr + sizeof(descr_t) + (pos % BLOCK_DATA);
   m_current_pos = pos;
-  while (pos != 0) {
-    // Read sector header and check that it is a file block
-    if (device->read(&entry, addr, sizeof(entry)) != sizeof(entry))
-      return (EIO);
-    if (entry.type != FILE_BLOCK_TYPE)
-      return (ENXIO);
-    // Check if additional sector skip is needed
-    uint32_t size = entry.size - sizeof(descr_t);
-    if (pos >= size) {
-      addr = entry.ref;
-      if (addr == NULL_REF)
-	return (ENXIO);
-      pos -= size;
-      // First byte in next sector
-      if (pos == 0)
-	m_current_addr = addr + sizeof(descr_t);
-    }
-    else {
-      // Byte in current sector
-      m_current_addr = addr + sizeof(descr_t) + pos;
-      pos = 0;
-    }
-  }
 
   // Found the position
   return (0);
@@ -130,6 +153,12 @@ CFFS::File::write_P(const void* buf, size_t size)
   return (write(buf, size, true));
 }
 
+int
+CFFS::File::flush()
+{
+  return (device->flush() < 0 ? EIO : 0);
+}
+
 int
 CFFS::File::getchar()
 {
@@ -153,6 +182,7 @@ CFFS::File::read(void* buf, size_t size)
   while (size != 0) {
     int res = CFFS::read(buf, m_current_addr, size);
     if (res < 0) return (EIO);
+    buf = (uint8_t*) buf + res;
     size -= res;
     m_current_pos += res;
     m_current_addr += res;
@@ -167,6 +197,8 @@ CFFS::File::read(void* buf, size_t size)
       if (header.size != device->SECTOR_BYTES) return (ENXIO);
       if (header.ref == NULL_REF) return (ENXIO);
       m_current_addr = header.ref + sizeof(header);
+      m_current_block += 1;
+      index_block(m_current_block, header.ref);
     }
   }
 
@@ -192,6 +224,7 @@ CFFS::File::write(const void* buf, size_t size, bool progmem)
     else
       res = CFFS::write(m_current_addr, buf, size);
     if (res < 0) return (res);
+    buf = (const uint8_t*) buf + res;
     m_current_addr += res;
     m_current_pos += res;
     m_file_size += res;
@@ -219,33 +252,228 @@ CFFS::File::write(const void* buf, size_t size, bool progmem)
 
       // Continue write in new sector
       m_current_addr = sector + sizeof(header);
+      m_current_block += 1;
+      index_block(m_current_block, sector);
     }
   }
   return (count);
 }
 
+void
+CFFS::File::index_block(uint16_t block, uint32_t addr)
+{
+  // Record every stride block in order
+  if (block & ((1 << m_index_shift) - 1)) return;
+  uint16_t ix = block >> m_index_shift;
+  if (ix != m_index_count) return;
+
+  // Double the stride when the index is full; keep every other block
+  if (ix == INDEX_MAX) {
+    m_index_shift += 1;
+    for (uint8_t i = 0; 2 * i < INDEX_MAX; i++) m_index[i] = m_index[2 * i];
+    m_index_count = (INDEX_MAX + 1) / 2;
+    if (block & ((1 << m_index_shift) - 1)) return;
+    ix = block >> m_index_shift;
+  }
+  m_index[ix] = addr;
+  m_index_count += 1;
+}
+
+int
+CFFS::File::find_block(uint16_t block, uint32_t &addr)
+{
+  // Start from the closest indexed block
+  uint16_t ix = block >> m_index_shift;
+  if (ix >= m_index_count) ix = m_index_count - 1;
+  uint16_t nr = ix << m_index_shift;
+  addr = m_index[ix];
+
+  // Follow the sector chain to the block
+  block_t header;
+  while (nr < block) {
+    if (device->read(&header, addr, sizeof(header)) != sizeof(header))
+      return (EIO);
+    if (header.type != FILE_BLOCK_TYPE) return (ENXIO);
+    if (header.ref == NULL_REF) return (ENXIO);
+    addr = header.ref;
+    nr += 1;
+    index_block(nr, addr);
+  }
+  return (0);
+}
+
+int
+CFFS::File::find_end()
+{
+  // Follow the end of file hint log from the first block
+  block_t header;
+  hint_t hint;
+  hint.pos = 0L;
+  hint.block = 0;
+  m_hint_addr = m_entry.ref;
+  while (1) {
+    if (device->read(&header, m_hint_addr, sizeof(header)) != sizeof(header))
+      return (EIO);
+    if (header.type != FILE_BLOCK_TYPE) return (ENXIO);
+    uint8_t slot = 0;
+    while ((slot < HINT_MAX) && (header.hint[slot].pos != NULL_REF)) slot++;
+    m_hint_slot = slot;
+    if (slot == 0) break;
+    hint = header.hint[slot - 1];
+    // Blocks without hint log (zero filled)
+    if (hint.pos == 0L) {
+      m_hint_slot = HINT_MAX;
+      break;
+    }
+    if (slot < HINT_MAX) break;
+    // The log continues in the block of the last hint
+    uint32_t addr = hint.pos & ~device->SECTOR_MASK;
+    if (addr == m_hint_addr) break;
+    m_hint_addr = addr;
+  }
+  m_hint_pos = hint.pos;
+
+  // Follow the sector chain from the hint to the last block
+  uint32_t addr = m_entry.ref;
+  uint16_t block = 0;
+  if (hint.pos != 0L) {
+    addr = hint.pos & ~device->SECTOR_MASK;
+    block = hint.block;
+  }
+  while (1) {
+    if (device->read(&header, addr, sizeof(header)) != sizeof(header))
+      return (EIO);
+    if (header.type != FILE_BLOCK_TYPE) return (ENXIO);
+    if (header.size != device->SECTOR_BYTES) return (ENXIO);
+    if (header.ref == NULL_REF) break;
+    addr = header.ref;
+    block += 1;
+    index_block(block, addr);
+  }
+  uint32_t sector = addr;
+
+  // Locate the end of the last block; scan backwards from the end of
+  // the sector for the last written byte. A hint in the last block is
+  // a lower bound; data may have been appended after the hint
+  uint32_t pos = sector + sizeof(header);
+  if (((hint.pos & ~device->SECTOR_MASK) == sector) && (hint.pos > pos))
+    pos = hint.pos;
+  uint8_t buf[256];
+  addr = sector + device->SECTOR_BYTES;
+  while (addr > pos) {
+    size_t size = addr - pos;
+    if (size > sizeof(buf)) size = sizeof(buf);
+    addr -= size;
+    if (device->read(buf, addr, size) != (int) size) return (EIO);
+    while ((size > 0) && (buf[size - 1] == 0xff)) size--;
+    if (size != 0) {
+      pos = addr + size;
+      break;
+    }
+  }
+
+  // And set position, block and size
+  const uint32_t BLOCK_DATA = device->SECTOR_BYTES - sizeof(header);
+  m_current_addr = pos;
+  m_current_block = block;
+  m_file_size = block * BLOCK_DATA + (pos - sector) - sizeof(header);
+  return (0);
+}
+
+int
+CFFS::File::write_hint()
+{
+  // Check if the end of file has changed and there is a free hint
+  uint32_t pos = m_current_addr;
+  if ((pos == m_hint_pos) || (m_hint_slot >= HINT_MAX)) return (0);
+
+  // The last hint must continue the log in another block
+  uint32_t sector = pos & ~device->SECTOR_MASK;
+  if ((m_hint_slot == HINT_MAX - 1) && (sector == m_hint_addr)) return (0);
+
+  // Append the hint to the log
+  hint_t hint;
+  hint.pos = pos;
+  hint.block = m_current_block;
+  uint32_t addr = m_hint_addr + offsetof(block_t, hint) + m_hint_slot * sizeof(hint);
+  if (device->write(addr, &hint, sizeof(hint)) != sizeof(hint)) return (EIO);
+  m_hint_pos = pos;
+  m_hint_slot += 1;
+  if (m_hint_slot == HINT_MAX) {
+    m_hint_addr = sector;
+    m_hint_slot = 0;
+  }
+  return (0);
+}
+
 bool
 CFFS::begin(Flash::Device* flash)
 {
   // Check that the file system access is not already initiated
   if (device != NULL) return (false);
+  device = flash;
+
+  // Build the free and deleted sector maps, and the wear table. The
+  // first sector holds the file system header and is never free. A
+  // spare with a complete compaction copy is finished below; a spare
+  // with an incomplete copy is deleted
+  sector_t header;
+  uint32_t spare = NULL_REF;
+  free_sector.empty();
+  deleted_sector.empty();
+  wear_base = NULL_REF;
+  free_hint = 1;
+  open_files = 0;
+  dir_hash_addr = NULL_REF;
+  compact_dir = NULL_REF;
+  compact_spare = NULL_REF;
+  uint32_t addr = flash->SECTOR_BYTES;
+  for (uint16_t i = 1; i < sector_max(); i++, addr += flash->SECTOR_BYTES) {
+    if (flash->read(&header, addr, sizeof(header)) != sizeof(header)) {
+      device = NULL;
+      return (false);
+    }
+    if (header.type == FREE_TYPE)
+      free_sector += i;
+    else if ((header.type & ALLOC_MASK) == 0)
+      deleted_sector += i;
+    else if (header.type == COMPACT_TYPE) {
+      if (((spare_t*) &header)->state == NULL_REF)
+	deleted_sector += i;
+      else
+	spare = addr;
+    }
+    set_wear(i, header.erases == NULL_REF ? 0L : header.erases);
+  }
+
+  // Finish an interrupted directory compaction before the directory
+  // sector is checked; it may be the first sector
+  if ((spare != NULL_REF) && (compact_finish(spare) != 0)) {
+    device = NULL;
+    return (false);
+  }
 
   // Check that the device is formatted and contains a file system
   descr_t entry;
-  uint32_t addr = 0L;
+  addr = 0L;
   if ((flash->read(&entry, addr, sizeof(entry)) != sizeof(entry))
-      || (entry.type != CFFS_TYPE))
+      || (entry.type != CFFS_TYPE)) {
+    device = NULL;
     return (false);
+  }
   addr += sizeof(entry);
   if ((flash->read(&entry, addr, sizeof(entry)) != sizeof(entry))
       || (entry.type != DIR_BLOCK_TYPE)
       || (entry.ref != addr)
-      || strcmp_P(entry.name, PSTR("..")))
+      || strcmp_P(entry.name, PSTR(".."))) {
+    device = NULL;
     return (false);
+  }
 
-  // A file system and root directory exists
-  device = flash;
+  // A file system and root directory exists; the collector checks
+  // the root directory for deleted entries
   current_dir_addr = addr;
+  dirty_dir = addr;
   return (true);
 }
 
@@ -327,18 +555,25 @@ CFFS::format(Flash::Device* flash, const char* name)
   // Check that the drive name is not too long
   if (strlen(name) >= FILENAME_MAX) return (ENAMETOOLONG);
 
-  // Erase sectors
-  descr_t header;
+  // Erase sectors; keep the erase count of data sectors
+  sector_t sector;
   uint32_t addr = 0L;
   const uint8_t SIZE = flash->SECTOR_BYTES / 1024;
   for (uint16_t i = 0; i < flash->SECTOR_MAX; i++) {
-    if (flash->read(&header, addr, sizeof(header)) != sizeof(header))
+    if (flash->read(&sector, addr, sizeof(sector)) != sizeof(sector))
       return (EIO);
-    if (header.type != FREE_TYPE) {
+    if (sector.type != FREE_TYPE) {
       if (flash->erase(addr, SIZE) != 0) return (EIO);
+      if (i != 0) {
+	uint32_t erases = (sector.erases == NULL_REF ? 0L : sector.erases) + 1;
+	if (flash->write(addr + offsetof(sector_t, erases),
+			 &erases, sizeof(erases)) != sizeof(erases))
+	  return (EIO);
+      }
     }
     addr += flash->SECTOR_BYTES;
   }
+  descr_t header;
 
   // Write file system header with drive name
   addr = 0L;
@@ -368,16 +603,18 @@ CFFS::lookup(const char* filename, descr_t &entry, uint32_t& addr)
   // Check that the file system driver is initiated
   if (device == NULL) return (ENXIO);
 
-  // Read current director and lookup entry with given filename
+  // Build the directory index if needed
+  int res = dir_index();
+  if (res < 0) return (res);
+
+  // Read entries in current directory with matching hash
+  uint8_t h = hash(filename);
   addr = current_dir_addr;
-  if (device->read(&entry, addr, sizeof(entry)) != sizeof(entry))
-    return (EIO);
-  const uint16_t ENTRY_MAX = entry.size / sizeof(descr_t);
-  addr = entry.ref;
-  for (uint16_t i = 0; i < ENTRY_MAX; i++, addr += sizeof(descr_t)) {
+  for (uint8_t i = 0; i < dir_hash_count; i++, addr += sizeof(descr_t)) {
+    if (dir_hash[i] == FREE_HASH) break;
+    if (dir_hash[i] != h) continue;
     if (device->read(&entry, addr, sizeof(entry)) != sizeof(entry))
       return (EIO);
-    if (entry.type == FREE_TYPE) break;
     if ((entry.type & ALLOC_MASK) == 0) continue;
     if (strcmp(filename, entry.name)) continue;
     return (0);
@@ -387,6 +624,47 @@ CFFS::lookup(const char* filename, descr_t &entry, uint32_t& addr)
   return (ENOENT);
 }
 
+uint8_t
+CFFS::hash(const char* filename)
+{
+  // FNV-1a hash folded to the range 1..254
+  uint16_t h = 0x811c;
+  while (*filename) h = (h ^ (uint8_t) *filename++) * 193;
+  return ((h ^ (h >> 8)) % 254 + 1);
+}
+
+int
+CFFS::dir_index()
+{
+  // Check if the current directory is already indexed
+  if (dir_hash_addr == current_dir_addr) return (0);
+
+  // Read directory header for number of entries
+  uint32_t addr = current_dir_addr;
+  descr_t entry;
+  dir_hash_addr = NULL_REF;
+  if (device->read(&entry, addr, sizeof(entry)) != sizeof(entry))
+    return (EIO);
+  uint16_t count = entry.size / sizeof(entry);
+  if (count > DIR_ENTRY_MAX) count = DIR_ENTRY_MAX;
+
+  // Hash the entry names; stop at the first free entry
+  uint8_t i = 0;
+  for (; i < count; i++, addr += sizeof(entry)) {
+    if (device->read(&entry, addr, sizeof(entry)) != sizeof(entry))
+      return (EIO);
+    if (entry.type == FREE_TYPE) break;
+    if ((entry.type & ALLOC_MASK) == 0)
+      dir_hash[i] = DELETED_HASH;
+    else
+      dir_hash[i] = hash(entry.name);
+  }
+  memset(dir_hash + i, FREE_HASH, count - i);
+  dir_hash_count = count;
+  dir_hash_addr = current_dir_addr;
+  return (0);
+}
+
 int
 CFFS::create(const char* filename, uint16_t type, uint8_t flags,
 	     descr_t &entry, uint32_t &addr)
@@ -398,20 +676,25 @@ CFFS::create(const char* filename, uint16_t type, uint8_t flags,
   if ((type != DIR_ENTRY_TYPE) && (type != FILE_ENTRY_TYPE)) return (EINVAL);
   if (strlen(filename) >= FILENAME_MAX) return (ENAMETOOLONG);
 
-  // Search through the current directory
+  // Build the directory index if needed
+  int res = dir_index();
+  if (res < 0) return (res);
+
+  // Search through the current directory; read entries with matching
+  // hash and the first free entry
+  uint8_t h = hash(filename);
   addr = current_dir_addr;
-  if (device->read(&entry, addr, sizeof(entry)) != sizeof(entry))
-    return (EIO);
-  uint16_t ENTRY_MAX = entry.size / sizeof(descr_t);
-  for (uint16_t i = 0; i < ENTRY_MAX; i++, addr += sizeof(descr_t)) {
+  for (uint8_t i = 0; i < dir_hash_count; i++, addr += sizeof(descr_t)) {
+    // Skip deleted entries and entries with other names
+    if (dir_hash[i] == DELETED_HASH) continue;
+    if ((dir_hash[i] != h) && (dir_hash[i] != FREE_HASH)) continue;
     if (device->read(&entry, addr, sizeof(entry)) != sizeof(entry))
       return (EIO);
-    // Skip deleted entries
     if ((entry.type & ALLOC_MASK) == 0) continue;
     // Check if file name is already used; error or remove
     if (!strcmp(filename, entry.name)) {
       if ((flags & O_EXCL) || (type == DIR_ENTRY_TYPE)) return (EEXIST);
-      int res = remove(addr, entry.type);
+      res = remove(addr, entry.type);
       if (res < 0) return (res);
     }
     else if (entry.type == FREE_TYPE) {
@@ -429,14 +712,18 @@ CFFS::create(const char* filename, uint16_t type, uint8_t flags,
       strcpy(entry.name, filename);
       entry.type = type;
       entry.size = sizeof(entry);
-      // Write the entry and return the address
+      // Write the entry, update the index and return the address
+      compact_check(addr);
       if (device->write(addr, &entry, sizeof(entry)) != sizeof(entry))
 	return (EIO);
+      dir_hash[i] = h;
       return (0);
     }
   }
 
-  // Directory is full
+  // Directory is full; the collector compacts it if there are
+  // deleted entries
+  dirty_dir = current_dir_addr;
   return (ENOSPC);
 }
 
@@ -456,16 +743,26 @@ CFFS::remove(uint32_t addr, uint16_t type)
   // Save reference to sector to erase
   uint32_t ref = entry.ref;
 
-  // Mark the entry as removed in the directory block
+  // Mark the entry as removed in the directory block and index
+  compact_check(addr);
   memset(&entry, 0, sizeof(entry));
   if (device->write(addr, &entry, sizeof(entry)) != sizeof(entry))
     return (EIO);
+  if ((addr >= dir_hash_addr)
+      && (addr < dir_hash_addr + dir_hash_count * sizeof(descr_t)))
+    dir_hash[(addr - dir_hash_addr) / sizeof(descr_t)] = DELETED_HASH;
 
-  // Erase sectors
+  // Track the directory block with deleted entries
+  dirty_dir = dir_block(addr);
+
+  // Mark sectors deleted; erased by the garbage collector
   while (ref != NULL_REF) {
     if (device->read(&entry, ref, sizeof(entry)) != sizeof(entry))
       return (EIO);
-    if (device->erase(ref, entry.size / 1024) != 0) return (EIO);
+    entry.type &= ~ALLOC_MASK;
+    if (device->write(ref, &entry.type, sizeof(entry.type)) != sizeof(entry.type))
+      return (EIO);
+    deleted_sector += ref / device->SECTOR_BYTES;
     ref = entry.ref;
   }
   return (0);
@@ -498,33 +795,332 @@ CFFS::write_P(uint32_t dest, const void* src, size_t size)
   return (device->write_P(dest, src, size));
 }
 
+void
+CFFS::mark_sector(uint32_t addr, bool free)
+{
+  uint16_t ix = addr / device->SECTOR_BYTES;
+  if (free) {
+    free_sector += ix;
+  }
+  else {
+    free_sector -= ix;
+    free_hint = ix + 1;
+  }
+}
+
+void
+CFFS::set_wear(uint16_t ix, uint32_t erases)
+{
+  uint16_t max = sector_max();
+
+  // Rebase the wear table if the sector is less worn than the base
+  if (erases < wear_base) {
+    uint32_t delta = wear_base - erases;
+    for (uint16_t i = 1; i < max; i++) {
+      uint32_t count = wear[i] + delta;
+      wear[i] = (count > UINT8_MAX) ? UINT8_MAX : count;
+    }
+    wear_base = erases;
+  }
+  uint32_t count = erases - wear_base;
+  wear[ix] = (count > UINT8_MAX) ? UINT8_MAX : count;
+  if (wear[ix] != UINT8_MAX) return;
+
+  // Saturated; rebase on the least worn sector
+  uint8_t min = UINT8_MAX;
+  for (uint16_t i = 1; i < max; i++)
+    if (wear[i] < min) min = wear[i];
+  if (min == 0) return;
+  for (uint16_t i = 1; i < max; i++) wear[i] -= min;
+  wear_base += min;
+}
+
+int
+CFFS::erase_sector(uint32_t addr, uint32_t erases)
+{
+  // Erase the sector and mark as no longer deleted
+  if (device->erase(addr, device->SECTOR_BYTES / 1024) != 0) return (EIO);
+  uint16_t ix = addr / device->SECTOR_BYTES;
+  deleted_sector -= ix;
+  if (addr == 0L) return (0);
+
+  // Write the new erase count to the sector header
+  erases = (erases == NULL_REF ? 0L : erases) + 1;
+  if (device->write(addr + offsetof(sector_t, erases), &erases, sizeof(erases))
+      != sizeof(erases))
+    return (EIO);
+  set_wear(ix, erases);
+  return (0);
+}
+
+int
+CFFS::erase_deleted()
+{
+  // Find the least worn deleted sector
+  uint16_t max = sector_max();
+  uint16_t sector = 0;
+  for (uint16_t ix = 1; ix < max; ix++) {
+    if (!deleted_sector[ix]) continue;
+    if ((sector == 0) || (wear[ix] < wear[sector])) sector = ix;
+  }
+  if (sector == 0) return (0);
+
+  // Erase the sector and mark as free
+  uint32_t addr = sector * device->SECTOR_BYTES;
+  sector_t header;
+  if (device->read(&header, addr, sizeof(header)) != sizeof(header))
+    return (EIO);
+  if (erase_sector(addr, header.erases) != 0) return (EIO);
+  mark_sector(addr, true);
+  return (1);
+}
+
+int
+CFFS::compact_begin(uint32_t dir, uint8_t min)
+{
+  // Read the directory block header for the size of the block
+  descr_t entry;
+  if (device->read(&entry, dir, sizeof(entry)) != sizeof(entry))
+    return (EIO);
+  if (entry.type != DIR_BLOCK_TYPE) return (EINVAL);
+  uint32_t dir_end = dir + entry.size;
+
+  // Count the deleted entries; free entries are last in the block
+  uint16_t deleted = 0;
+  uint32_t addr = dir;
+  for (; addr < dir_end; addr += sizeof(entry)) {
+    if (device->read(&entry, addr, sizeof(entry.type)) != sizeof(entry.type))
+      return (EIO);
+    if (entry.type == FREE_TYPE) break;
+    if ((entry.type & ALLOC_MASK) == 0) deleted += 1;
+  }
+  if ((deleted == 0) || ((deleted < min) && (addr != dir_end))) return (0);
+
+  // Read the erase count of the source sector; none for the first
+  uint32_t sector = dir & ~device->SECTOR_MASK;
+  uint32_t erases = NULL_REF;
+  if (sector != 0L) {
+    sector_t header;
+    if (device->read(&header, sector, sizeof(header)) != sizeof(header))
+      return (EIO);
+    erases = header.erases;
+  }
+
+  // Allocate the spare and write the compaction marker before the
+  // copy. The source sector header is saved in the last entry of the
+  // compacted directory block; it is free as there are deleted entries
+  uint32_t spare = find_free_sector();
+  if (spare == 0L) return (ENOSPC);
+  mark_sector(spare, false);
+  spare_t marker;
+  memset(&marker, 0xff, sizeof(marker));
+  marker.type = COMPACT_TYPE;
+  marker.ref = sector;
+  marker.source = erases;
+  marker.saved = dir_end - sizeof(entry) - sector;
+  compact_dir = dir;
+  compact_spare = spare;
+  if (device->write(spare, &marker, sizeof(marker)) != sizeof(marker)) {
+    compact_check(dir);
+    return (EIO);
+  }
+
+  // Copy the sector to the spare; pack the entries in the directory
+  // block and skip deleted entries
+  uint32_t dest = spare;
+  for (uint32_t src = sector; src < sector + device->SECTOR_BYTES;
+       src += sizeof(entry)) {
+    if (device->read(&entry, src, sizeof(entry)) != sizeof(entry)) {
+      compact_check(dir);
+      return (EIO);
+    }
+    if ((src < dir) || (src >= dir_end))
+      dest = spare + (src - sector);
+    else if ((entry.type & ALLOC_MASK) == 0)
+      continue;
+    if (!is_erased(&entry, sizeof(entry))) {
+      addr = (dest == spare) ? spare + marker.saved : dest;
+      if (device->write(addr, &entry, sizeof(entry)) != sizeof(entry)) {
+	compact_check(dir);
+	return (EIO);
+      }
+    }
+    dest += sizeof(entry);
+  }
+  return (1);
+}
+
+int
+CFFS::compact_end()
+{
+  // Directory entries are moved; no files may be open
+  if (open_files != 0) return (EBUSY);
+
+  // Commit the copy; the compaction is finished on mount from here
+  uint32_t spare = compact_spare;
+  uint32_t state = 0L;
+  compact_dir = NULL_REF;
+  compact_spare = NULL_REF;
+  if ((device->write(spare + offsetof(spare_t, state), &state, sizeof(state))
+       != sizeof(state))
+      || (device->flush() < 0))
+    return (EIO);
+  return (compact_finish(spare));
+}
+
+int
+CFFS::compact_finish(uint32_t spare)
+{
+  // Read and check the compaction marker
+  spare_t marker;
+  if (device->read(&marker, spare, sizeof(marker)) != sizeof(marker))
+    return (EIO);
+  uint32_t sector = marker.ref;
+  if ((marker.type != COMPACT_TYPE)
+      || (sector & device->SECTOR_MASK)
+      || (sector >= device->DEVICE_BYTES)
+      || (marker.saved == 0)
+      || (marker.saved >= device->SECTOR_BYTES)
+      || (marker.saved % sizeof(descr_t)))
+    return (EINVAL);
+
+  // Erase the sector and copy back; the sector header from the saved
+  // entry, which is left free. Keep the new erase count
+  if (erase_sector(sector, marker.source) != 0) return (EIO);
+  descr_t entry;
+  for (uint32_t offset = 0; offset < device->SECTOR_BYTES;
+       offset += sizeof(entry)) {
+    if (offset == marker.saved) continue;
+    uint32_t src = spare + (offset == 0 ? marker.saved : offset);
+    if (device->read(&entry, src, sizeof(entry)) != sizeof(entry))
+      return (EIO);
+    if ((offset == 0) && (sector != 0L))
+      ((sector_t*) &entry)->erases = NULL_REF;
+    if (!is_erased(&entry, sizeof(entry))
+	&& (device->write(sector + offset, &entry, sizeof(entry))
+	    != sizeof(entry)))
+      return (EIO);
+  }
+
+  // Mark the spare deleted; erased by the garbage collector
+  marker.type &= ~ALLOC_MASK;
+  if ((device->write(spare, &marker.type, sizeof(marker.type))
+       != sizeof(marker.type))
+      || (device->flush() < 0))
+    return (EIO);
+  deleted_sector += spare / device->SECTOR_BYTES;
+
+  // Entries are moved; rebuild the directory index on next lookup
+  dir_hash_addr = NULL_REF;
+  return (0);
+}
+
+void
+CFFS::compact_check(uint32_t addr)
+{
+  // Check that the address is in the sector being compacted
+  if (compact_spare == NULL_REF) return;
+  if (((addr ^ compact_dir) & ~device->SECTOR_MASK) != 0) return;
+
+  // Mark the spare deleted; the compaction is started again
+  uint16_t type = COMPACT_TYPE & ~ALLOC_MASK;
+  device->write(compact_spare, &type, sizeof(type));
+  deleted_sector += compact_spare / device->SECTOR_BYTES;
+  dirty_dir = compact_dir;
+  compact_dir = NULL_REF;
+  compact_spare = NULL_REF;
+}
+
+int
+CFFS::collect()
+{
+  // Check that the file system driver is initiated
+  if (device == NULL) return (ENXIO);
+
+  // Finish the directory compaction in progress if no files are open
+  if ((compact_spare != NULL_REF) && (open_files == 0)) {
+    int res = compact_end();
+    return (res < 0 ? res : 1);
+  }
+
+  // Erase the least worn deleted sector
+  int res = erase_deleted();
+  if (res != 0) return (res);
+
+  // Start compaction of the latest directory block with deleted entries
+  if ((dirty_dir == NULL_REF) || (compact_spare != NULL_REF)) return (0);
+  uint32_t dir = dirty_dir;
+  dirty_dir = NULL_REF;
+  res = compact_begin(dir, DIR_COLLECT_MIN);
+  if (res < 0) dirty_dir = dir;
+  return (res);
+}
+
+int
+CFFS::compact()
+{
+  // Check that the file system driver is initiated
+  if (device == NULL) return (ENXIO);
+
+  // Directory entries are moved; no files may be open
+  if (open_files != 0) return (EBUSY);
+
+  // Finish a compaction in progress and compact the current directory
+  int res;
+  if (compact_spare != NULL_REF) {
+    res = compact_end();
+    if (res < 0) return (res);
+  }
+  res = compact_begin(current_dir_addr, 1);
+  if (res <= 0) return (res);
+  return (compact_end());
+}
+
+uint32_t
+CFFS::find_free_sector()
+{
+  // Erase a deleted sector if there are no free sectors
+  if (free_sector.is_empty() && !deleted_sector.is_empty()) erase_deleted();
+
+  // Search round robin from the hint for the least worn free sector
+  uint16_t max = sector_max();
+  uint16_t ix = free_hint;
+  uint16_t res = 0;
+  for (uint16_t i = 1; i < max; i++, ix++) {
+    if (ix >= max) ix = 1;
+    if (!free_sector[ix]) continue;
+    if ((res == 0) || (wear[ix] < wear[res])) {
+      res = ix;
+      if (wear[res] == 0) break;
+    }
+  }
+  return (res * device->SECTOR_BYTES);
+}
+
 uint32_t
 CFFS::next_free_sector()
 {
   // Check that the file system driver is initiated
   if (device == NULL) return (0L);
 
-  // Search for a free sector
-  descr_t header;
-  uint32_t addr = device->SECTOR_BYTES;
-  for (uint16_t i = 1; i < device->SECTOR_MAX; i++) {
-    if (device->read(&header, addr, sizeof(header)) != sizeof(header))
-      return (0L);
-    if (header.type != FREE_TYPE) {
-      addr += device->SECTOR_BYTES;
-      continue;
-    }
-    // Initiate the sector header
-    header.type = FILE_BLOCK_TYPE;
-    header.size = device->SECTOR_BYTES;
-    header.ref = NULL_REF;
-    memset(header.name, 0, sizeof(header.name));
-    if (device->write(addr, &header, sizeof(header)) != sizeof(header))
-      return (0L);
-    // Return address of sector
-    return (addr);
-  }
-  return (0L);
+  // Find a free sector
+  uint32_t addr = find_free_sector();
+  if (addr == 0L) return (0L);
+
+  // Initiate the sector header; keep the erase count and the end of
+  // file hints erased
+  block_t header;
+  header.type = FILE_BLOCK_TYPE;
+  header.size = device->SECTOR_BYTES;
+  header.ref = NULL_REF;
+  memset(header.hint, 0xff, sizeof(header.hint));
+  header.erases = NULL_REF;
+  if (device->write(addr, &header, sizeof(header)) != sizeof(header))
+    return (0L);
+  mark_sector(addr, false);
+
+  // Return address of sector
+  return (addr);
 }
 
 uint32_t
@@ -534,15 +1130,12 @@ CFFS::next_free_directory()
   if (device == NULL) return (0L);
 
   // Search for a free directory
-  descr_t header;
+  sector_t header;
   uint32_t addr;
   if (device->SECTOR_BYTES == device->DEFAULT_SECTOR_BYTES) {
-    addr = device->SECTOR_BYTES;
-    for (uint16_t i = 1; i < device->SECTOR_MAX; i++, addr += device->SECTOR_BYTES) {
-      if (device->read(&header, addr, sizeof(header)) != sizeof(header))
-	return (0L);
-      if (header.type == FREE_TYPE) break;
-    }
+    addr = find_free_sector();
+    if (addr == 0L) return (0L);
+    header.type = FREE_TYPE;
   }
   else {
     addr = device->DEFAULT_SECTOR_BYTES;
@@ -554,54 +1147,19 @@ CFFS::next_free_directory()
   }
   if (header.type != FREE_TYPE) return (0L);
 
-  // Initiate the parent directory reference
+  // Initiate the parent directory reference; keep the erase count
   memset(&header, 0, sizeof(header));
   header.type = DIR_BLOCK_TYPE;
   header.size = device->DEFAULT_SECTOR_BYTES;
   header.ref = current_dir_addr;
   strcpy_P(header.name, PSTR(".."));
+  header.erases = NULL_REF;
+  compact_check(addr);
   if (device->write(addr, &header, sizeof(header)) != sizeof(header))
     return (0L);
+  if (device->SECTOR_BYTES == device->DEFAULT_SECTOR_BYTES)
+    mark_sector(addr, false);
+
   // Return the directory address
   return (addr);
 }
-
-int
-CFFS::find_end_of_file(uint32_t addr, uint32_t &pos, uint32_t &size)
-{
-  // Check that the file system driver is initiated
-  if (device == NULL) return (ENXIO);
-
-  // Locate last sector
-  descr_t header;
-  size = 0L;
-  while (1) {
-    if (device->read(&header, addr, sizeof(header)) != sizeof(header))
-      return (EIO);
-    if (header.type != FILE_BLOCK_TYPE) return (ENXIO);
-    if (header.size != device->SECTOR_BYTES) return (ENXIO);
-    if (header.ref == NULL_REF) break;
-    addr = header.ref;
-    size += (header.size - sizeof(header));
-  }
-
-  // Locate end of sector
-  uint8_t buf[256];
-  addr += device->SECTOR_BYTES;
-  const uint16_t BUF_MAX = device->SECTOR_BYTES / sizeof(buf);
-  for (uint16_t i = 0; i < BUF_MAX; i++) {
-    addr -= sizeof(buf);
-    if (device->read(buf, addr, sizeof(buf)) != sizeof(buf))
-      return (EIO);
-    uint16_t j = sizeof(buf) - 1;
-    while (buf[j] == 0xff) if (j == 0) break; else j--;
-    if (j == 0) continue;
-    addr += j + 1;
-    break;
-  }
-
-  // And return position and size
-  pos = addr;
-  size += (addr & device->SECTOR_MASK) - sizeof(header);
-  return (0);
-}
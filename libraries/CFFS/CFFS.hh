@@ -24,13 +24,53 @@
 #include "Cosa/FS.hh"
 #include "Cosa/Flash.hh"
 #include "Cosa/IOStream.hh"
+#include "Cosa/BitSet.hh"
+#include "Cosa/Periodic.hh"
+
+/**
+ * Max number of flash sectors handled by the free sector map and
+ * wear leveling. Sectors beyond this are not allocated. Default 256
+ * (320 bytes of RAM).
+ */
+#if !defined(CFFS_SECTOR_MAX)
+#define CFFS_SECTOR_MAX 256
+#endif
+
+/**
+ * Number of entries in the per-file block index cache. The index
+ * holds the address of every n:th file block, where the stride n is
+ * doubled when the index is full. Default 8 (32 bytes per file).
+ */
+#if !defined(CFFS_FILE_INDEX_MAX)
+#define CFFS_FILE_INDEX_MAX 8
+#endif
 
 /**
  * Cosa Flash File System for Flash Memory.
  *
- * @section Limitations
- * Directory entries are not reclaimed (directory block is not erased
- * and rewritten when full).
+ * @section Wear Leveling
+ * Each sector header holds an erase count. Allocation prefers the
+ * least worn free sector. Sectors of removed files are marked deleted
+ * and erased later by the garbage collector; collect() or a
+ * Collector job. The collector also compacts directory blocks with
+ * deleted entries through a spare sector.
+ *
+ * @section Directory Compaction
+ * The directory sector is copied to a spare sector without the
+ * deleted entries. The spare header is a marker with the source
+ * sector address and the copy state; the source sector header is
+ * saved in a free entry of the copy. The marker is committed when the
+ * copy is complete, and the source sector is then erased and copied
+ * back. Mount finishes a committed compaction and deletes a spare with
+ * an incomplete copy. The collector performs the copy and the copy
+ * back in separate steps; an update of the directory sector in
+ * between restarts the compaction.
+ *
+ * @section Directory Index
+ * The current directory has a name hash index in RAM; one byte per
+ * directory entry. It is built on the first lookup after mount or
+ * change of directory and updated on create and remove. Lookup only
+ * reads the entries with matching hash.
  */
 class CFFS {
 public:
@@ -48,6 +88,68 @@ protected:
     char name[FILENAME_MAX];	//!< Printable name of object(zero terminated).
   };
 
+  /**
+   * CFFS sector header; file and directory block descriptor with the
+   * sector erase count in the end of the name field. The erase count
+   * of a never erased sector is 0xffffffffL.
+   */
+  struct sector_t {
+    uint16_t type;		//!< Type of block and entry state.
+    uint32_t size;		//!< Number of bytes (including header).
+    uint32_t ref;		//!< Reference value (pointer).
+    char name[FILENAME_MAX - sizeof(uint32_t)]; //!< Directory name.
+    uint32_t erases;		//!< Sector erase count.
+  };
+  static_assert(sizeof(sector_t) == sizeof(descr_t),
+		"CFFS sector header and descriptor size differ");
+
+  /**
+   * CFFS end of file hint; flash address of the end of file and the
+   * number of the file block.
+   */
+  struct hint_t {
+    uint32_t pos;		//!< End of file address.
+    uint16_t block;		//!< File block number.
+  };
+
+  /** Number of end of file hints in a file block header. */
+  static const uint8_t HINT_MAX = 3;
+
+  /**
+   * CFFS file block header; the name field holds a log of end of file
+   * hints. The hints are written on close. When the hints in a block
+   * are used the log continues in the block of the last hint. Unused
+   * hints are erased (0xff).
+   */
+  struct block_t {
+    uint16_t type;		//!< Type of block and entry state.
+    uint32_t size;		//!< Number of bytes (including header).
+    uint32_t ref;		//!< Reference value (pointer).
+    hint_t hint[HINT_MAX];	//!< End of file hint log.
+    uint32_t erases;		//!< Sector erase count.
+  };
+  static_assert(sizeof(block_t) == sizeof(descr_t),
+		"CFFS file block header and descriptor size differ");
+
+  /**
+   * CFFS directory compaction marker; header of the spare sector with
+   * the compacted copy of the source sector. The state is NULL_REF
+   * while the copy is written and zero when complete. The source
+   * sector header is saved in the copy at the given offset. The
+   * allocated bit is cleared when the compaction is done.
+   */
+  struct spare_t {
+    uint16_t type;		//!< Type of block and entry state.
+    uint32_t state;		//!< Copy state.
+    uint32_t ref;		//!< Source sector address.
+    uint32_t source;		//!< Source sector erase count.
+    uint16_t saved;		//!< Offset of saved source sector header.
+    uint8_t reserved[12];	//!< Reserved (erased).
+    uint32_t erases;		//!< Sector erase count.
+  };
+  static_assert(sizeof(spare_t) == sizeof(descr_t),
+		"CFFS compaction marker and descriptor size differ");
+
   /**
    * CFFS object types:
    *
@@ -60,8 +162,10 @@ protected:
    * the  address of the first file block, name is the name of the file.
    *
    * FILE_BLOCK_TYPE is a file block; size is the block size (typically
-   * sector size), ref is the address of the next block, name is not
-   * used (filled with zero).
+   * sector size), ref is the address of the next block, name holds
+   * end of file hints and the erase count. A deleted
+   * file block has the allocated bit cleared and is erased by the
+   * garbage collector.
 
    * DIR_ENTRY_TYPE is a directory reference; size is not used, ref is
    * the address of the directory block, name is the name of the
@@ -70,6 +174,9 @@ protected:
    * DIR_BLOCK_TYPE is directory block header; size is the directory
    * sector, ref is the address to the next directory block (NULL is
    * encoded as 0xffffffffL, NULL_REF)
+   *
+   * COMPACT_TYPE is the header of a spare sector with a directory
+   * compaction copy (see spare_t).
    */
   enum {
     CFFS_TYPE = 0xf5cf,		//!< File System Master header.
@@ -77,6 +184,7 @@ protected:
     FILE_BLOCK_TYPE = 0x8002,	//!< File data block.
     DIR_ENTRY_TYPE = 0x8003,	//!< Directory reference entry.
     DIR_BLOCK_TYPE = 0x8004,	//!< Directory block.
+    COMPACT_TYPE = 0x8005,	//!< Directory compaction spare.
     FREE_TYPE = 0xffff,		//!< Free descriptor.
     ALLOC_MASK = 0x8000,	//!< Allocated mask.
     TYPE_MASK = 0x7fff		//!< Type mask.
@@ -92,9 +200,12 @@ public:
    * Flash File access class. Support for directories, hard links,
    * text and binary files. The end of the file is not store in the
    * directory entry, instead it is located when the file is
-   * opened. This is done by searching for the first non-0xff value
-   * from the end of the last file sector. Text files may not use the
-   * value (0xff). Binary files must end each entry with non-0xff
+   * opened. The end of file hint written on close gives the last
+   * sector and a lower bound for the position. Without a valid hint
+   * the sector chain is followed. The end is found by searching for
+   * the first non-0xff value from the end of the last file sector
+   * down to the hint position. Text files may not
+   * use the value (0xff). Binary files must end each entry with non-0xff
    * entry. Write should always be in append mode as the file cannot
    * be rewritten with any value.
    */
@@ -106,6 +217,14 @@ public:
      */
     File() : IOStream::Device(), m_flags(0) {}
 
+    /**
+     * Close the file if open.
+     */
+    ~File()
+    {
+      if (is_open()) close();
+    }
+
     /**
      * Open a file by name and mode flags. Returns zero(0) if
      * successful otherwise a negative error code (EBUSY, EPERM,
@@ -212,6 +331,15 @@ public:
      */
     virtual int getchar();
 
+    /**
+     * @override{IOStream::Device}
+     * Write any data buffered by the flash device (Flash::Buffer).
+     * Called by close(). Return zero(0) if successful otherwise a
+     * negative error code (EIO).
+     * @return zero or negative error code.
+     */
+    virtual int flush();
+
     /** Overloaded virtual member functions. */
     using IOStream::Device::read;
 
@@ -234,6 +362,66 @@ public:
     uint32_t m_file_size;		//!< File size.
     uint32_t m_current_addr;		//!< Current flash address.
     uint32_t m_current_pos;		//!< Current logical position.
+    uint16_t m_current_block;		//!< Current file block number.
+    uint32_t m_hint_addr;		//!< Block with end of file hint log.
+    uint8_t m_hint_slot;		//!< Next free hint in block.
+    uint32_t m_hint_pos;		//!< Latest end of file hint.
+
+    /** Number of entries in block index. */
+    static const uint8_t INDEX_MAX = CFFS_FILE_INDEX_MAX;
+    static_assert(INDEX_MAX > 0, "CFFS_FILE_INDEX_MAX must be one or more");
+
+    uint32_t m_index[INDEX_MAX];	//!< Block index; addresses.
+    uint8_t m_index_count;		//!< Number of index entries.
+    uint8_t m_index_shift;		//!< Block index stride (log2).
+
+    /**
+     * Reset the block index to the first file block.
+     */
+    void index_reset()
+    {
+      m_index[0] = m_entry.ref;
+      m_index_count = 1;
+      m_index_shift = 0;
+    }
+
+    /**
+     * Record the address of the given file block in the block index.
+     * Blocks are recorded in order and with the index stride. The
+     * stride is doubled when the index is full.
+     * @param[in] block file block number.
+     * @param[in] addr file block address.
+     */
+    void index_block(uint16_t block, uint32_t addr);
+
+    /**
+     * Find address of the given file block; start from the closest
+     * block in the block index and follow the sector chain. Return
+     * zero(0) if successful otherwise a negative error code (EIO,
+     * ENXIO).
+     * @param[in] block file block number.
+     * @param[out] addr file block address.
+     * @return zero or negative error code.
+     */
+    int find_block(uint16_t block, uint32_t &addr);
+
+    /**
+     * Locate the end of the file from the end of file hint log; follow
+     * the sector chain and search the last sector when the hint is
+     * missing or out of date. Sets the current address, block and
+     * file size. Return zero(0) if successful otherwise a negative
+     * error code (EIO, ENXIO).
+     * @return zero or negative error code.
+     */
+    int find_end();
+
+    /**
+     * Append the current end of file to the hint log if changed.
+     * Return zero(0) if successful otherwise a negative error code
+     * (EIO).
+     * @return zero or negative error code.
+     */
+    int write_hint();
 
     /**
      * @override{IOStream::Device}
@@ -249,8 +437,9 @@ public:
   };
 
   /**
-   * Mount a CFFS volume on the given flash device. Return true if
-   * successful otherwise false.
+   * Mount a CFFS volume on the given flash device and build the free
+   * sector map. An interrupted directory compaction is finished or
+   * rolled back. Return true if successful otherwise false.
    * @param[in] flash device to mount.
    * @return bool.
    */
@@ -310,6 +499,52 @@ public:
    */
   static int format(Flash::Device* flash, const char* name);
 
+  /**
+   * Perform one incremental garbage collection step; finish a
+   * directory compaction when no files are open, erase a deleted
+   * sector or start the compaction of the latest directory block with
+   * deleted entries. Returns one(1) if a step was performed, zero(0)
+   * if there was nothing to collect otherwise a negative error code
+   * (ENXIO, EIO, ENOSPC).
+   * @return one, zero or negative error code.
+   */
+  static int collect();
+
+  /**
+   * Compact the current directory; remove deleted entries. The
+   * directory sector is copied to a spare sector, erased and copied
+   * back. Requires that no files are open. Returns zero(0) if
+   * successful otherwise a negative error code (ENXIO, EBUSY, ENOSPC,
+   * EIO).
+   * @return zero or negative error code.
+   */
+  static int compact();
+
+  /**
+   * Periodic job to run the garbage collector incrementally.
+   */
+  class Collector : public Periodic {
+  public:
+    /**
+     * Construct garbage collector job with given period in the
+     * scheduler time base.
+     * @param[in] scheduler for the periodic job.
+     * @param[in] period between collection steps.
+     */
+    Collector(Job::Scheduler* scheduler, uint32_t period) :
+      Periodic(scheduler, period)
+    {}
+
+    /**
+     * @override{Periodic}
+     * Perform a garbage collection step.
+     */
+    virtual void run()
+    {
+      CFFS::collect();
+    }
+  };
+
   friend class File;
 
 protected:
@@ -322,6 +557,168 @@ protected:
   /** Current directory address. */
   static uint32_t current_dir_addr;
 
+  /** Max number of sectors in free sector map. */
+  static const uint16_t SECTOR_MAX = CFFS_SECTOR_MAX;
+
+  /** Number of deleted entries before background compaction. */
+  static const uint8_t DIR_COLLECT_MIN = 32;
+
+  /** Free sector map; built on mount and updated on allocate/erase. */
+  static BitSet<SECTOR_MAX> free_sector;
+
+  /** Deleted sector map; sectors to be erased by the collector. */
+  static BitSet<SECTOR_MAX> deleted_sector;
+
+  /** Sector erase count relative wear_base (saturated). */
+  static uint8_t wear[SECTOR_MAX];
+
+  /** Erase count of the least worn sector. */
+  static uint32_t wear_base;
+
+  /** Index of sector to start the next allocation search from. */
+  static uint16_t free_hint;
+
+  /** Number of open files; directory compaction is deferred. */
+  static uint8_t open_files;
+
+  /** Latest directory block with deleted entries (or NULL_REF). */
+  static uint32_t dirty_dir;
+
+  /** Directory block being compacted and spare sector (or NULL_REF). */
+  static uint32_t compact_dir;
+  static uint32_t compact_spare;
+
+  /** Max number of entries in a directory block. */
+  static const uint8_t DIR_ENTRY_MAX =
+    Flash::Device::DEFAULT_SECTOR_BYTES / sizeof(descr_t);
+
+  /** Directory index hash values for free and deleted entries. */
+  static const uint8_t FREE_HASH = 0xff;
+  static const uint8_t DELETED_HASH = 0x00;
+
+  /** Directory index; name hash of the current directory entries. */
+  static uint8_t dir_hash[DIR_ENTRY_MAX];
+
+  /** Address of the indexed directory (or NULL_REF). */
+  static uint32_t dir_hash_addr;
+
+  /** Number of entries in the indexed directory. */
+  static uint8_t dir_hash_count;
+
+  /**
+   * Return directory index hash of the given file name; never
+   * FREE_HASH or DELETED_HASH.
+   * @param[in] filename to hash.
+   * @return hash value.
+   */
+  static uint8_t hash(const char* filename);
+
+  /**
+   * Build the directory index for the current directory if needed.
+   * Returns zero(0) if successful otherwise a negative error code
+   * (EIO).
+   * @return zero or negative error code.
+   */
+  static int dir_index();
+
+  /**
+   * Return number of sectors in the free sector map for the current
+   * device.
+   * @return number of sectors.
+   */
+  static uint16_t sector_max()
+  {
+    return (device->SECTOR_MAX < SECTOR_MAX ? device->SECTOR_MAX : SECTOR_MAX);
+  }
+
+  /**
+   * Mark the sector with the given address as free or allocated in
+   * the free sector map.
+   * @param[in] addr sector address.
+   * @param[in] free sector state.
+   */
+  static void mark_sector(uint32_t addr, bool free);
+
+  /**
+   * Record the erase count of the sector with the given index in the
+   * wear table. Rebase the table when the count saturates.
+   * @param[in] ix sector index.
+   * @param[in] erases sector erase count.
+   */
+  static void set_wear(uint16_t ix, uint32_t erases);
+
+  /**
+   * Erase sector with the given address and erase count, and write
+   * the incremented erase count to the sector header. The sector is
+   * marked free. Returns zero(0) if successful otherwise a negative
+   * error code.
+   * @param[in] addr sector address.
+   * @param[in] erases current erase count of sector.
+   * @return zero or negative error code.
+   */
+  static int erase_sector(uint32_t addr, uint32_t erases);
+
+  /**
+   * Erase the least worn deleted sector. Returns one(1) if a sector
+   * was erased, zero(0) if there are no deleted sectors otherwise a
+   * negative error code (EIO).
+   * @return one, zero or negative error code.
+   */
+  static int erase_deleted();
+
+  /**
+   * Return address of the directory block with the given entry
+   * address. The root directory follows the master block in the
+   * first directory block.
+   * @param[in] addr entry address.
+   * @return directory address.
+   */
+  static uint32_t dir_block(uint32_t addr)
+  {
+    uint32_t dir = addr & ~(device->DEFAULT_SECTOR_BYTES - 1);
+    return (dir == 0L ? sizeof(descr_t) : dir);
+  }
+
+  /**
+   * Start compaction of the directory block with the given address if
+   * it has at least the given number of deleted entries, or is full
+   * and has deleted entries. The sector is copied to a spare sector
+   * without the deleted entries. Returns one(1) if started, zero(0)
+   * if there is nothing to compact otherwise a negative error code
+   * (EINVAL, ENOSPC, EIO).
+   * @param[in] dir directory block address.
+   * @param[in] min number of deleted entries.
+   * @return one, zero or negative error code.
+   */
+  static int compact_begin(uint32_t dir, uint8_t min);
+
+  /**
+   * Commit the compaction in progress and finish it; requires that no
+   * files are open. Returns zero(0) if successful otherwise a
+   * negative error code (EBUSY, EINVAL, EIO).
+   * @return zero or negative error code.
+   */
+  static int compact_end();
+
+  /**
+   * Finish the committed compaction with the given spare sector;
+   * erase the source sector, copy back from the spare and mark the
+   * spare deleted. Also used on mount. Returns zero(0) if successful
+   * otherwise a negative error code (EINVAL, EIO).
+   * @param[in] spare sector address.
+   * @return zero or negative error code.
+   */
+  static int compact_finish(uint32_t spare);
+
+  /**
+   * Abort the compaction in progress if the given address is in the
+   * sector being compacted; the copy is out of date. The spare is
+   * marked deleted and the directory is checked again by the
+   * collector.
+   * @param[in] addr address to be written.
+   */
+  static void compact_check(uint32_t addr);
+
   /**
    * Read flash block with the given size into the buffer from the
    * source address. Return number of bytes read or negative error
@@ -390,27 +787,25 @@ protected:
   static int remove(uint32_t addr, uint16_t type);
 
   /**
-   * Allocate next free sector. Returns sector address or zero.
+   * Allocate next free sector from the free sector map. Returns
+   * sector address or zero.
    * @return sector address or zero.
    */
   static uint32_t next_free_sector();
 
   /**
-   * Allocate next free directory. Returns directory address or zero.
-   * @return directory address or zero.
+   * Return address of the least worn free sector in the free sector
+   * map without allocating it. Deleted sectors are erased if there
+   * are no free sectors. Returns zero if the flash is full.
+   * @return sector address or zero.
    */
-  static uint32_t next_free_directory();
+  static uint32_t find_free_sector();
 
   /**
-   * Find address and size of file that starts with the given
-   * sector. Return zero(0) if successful otherwise a negative error
-   * code.
-   * @param[in] sector address of sector.
-   * @param[out] pos address of end of file.
-   * @param[out] size of file.
-   * @return zero or negative error code.
+   * Allocate next free directory. Returns directory address or zero.
+   * @return directory address or zero.
    */
-  static int find_end_of_file(uint32_t sector, uint32_t &pos, uint32_t &size);
+  static uint32_t next_free_directory();
 };
 
 #endif
@@ -0,0 +1,141 @@
+/**
+ * @file CosaCFFSbenchmark.ino
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * @section Description
+ * Benchmark of the Cosa Flash File System; text logging through
+ * IOStream (putchar), binary block writes, directory listing and
+ * file reads. Prints bytes per second and, with the Flash::Buffer
+ * write-back page buffer and read-ahead cache (USE_FLASH_BUFFER),
+ * the cache hit rate. Run with and without the buffer to compare.
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#include <CFFS.h>
+#include "Cosa/UART.hh"
+#include "Cosa/Trace.hh"
+#include "Cosa/Watchdog.hh"
+#include "Cosa/RTT.hh"
+
+#define USE_FLASH_S25FL127S
+//#define USE_FLASH_W25X40CL
+#define USE_FLASH_BUFFER
+
+#if defined(USE_FLASH_S25FL127S) || defined(ANARDUINO_MINIWIRELESS)
+#include <S25FL127S.h>
+S25FL127S flash;
+#endif
+
+#if defined(USE_FLASH_W25X40CL) || defined(WICKEDDEVICE_WILDFIRE)
+#include <W25X40CL.h>
+W25X40CL flash;
+#endif
+
+#if defined(USE_FLASH_BUFFER)
+Flash::Buffer buffer(&flash);
+Flash::Device* device = &buffer;
+#else
+Flash::Device* device = &flash;
+#endif
+
+// Number of log lines and binary blocks
+static const uint16_t LINE_MAX = 500;
+static const uint16_t BLOCK_MAX = 64;
+
+void setup()
+{
+  Watchdog::begin();
+  RTT::begin();
+  uart.begin(57600);
+  trace.begin(&uart, PSTR("CosaCFFSbenchmark: started"));
+  ASSERT(device->begin());
+  ASSERT(CFFS::format(device, "flash") == 0);
+  ASSERT(CFFS::begin(device));
+}
+
+void loop()
+{
+  CFFS::File file;
+  IOStream cout(&file);
+  uint32_t start, ms, us, size;
+
+  // Text log through IOStream; one device write per character
+  ASSERT(file.open("LOG.TXT", O_CREAT) == 0);
+  start = RTT::millis();
+  for (uint16_t i = 0; i < LINE_MAX; i++)
+    cout << RTT::millis() << PSTR(":sample:") << i << endl;
+  ASSERT(file.close() == 0);
+  ms = RTT::since(start);
+  ASSERT(file.open("LOG.TXT", O_READ) == 0);
+  size = file.size();
+  file.close();
+  trace << PSTR("putchar:") << size << PSTR(" bytes, ")
+	<< (size * 1000L) / ms << PSTR(" bytes/s")
+	<< endl;
+
+  // Binary blocks of 64 bytes
+  uint8_t buf[64];
+  for (uint8_t i = 0; i < sizeof(buf); i++) buf[i] = i;
+  ASSERT(file.open("LOG.BIN", O_CREAT) == 0);
+  start = RTT::millis();
+  for (uint16_t i = 0; i < BLOCK_MAX; i++)
+    ASSERT(file.write(buf, sizeof(buf)) == sizeof(buf));
+  ASSERT(file.close() == 0);
+  ms = RTT::since(start);
+  size = BLOCK_MAX * sizeof(buf);
+  trace << PSTR("write(") << sizeof(buf) << PSTR("):") << size
+	<< PSTR(" bytes, ") << (size * 1000L) / ms << PSTR(" bytes/s")
+	<< endl;
+
+  // Directory listing; output is discarded
+  IOStream null;
+#if defined(USE_FLASH_BUFFER)
+  uint32_t hits = buffer.hits();
+  uint32_t misses = buffer.misses();
+#endif
+  start = RTT::micros();
+  ASSERT(CFFS::ls(null) == 0);
+  us = RTT::micros() - start;
+  trace << PSTR("ls:") << us << PSTR(" us");
+#if defined(USE_FLASH_BUFFER)
+  trace << PSTR(", hits ") << buffer.hits() - hits
+	<< PSTR(", misses ") << buffer.misses() - misses;
+#endif
+  trace << endl;
+
+  // Read of the text log in small chunks
+  uint8_t chunk[16];
+#if defined(USE_FLASH_BUFFER)
+  hits = buffer.hits();
+  misses = buffer.misses();
+#endif
+  ASSERT(file.open("LOG.TXT", O_READ) == 0);
+  start = RTT::millis();
+  size = 0;
+  for (int n; (n = file.read(chunk, sizeof(chunk))) > 0;) size += n;
+  ms = RTT::since(start);
+  file.close();
+  trace << PSTR("read(") << sizeof(chunk) << PSTR("):") << size
+	<< PSTR(" bytes, ") << (size * 1000L) / ms << PSTR(" bytes/s");
+#if defined(USE_FLASH_BUFFER)
+  trace << PSTR(", hits ") << buffer.hits() - hits
+	<< PSTR(", misses ") << buffer.misses() - misses;
+#endif
+  trace << endl;
+
+  ASSERT(true == false);
+}
@@ -48,6 +48,14 @@ SHELL_ACTION(cd, "DIR", "change directory")
   return (CFFS::cd(argv[1]));
 }
 
+SHELL_ACTION(compact, "", "compact current directory")
+(int argc, char* argv[])
+{
+  UNUSED(argv);
+  if (argc != 1) return (-1);
+  return (CFFS::compact());
+}
+
 SHELL_ACTION(date, "", "current time and date")
 (int argc, char* argv[])
 {
@@ -69,6 +77,19 @@ SHELL_ACTION(du, "FILE", "file size")
   return (0);
 }
 
+SHELL_ACTION(gc, "", "collect deleted sectors and entries")
+(int argc, char* argv[])
+{
+  UNUSED(argv);
+  if (argc != 1) return (-1);
+  int res;
+  uint16_t steps = 0;
+  while ((res = CFFS::collect()) > 0) steps++;
+  if (res < 0) return (res);
+  ios << steps << endl;
+  return (0);
+}
+
 SHELL_ACTION(help, "", "list command help")
 (int argc, char* argv[])
 {
@@ -222,8 +243,10 @@ SHELL_ACTION(write, "[-n|t] FILE STRING..", "print text to file (newline/timesta
 SHELL_BEGIN(command_tab)
   SHELL_COMMAND(cat, Shell::GUEST)
   SHELL_COMMAND(cd, Shell::GUEST)
+  SHELL_COMMAND(compact, Shell::GUEST)
   SHELL_COMMAND(date, Shell::GUEST)
   SHELL_COMMAND(du, Shell::GUEST)
+  SHELL_COMMAND(gc, Shell::GUEST)
   SHELL_COMMAND(help, Shell::GUEST)
   SHELL_COMMAND(ls, Shell::GUEST)
   SHELL_COMMAND(mkdir, Shell::GUEST)
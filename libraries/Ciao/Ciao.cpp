@@ -102,131 +102,115 @@ Ciao::write(str_P buf)
 void
 Ciao::write(uint8_t value)
 {
-  write(UINT8_TYPE, 1);
-  m_dev->putchar(value);
+  write(UINT8_TYPE, 1, &value, sizeof(value));
 }
 
 void
 Ciao::write(uint8_t* buf, uint16_t count)
 {
-  write(UINT8_TYPE, count);
-  m_dev->write(buf, count * sizeof(uint8_t));
+  write(UINT8_TYPE, count, buf, sizeof(uint8_t));
 }
 
 void
 Ciao::write(uint16_t value)
 {
-  write(UINT16_TYPE, 1);
-  m_dev->write(&value, sizeof(value));
+  write(UINT16_TYPE, 1, &value, sizeof(value));
 }
 
 void
 Ciao::write(uint16_t* buf, uint16_t count)
 {
-  write(UINT16_TYPE, count);
-  m_dev->write(buf, count * sizeof(uint16_t));
+  write(UINT16_TYPE, count, buf, sizeof(uint16_t));
 }
 
 void
 Ciao::write(uint32_t value)
 {
-  write(UINT32_TYPE, 1);
-  m_dev->write(&value, sizeof(value));
+  write(UINT32_TYPE, 1, &value, sizeof(value));
 }
 
 void
 Ciao::write(uint32_t* buf, uint16_t count)
 {
-  write(UINT32_TYPE, count);
-  m_dev->write(buf, count * sizeof(uint32_t));
+  write(UINT32_TYPE, count, buf, sizeof(uint32_t));
 }
 
 void
 Ciao::write(uint64_t value)
 {
-  write(UINT64_TYPE, 1);
-  m_dev->write(&value, sizeof(value));
+  write(UINT64_TYPE, 1, &value, sizeof(value));
 }
 
 void
 Ciao::write(uint64_t* buf, uint16_t count)
 {
-  write(UINT64_TYPE, count);
-  m_dev->write(buf, count * sizeof(uint32_t));
+  write(UINT64_TYPE, count, buf, sizeof(uint64_t));
 }
 
 void
 Ciao::write(int8_t value)
 {
-  write(INT8_TYPE, 1);
-  m_dev->putchar(value);
+  write(INT8_TYPE, 1, &value, sizeof(value));
 }
 
 void
 Ciao::write(int8_t* buf, uint16_t count)
 {
-  write(INT8_TYPE, count);
-  m_dev->write(buf, count * sizeof(int8_t));
+  write(INT8_TYPE, count, buf, sizeof(int8_t));
 }
 
 void
 Ciao::write(int16_t value)
 {
-  write(INT16_TYPE, 1);
-  m_dev->write(&value, sizeof(value));
+  write(INT16_TYPE, 1, &value, sizeof(value));
 }
 
 void Ciao::write(int16_t* buf, uint16_t count)
 {
-  write(INT16_TYPE, count);
-  m_dev->write(buf, count * sizeof(int16_t));
+  write(INT16_TYPE, count, buf, sizeof(int16_t));
 }
 
 void
 Ciao::write(int32_t value)
 {
-  write(INT32_TYPE, 1);
-  m_dev->write(&value, sizeof(value));
+  write(INT32_TYPE, 1, &value, sizeof(value));
 }
 
 void
 Ciao::write(int32_t* buf, uint16_t count)
 {
-  write(INT32_TYPE, count);
-  m_dev->write(buf, count * sizeof(int32_t));
+  write(INT32_TYPE, count, buf, sizeof(int32_t));
 }
 
 void
 Ciao::write(int64_t value)
 {
-  write(INT64_TYPE, 1);
-  m_dev->write(&value, sizeof(value));
+  write(INT64_TYPE, 1, &value, sizeof(value));
 }
 
 void
 Ciao::write(int64_t* buf, uint16_t count)
 {
-  write(INT64_TYPE, count);
-  m_dev->write(buf, count * sizeof(int32_t));
+  write(INT64_TYPE, count, buf, sizeof(int64_t));
 }
 
 void
 Ciao::write(float value)
 {
-  write(FLOAT32_TYPE, 1);
-  m_dev->write(&value, sizeof(value));
+  write(FLOAT32_TYPE, 1, &value, sizeof(value));
 }
 
 void
 Ciao::write(float* buf, uint16_t count)
 {
-  write(FLOAT32_TYPE, count);
-  m_dev->write(buf, count * sizeof(float));
+  write(FLOAT32_TYPE, count, buf, sizeof(float));
 }
 
-void
-Ciao::write(uint8_t type, uint16_t count)
+uint8_t
+Ciao::prefix(uint8_t* buf, uint8_t type, uint16_t count)
 {
+  uint8_t n = 0;
+
   // Tag byte contains count[0..7]
   if (count < 8) {
     count |= type;
@@ -234,16 +218,36 @@ Ciao::write(uint8_t type, uint16_t count)
 
   // Else tag byte contains marker. Succeeding byte counter[8..255]
   else if (count < 256) {
-    m_dev->putchar(type | COUNT8_ATTR);
+    buf[n++] = type | COUNT8_ATTR;
   }
 
   // Else tag byte contains marker. Succeeding two bytes counter[256..64K]
   else {
-    m_dev->putchar(type | COUNT16_ATTR);
-    m_dev->putchar(count >> 8);
+    buf[n++] = type | COUNT16_ATTR;
+    buf[n++] = count >> 8;
   }
 
-  m_dev->putchar(count);
+  buf[n++] = count;
+  return (n);
+}
+
+void
+Ciao::write(uint8_t type, uint16_t count)
+{
+  uint8_t buf[PREFIX_MAX];
+  m_dev->write(buf, prefix(buf, type, count));
+}
+
+void
+Ciao::write(uint8_t type, uint16_t count, const void* buf, size_t size)
+{
+  uint8_t tag[PREFIX_MAX];
+  iovec_t vec[3];
+  iovec_t* vp = vec;
+  iovec_arg(vp, tag, prefix(tag, type, count));
+  iovec_arg(vp, buf, count * size);
+  iovec_end(vp);
+  m_dev->write(vec);
 }
 
 void
@@ -300,25 +304,80 @@ static const uint8_t sizeoftype[] __PROGMEM = {
   0
 };
 
-void
-Ciao::write(const Descriptor::user_t* desc, void* buf, uint16_t count)
+Ciao::Layout::Layout(const Descriptor::user_t* desc) :
+  m_desc(desc),
+  m_size(0),
+  m_packed(true)
 {
   // Read descriptor from program memory
   Descriptor::user_t d;
   memcpy_P(&d, desc, sizeof(d));
+  m_id = d.id;
 
-  // Write type tag for user data with count and type identity
-  if (d.id < 256) {
-    write(USER8_TYPE, count);
+  // Sum member sizes; string members are pointers to null terminated
+  // strings and are not packed
+  const Descriptor::member_t* mp = d.member;
+  for (uint16_t i = 0; i < d.count; i++) {
+    Descriptor::member_t m;
+    memcpy_P(&m, mp++, sizeof(m));
+    if (m.count == 0 && m.type == UINT8_TYPE) {
+      m_size += sizeof(char*);
+      m_packed = false;
+    }
+    else {
+      size_t s = pgm_read_byte(&sizeoftype[m.type >> 4]) * m.count;
+      if (s == 0) {
+	m_size = 0;
+	m_packed = false;
+	return;
+      }
+      m_size += s;
+    }
+  }
+}
+
+void
+Ciao::write(const Descriptor::user_t* desc, void* buf, uint16_t count)
+{
+  write(Layout(desc), buf, count);
+}
+
+void
+Ciao::write(const Layout& layout, void* buf, uint16_t count)
+{
+  // Build type tag for user data with count and type identity
+  uint8_t tag[PREFIX_MAX];
+  uint16_t id = layout.id();
+  uint8_t n;
+  if (id < 256) {
+    n = prefix(tag, USER8_TYPE, count);
   }
   else {
-    write(USER16_TYPE, count);
-    m_dev->putchar(d.id >> 8);
+    n = prefix(tag, USER16_TYPE, count);
+    tag[n++] = id >> 8;
   }
-  m_dev->putchar(d.id);
+  tag[n++] = id;
+
+  // Write packed values with the tag in a single device write
+  if (layout.is_packed()) {
+    iovec_t vec[3];
+    iovec_t* vp = vec;
+    iovec_arg(vp, tag, n);
+    iovec_arg(vp, buf, layout.size() * count);
+    iovec_end(vp);
+    m_dev->write(vec);
+    return;
+  }
+  m_dev->write(tag, n);
+
+  // Read descriptor from program memory
+  Descriptor::user_t d;
+  memcpy_P(&d, layout.desc(), sizeof(d));
 
-  // Write data buffer to stream
+  // Write data buffer to stream; data members between strings are
+  // written as a single block
   uint8_t* dp = (uint8_t*) buf;
+  uint8_t* bp = dp;
   while (count--) {
     const Descriptor::member_t* mp = d.member;
     for (uint16_t i = 0; i < d.count; i++) {
@@ -327,20 +386,350 @@ Ciao::write(const Descriptor::user_t* desc, void* buf, uint16_t count)
       // Allow strings and data elements vectors only
       // Fix: Add table with user defined types
       if (m.count == 0 && m.type == UINT8_TYPE) {
-	uint8_t* sp = *((uint8_t**) dp);
-	uint8_t d;
-	do {
-	  d = *sp++;
-	  m_dev->putchar(d);
-	} while (d != 0);
-	dp += sizeof(sp);
+	if (dp != bp) m_dev->write(bp, dp - bp);
+	m_dev->puts(*((char**) dp));
+	m_dev->putchar(0);
+	dp += sizeof(char*);
+	bp = dp;
       }
       else {
 	size_t s = pgm_read_byte(&sizeoftype[m.type >> 4]) * m.count;
-	if (s == 0) return;
-	m_dev->write(dp, s);
+	if (UNLIKELY(s == 0)) {
+	  count = 0;
+	  break;
+	}
 	dp += s;
       }
     }
   }
+  if (dp != bp) m_dev->write(bp, dp - bp);
+}
+
+void
+Ciao::Decoder::reset()
+{
+  m_size = 0;
+  m_state = TAG_STATE;
+  m_type = 0;
+  m_count = 0;
+  m_id = 0;
+  m_in_desc = false;
+  m_member_tag = false;
+  m_dest = NULL;
+  m_room = 0;
+  m_left = 0;
+  m_user.member = NULL;
+  m_user_size = 0;
+  m_packed = false;
+  m_dp = NULL;
+  m_elements = 0;
+  m_room_elements = 0;
+  m_member = 0;
+}
+
+void
+Ciao::Decoder::bind(const Layout& layout, void* buf, uint16_t count)
+{
+  memcpy_P(&m_user, layout.desc(), sizeof(m_user));
+  m_user_size = layout.size();
+  m_packed = layout.is_packed();
+  m_dp = (uint8_t*) buf;
+  m_room_elements = (buf == NULL) ? 0 : count;
+  if (m_room_elements == 0) m_dp = NULL;
+}
+
+int
+Ciao::Decoder::next()
+{
+  int res;
+  while (1) {
+    switch (m_state) {
+    case BIND_STATE:
+      res = start();
+      if (res != NO_EVENT) return (res);
+      break;
+    case DATA_STATE:
+      if (m_left == 0) {
+	res = done();
+	if (res != NO_EVENT) return (res);
+	break;
+      }
+      size_t n;
+      // Copy from the input buffer; skip bytes that do not fit
+      if (m_size != 0) {
+	n = (m_size < m_left) ? m_size : m_left;
+	if (m_room != 0) {
+	  size_t s = (n < m_room) ? n : m_room;
+	  memcpy(m_dest, m_buf, s);
+	  m_dest += s;
+	  m_room -= s;
+	}
+	m_buf += n;
+	m_size -= n;
+      }
+      // Read directly from the device into the bound buffer
+      else if ((m_room != 0) && (m_dev != NULL)) {
+	n = (m_room < m_left) ? m_room : m_left;
+	res = m_dev->read(m_dest, n);
+	if (res <= 0) return (NO_EVENT);
+	n = res;
+	m_dest += n;
+	m_room -= n;
+      }
+      // Skip unbound data
+      else {
+	if (getchar() < 0) return (NO_EVENT);
+	n = 1;
+      }
+      m_left -= n;
+      break;
+    case STRING_STATE:
+      res = getchar();
+      if (res < 0) return (NO_EVENT);
+      if (m_room > 1) {
+	*m_dest++ = res;
+	m_room -= 1;
+      }
+      if (res == 0) {
+	if (m_room != 0) *m_dest = 0;
+	res = done();
+	if (res != NO_EVENT) return (res);
+      }
+      break;
+    default:
+      res = getchar();
+      if (res < 0) return (NO_EVENT);
+      res = parse(res);
+      if (res != NO_EVENT) return (res);
+    }
+  }
+}
+
+int
+Ciao::Decoder::getchar()
+{
+  if (m_size != 0) {
+    m_size -= 1;
+    return (*m_buf++);
+  }
+  if (m_dev == NULL) return (IOStream::EOF);
+  return (m_dev->getchar());
+}
+
+int
+Ciao::Decoder::parse(uint8_t c)
+{
+  switch (m_state) {
+  case TAG_STATE:
+    // Tag prefix starts; clear the binding
+    m_dest = NULL;
+    m_room = 0;
+    m_user.member = NULL;
+    m_elements = 0;
+    m_id = 0;
+    m_member_tag = m_in_desc;
+
+    // End of user data type descriptor
+    if (m_in_desc && ((c == USER8_DESC_END) || (c == USER16_DESC_END))) {
+      m_type = c;
+      m_count = 0;
+      m_in_desc = false;
+      m_member_tag = false;
+      return (TAG_EVENT);
+    }
+
+    // Start of user data type descriptor; identity follows
+    m_type = c & MASK_TYPE;
+    c &= MASK_ATTR;
+    if ((m_type == USER8_DESC_START) || (m_type == USER16_DESC_START)) {
+      if (m_in_desc || (c != COUNT0_ATTR)) return (EINVAL);
+      m_count = 0;
+      m_state = (m_type == USER8_DESC_START) ? ID8_STATE : ID16_STATE;
+      return (NO_EVENT);
+    }
+
+    // Tag byte contains count[0..7] or marker for count[8..64K]
+    if (c <= COUNT4_MASK) {
+      m_count = c;
+      break;
+    }
+    m_count = 0;
+    if (c == COUNT8_ATTR) {
+      m_state = COUNT8_STATE;
+      return (NO_EVENT);
+    }
+    if (c == COUNT16_ATTR) {
+      m_state = COUNT16_STATE;
+      return (NO_EVENT);
+    }
+    return (EINVAL);
+  case COUNT16_STATE:
+    m_count = c << 8;
+    m_state = COUNT8_STATE;
+    return (NO_EVENT);
+  case COUNT8_STATE:
+    m_count |= c;
+    break;
+  case ID16_STATE:
+    m_id = c << 8;
+    m_state = ID8_STATE;
+    return (NO_EVENT);
+  case ID8_STATE:
+    m_id |= c;
+    m_state = BIND_STATE;
+    return (TAG_EVENT);
+  }
+
+  // Count decoded; user data type identity (8 or 16-bit) follows
+  if (m_type == USER8_TYPE) {
+    m_state = ID8_STATE;
+    return (NO_EVENT);
+  }
+  if (m_type == USER16_TYPE) {
+    m_state = ID16_STATE;
+    return (NO_EVENT);
+  }
+  m_state = BIND_STATE;
+  return (TAG_EVENT);
+}
+
+int
+Ciao::Decoder::start()
+{
+  // User data type descriptor and members; name string follows
+  if ((m_type == USER8_DESC_START) || (m_type == USER16_DESC_START)) {
+    m_in_desc = true;
+    m_state = STRING_STATE;
+    return (NO_EVENT);
+  }
+  if (m_member_tag) {
+    m_state = STRING_STATE;
+    return (NO_EVENT);
+  }
+
+  // User data type values; decode members with bound descriptor
+  if ((m_type == USER8_TYPE) || (m_type == USER16_TYPE)) {
+    if ((m_user.member == NULL) || (m_user.count == 0) || (m_count == 0))
+      return (EINVAL);
+    // Packed values are decoded as a single block
+    if (m_packed) {
+      m_left = (uint32_t) m_user_size * m_count;
+      m_dest = m_dp;
+      m_room = (size_t) m_room_elements * m_user_size;
+      m_state = DATA_STATE;
+      return (NO_EVENT);
+    }
+    m_elements = m_count;
+    m_member = 0;
+    return (member());
+  }
+
+  // Null terminated or fixed size sequence of values
+  uint8_t size = pgm_read_byte(&sizeoftype[m_type >> 4]);
+  if (UNLIKELY(size == 0)) return (EINVAL);
+  if (m_count == 0) {
+    if (UNLIKELY(size != 1)) return (EINVAL);
+    m_state = STRING_STATE;
+    return (NO_EVENT);
+  }
+  m_left = (uint32_t) size * m_count;
+  m_state = DATA_STATE;
+  return (NO_EVENT);
+}
+
+int
+Ciao::Decoder::member()
+{
+  Descriptor::member_t m;
+  memcpy_P(&m, &m_user.member[m_member], sizeof(m));
+
+  // String members are skipped; the member pointer is not changed
+  if ((m.count == 0) && (m.type == UINT8_TYPE)) {
+    m_dest = NULL;
+    m_room = 0;
+    if (m_dp != NULL) m_dp += sizeof(char*);
+    m_state = STRING_STATE;
+    return (NO_EVENT);
+  }
+
+  // Data elements vector directly into the element member
+  size_t size = pgm_read_byte(&sizeoftype[m.type >> 4]) * m.count;
+  if (UNLIKELY(size == 0)) return (EINVAL);
+  m_left = size;
+  m_dest = m_dp;
+  m_room = (m_dp != NULL) ? size : 0;
+  if (m_dp != NULL) m_dp += size;
+  m_state = DATA_STATE;
+  return (NO_EVENT);
+}
+
+int
+Ciao::Decoder::done()
+{
+  m_state = TAG_STATE;
+  if (m_elements == 0) return (VALUE_EVENT);
+
+  // Next user data member or element
+  m_member += 1;
+  if (m_member == m_user.count) {
+    m_member = 0;
+    m_elements -= 1;
+    if ((m_room_elements != 0) && (--m_room_elements == 0)) m_dp = NULL;
+    if (m_elements == 0) return (VALUE_EVENT);
+  }
+  return (member());
+}
+
+int
+Ciao::Decoder::await(uint8_t event)
+{
+  int res = next();
+  if (res == event) return (0);
+  if (res == NO_EVENT) return (ENODATA);
+  return (res < 0 ? res : EINVAL);
+}
+
+int
+Ciao::Decoder::read(uint8_t type, void* buf, uint16_t count)
+{
+  int res = await(TAG_EVENT);
+  if (UNLIKELY(res < 0)) return (res);
+  if (UNLIKELY((m_type != type) || m_member_tag || (m_count == 0)))
+    return (EINVAL);
+  size_t size = pgm_read_byte(&sizeoftype[type >> 4]);
+  bind(buf, size * (count < m_count ? count : m_count));
+  res = await(VALUE_EVENT);
+  if (UNLIKELY(res < 0)) return (res);
+  return (m_count);
+}
+
+int
+Ciao::Decoder::read(char* s, size_t size)
+{
+  if (UNLIKELY(size == 0)) return (EINVAL);
+  int res = await(TAG_EVENT);
+  if (UNLIKELY(res < 0)) return (res);
+  if (UNLIKELY((m_type != UINT8_TYPE) || m_member_tag || (m_count != 0)))
+    return (EINVAL);
+  bind(s, size);
+  res = await(VALUE_EVENT);
+  if (UNLIKELY(res < 0)) return (res);
+
+  // The string is terminated; return the decoded length
+  return ((char*) m_dest - s);
+}
+
+int
+Ciao::Decoder::read(const Descriptor::user_t* desc, void* buf, uint16_t count)
+{
+  int res = await(TAG_EVENT);
+  if (UNLIKELY(res < 0)) return (res);
+  if (UNLIKELY(((m_type != USER8_TYPE) && (m_type != USER16_TYPE))
+	       || m_member_tag
+	       || (m_id != pgm_read_word(&desc->id))))
+    return (EINVAL);
+  bind(desc, buf, count);
+  res = await(VALUE_EVENT);
+  if (UNLIKELY(res < 0)) return (res);
+  return (m_count);
 }
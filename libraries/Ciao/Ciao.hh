@@ -27,8 +27,8 @@
  * The Cosa Ciao data stream handler. Please see CIAO.txt for details.
  *
  * @section Limitations
- * The Ciao class handles only output. The data types 16, 64 and 80-bit
- * floating point are not supported.
+ * The Ciao class handles output; input is handled by Ciao::Decoder.
+ * The data types 16, 64 and 80-bit floating point are not supported.
  *
  * @section See Also
  * Requires an IOSteam::Device. This is used in binary/8-bit character
@@ -130,6 +130,447 @@ public:
     BIG_ENDIAN = 1
   } __attribute__((packed));
 
+  /**
+   * User data type layout plan. Compiled once from a user data type
+   * descriptor. The layout is packed when the members are stored
+   * contiguously and the in-memory layout is the stream layout (no
+   * string members). Vectors of packed user data type values are
+   * streamed as a single block of bytes.
+   */
+  class Layout {
+  public:
+    /**
+     * Construct layout plan for given user data type descriptor.
+     * @param[in] desc user data type descriptor (program memory).
+     */
+    Layout(const Descriptor::user_t* desc);
+
+    /**
+     * Return user data type descriptor (program memory).
+     * @return descriptor.
+     */
+    const Descriptor::user_t* desc() const
+    {
+      return (m_desc);
+    }
+
+    /**
+     * Return user data type identity.
+     * @return identity.
+     */
+    uint16_t id() const
+    {
+      return (m_id);
+    }
+
+    /**
+     * Return size of user data type value in bytes, or zero(0) if
+     * the descriptor contains an unsupported member data type.
+     * @return size.
+     */
+    size_t size() const
+    {
+      return (m_size);
+    }
+
+    /**
+     * Return true(1) if the layout is packed otherwise false(0).
+     * @return bool.
+     */
+    bool is_packed() const
+    {
+      return (m_packed);
+    }
+
+  protected:
+    const Descriptor::user_t* m_desc;	//!< Descriptor (program memory).
+    uint16_t m_id;			//!< User data type identity.
+    uint16_t m_size;			//!< Value size in bytes.
+    bool m_packed;			//!< Packed layout.
+  };
+
+  /**
+   * Ciao data stream decoder. The decoder is an incremental parser
+   * with the parser state in the object. Input is either pushed with
+   * feed() or pulled from the device. The parser is run with next()
+   * and returns an event when a tag prefix or the value(s) following
+   * a tag have been decoded. The caller may bind a buffer or a user
+   * data type descriptor when the tag event is returned. Values are
+   * decoded directly into the bound buffer; unbound values are
+   * skipped. Partial buffers may be fed; next() returns NO_EVENT when
+   * more input is needed and continues from the same state when new
+   * input is available.
+   *
+   * @section Limitations
+   * Null terminated sequences are only supported for 8-bit data
+   * types (strings). String members of user data types are skipped;
+   * the member pointer is not changed. User data values must be
+   * bound with a descriptor otherwise the value cannot be skipped.
+   */
+  class Decoder {
+  public:
+    /**
+     * Parser events returned by next().
+     */
+    enum {
+      NO_EVENT = 0,		//!< More input needed.
+      TAG_EVENT = 1,		//!< Tag prefix decoded.
+      VALUE_EVENT = 2		//!< Value(s), string or name decoded.
+    } __attribute__((packed));
+
+    /**
+     * Construct data stream decoder for given device.
+     * @param[in] dev input device (default NULL).
+     */
+    Decoder(IOStream::Device* dev = NULL) :
+      m_dev(dev),
+      m_buf(NULL),
+      m_size(0)
+    {
+      reset();
+    }
+
+    /**
+     * Set io-stream device.
+     * @param[in] dev stream device.
+     */
+    void set(IOStream::Device* dev)
+      __attribute__((always_inline))
+    {
+      m_dev = dev;
+    }
+
+    /**
+     * Reset the parser state. Any remaining input is discarded.
+     */
+    void reset();
+
+    /**
+     * Push given input buffer with given size to the parser. The
+     * buffer must be valid until consumed by next(). Input is taken
+     * from the device when the buffer is consumed.
+     * @param[in] buf input buffer.
+     * @param[in] size number of bytes in buffer.
+     */
+    void feed(const void* buf, size_t size)
+      __attribute__((always_inline))
+    {
+      m_buf = (const uint8_t*) buf;
+      m_size = size;
+    }
+
+    /**
+     * Return number of bytes left in the input buffer.
+     * @return bytes.
+     */
+    size_t available() const
+    {
+      return (m_size);
+    }
+
+    /**
+     * Run the parser until an event or until more input is needed.
+     * Returns TAG_EVENT when a tag prefix has been decoded, VALUE_EVENT
+     * when the value(s) following the tag have been decoded, NO_EVENT
+     * when more input is needed, otherwise a negative error code
+     * (EINVAL for a malformed or unsupported tag).
+     * @return event or negative error code.
+     */
+    int next();
+
+    /**
+     * Bind given buffer with given size for the value(s) or string
+     * following the last decoded tag. Values that do not fit are
+     * skipped. Strings are null terminated. Should be called after
+     * TAG_EVENT.
+     * @param[in] buf buffer for values.
+     * @param[in] size of buffer in bytes.
+     */
+    void bind(void* buf, size_t size)
+    {
+      m_dest = (uint8_t*) buf;
+      m_room = size;
+    }
+
+    /**
+     * Bind given user data type descriptor and buffer with given
+     * number of elements for the user data value(s) following the last
+     * decoded tag. Elements that do not fit are skipped. Should be
+     * called after TAG_EVENT.
+     * @param[in] desc user data type descriptor (program memory).
+     * @param[in] buf buffer for values (or NULL to skip).
+     * @param[in] count max number of elements in buffer.
+     */
+    void bind(const Descriptor::user_t* desc, void* buf, uint16_t count)
+    {
+      bind(Layout(desc), buf, count);
+    }
+
+    /**
+     * Bind given user data type layout plan and buffer with given
+     * number of elements for the user data value(s) following the last
+     * decoded tag. Packed values are decoded as a single block of
+     * bytes. Should be called after TAG_EVENT.
+     * @param[in] layout user data type layout plan.
+     * @param[in] buf buffer for values (or NULL to skip).
+     * @param[in] count max number of elements in buffer.
+     */
+    void bind(const Layout& layout, void* buf, uint16_t count);
+
+    /**
+     * Return data type tag of the last decoded tag prefix.
+     * @return type tag.
+     */
+    uint8_t type() const
+    {
+      return (m_type);
+    }
+
+    /**
+     * Return number of elements of the last decoded tag prefix; zero
+     * for null terminated sequence.
+     * @return count.
+     */
+    uint16_t count() const
+    {
+      return (m_count);
+    }
+
+    /**
+     * Return user data type identity of the last decoded tag prefix.
+     * @return identity.
+     */
+    uint16_t id() const
+    {
+      return (m_id);
+    }
+
+    /**
+     * Return true(1) if the last decoded tag prefix is a member of a
+     * user data type descriptor otherwise false(0).
+     * @return bool.
+     */
+    bool is_member() const
+    {
+      return (m_member_tag);
+    }
+
+    /**
+     * Read tagged value sequence of given type into given buffer with
+     * given max number of elements. Returns number of elements in the
+     * sequence, EINVAL if the next value is not of the given type
+     * (the tag is consumed and next() may be used to skip the value),
+     * or ENODATA if the input ended.
+     * @param[in] type data type tag.
+     * @param[in] buf buffer for values.
+     * @param[in] count max number of elements in buffer.
+     * @return number of elements or negative error code.
+     */
+    int read(uint8_t type, void* buf, uint16_t count);
+
+    /**
+     * Read string into given buffer with given size. The string is
+     * truncated to fit and always terminated. Returns string length
+     * or negative error code (as above, EINVAL if size is zero).
+     * @param[in] s string buffer.
+     * @param[in] size of buffer.
+     * @return length or negative error code.
+     */
+    int read(char* s, size_t size);
+
+    /**
+     * Read unsigned 8-bit integer vector from data stream.
+     * @param[in] buf pointer to integer vector.
+     * @param[in] count max size of vector.
+     * @return number of elements or negative error code.
+     */
+    int read(uint8_t* buf, uint16_t count)
+    {
+      return (read(UINT8_TYPE, buf, count));
+    }
+
+    /**
+     * Read unsigned 16-bit integer vector from data stream.
+     * @param[in] buf pointer to integer vector.
+     * @param[in] count max size of vector.
+     * @return number of elements or negative error code.
+     */
+    int read(uint16_t* buf, uint16_t count)
+    {
+      return (read(UINT16_TYPE, buf, count));
+    }
+
+    /**
+     * Read unsigned 32-bit integer vector from data stream.
+     * @param[in] buf pointer to integer vector.
+     * @param[in] count max size of vector.
+     * @return number of elements or negative error code.
+     */
+    int read(uint32_t* buf, uint16_t count)
+    {
+      return (read(UINT32_TYPE, buf, count));
+    }
+
+    /**
+     * Read unsigned 64-bit integer vector from data stream.
+     * @param[in] buf pointer to integer vector.
+     * @param[in] count max size of vector.
+     * @return number of elements or negative error code.
+     */
+    int read(uint64_t* buf, uint16_t count)
+    {
+      return (read(UINT64_TYPE, buf, count));
+    }
+
+    /**
+     * Read signed 8-bit integer vector from data stream.
+     * @param[in] buf pointer to integer vector.
+     * @param[in] count max size of vector.
+     * @return number of elements or negative error code.
+     */
+    int read(int8_t* buf, uint16_t count)
+    {
+      return (read(INT8_TYPE, buf, count));
+    }
+
+    /**
+     * Read signed 16-bit integer vector from data stream.
+     * @param[in] buf pointer to integer vector.
+     * @param[in] count max size of vector.
+     * @return number of elements or negative error code.
+     */
+    int read(int16_t* buf, uint16_t count)
+    {
+      return (read(INT16_TYPE, buf, count));
+    }
+
+    /**
+     * Read signed 32-bit integer vector from data stream.
+     * @param[in] buf pointer to integer vector.
+     * @param[in] count max size of vector.
+     * @return number of elements or negative error code.
+     */
+    int read(int32_t* buf, uint16_t count)
+    {
+      return (read(INT32_TYPE, buf, count));
+    }
+
+    /**
+     * Read signed 64-bit integer vector from data stream.
+     * @param[in] buf pointer to integer vector.
+     * @param[in] count max size of vector.
+     * @return number of elements or negative error code.
+     */
+    int read(int64_t* buf, uint16_t count)
+    {
+      return (read(INT64_TYPE, buf, count));
+    }
+
+    /**
+     * Read 32-bit floating point vector from data stream.
+     * @param[in] buf pointer to vector.
+     * @param[in] count max size of vector.
+     * @return number of elements or negative error code.
+     */
+    int read(float* buf, uint16_t count)
+    {
+      return (read(FLOAT32_TYPE, buf, count));
+    }
+
+    /**
+     * Read user defined data type value(s) from data stream into given
+     * buffer with given max number of elements. Returns number of
+     * elements in the sequence, EINVAL if the next value is not of
+     * the given user data type, or ENODATA if the input ended.
+     * @param[in] desc user data type descriptor (program memory).
+     * @param[in] buf buffer for values.
+     * @param[in] count max number of elements in buffer.
+     * @return number of elements or negative error code.
+     */
+    int read(const Descriptor::user_t* desc, void* buf, uint16_t count);
+
+  protected:
+    /** Parser states. */
+    enum {
+      TAG_STATE,		//!< Tag byte.
+      COUNT8_STATE,		//!< Count, low byte.
+      COUNT16_STATE,		//!< Count, high byte.
+      ID8_STATE,		//!< Identity, low byte.
+      ID16_STATE,		//!< Identity, high byte.
+      BIND_STATE,		//!< Tag decoded; value binding.
+      DATA_STATE,		//!< Fixed size data.
+      STRING_STATE		//!< Null terminated data.
+    } __attribute__((packed));
+
+    IOStream::Device* m_dev;	//!< Input device (or NULL).
+    const uint8_t* m_buf;	//!< Input buffer.
+    size_t m_size;		//!< Bytes left in input buffer.
+    uint8_t m_state;		//!< Parser state.
+    uint8_t m_type;		//!< Data type tag.
+    uint16_t m_count;		//!< Number of elements.
+    uint16_t m_id;		//!< User data type identity.
+    bool m_in_desc;		//!< Within user data type descriptor.
+    bool m_member_tag;		//!< Tag is descriptor member.
+    uint8_t* m_dest;		//!< Bound buffer (or NULL).
+    size_t m_room;		//!< Bytes left in bound buffer.
+    uint32_t m_left;		//!< Data bytes left of element.
+    Descriptor::user_t m_user;	//!< Bound user data type.
+    uint16_t m_user_size;	//!< Bound user data type value size.
+    bool m_packed;		//!< Bound user data type layout packed.
+    uint8_t* m_dp;		//!< Next user data element member.
+    uint16_t m_elements;	//!< User data elements left.
+    uint16_t m_room_elements;	//!< User data elements left in buffer.
+    uint8_t m_member;		//!< Next member index.
+
+    /**
+     * Get next byte from input buffer or device. Returns byte or
+     * EOF(-1) if more input is needed.
+     * @return byte or EOF(-1).
+     */
+    int getchar();
+
+    /**
+     * Parse given tag prefix byte. Returns TAG_EVENT when the prefix
+     * is complete, NO_EVENT if more bytes are needed, otherwise a
+     * negative error code.
+     * @param[in] c prefix byte.
+     * @return event or negative error code.
+     */
+    int parse(uint8_t c);
+
+    /**
+     * Start decoding of the value(s) following the tag with the bound
+     * buffer or descriptor. Returns NO_EVENT, VALUE_EVENT if there is
+     * no data, otherwise a negative error code.
+     * @return event or negative error code.
+     */
+    int start();
+
+    /**
+     * Complete the current data or string. Continues with the next
+     * user data member or element. Returns NO_EVENT if there is more
+     * data otherwise VALUE_EVENT.
+     * @return event or negative error code.
+     */
+    int done();
+
+    /**
+     * Load the next user data member and start decoding of the member
+     * data. Returns NO_EVENT otherwise a negative error code.
+     * @return event or negative error code.
+     */
+    int member();
+
+    /**
+     * Run the parser and check for given event. Returns zero(0) if
+     * the event was returned otherwise a negative error code (ENODATA
+     * if the input ended, EINVAL if another event was returned).
+     * @param[in] event expected.
+     * @return zero or negative error code.
+     */
+    int await(uint8_t event);
+  };
+
 public:
   /**
    * Construct data streaming for given device.
@@ -296,7 +737,29 @@ public:
    */
   void write(const Descriptor::user_t* desc, void* buf, uint16_t count);
 
+  /**
+   * Write given user defined data type value to data stream with
+   * given layout plan. Packed values are written with the tag prefix
+   * in a single device write.
+   * @param[in] layout user defined data type layout plan.
+   * @param[in] buf pointer to value(s) to write.
+   * @param[in] count size of sequence to write.
+   */
+  void write(const Layout& layout, void* buf, uint16_t count);
+
 protected:
+  /** Max size of tag prefix; tag, count and identity. */
+  static const uint8_t PREFIX_MAX = 5;
+
+  /**
+   * Build data tag prefix in given buffer. Returns prefix length.
+   * @param[in] buf prefix buffer (at least PREFIX_MAX bytes).
+   * @param[in] type data type tag.
+   * @param[in] count number of elements in sequence.
+   * @return number of bytes.
+   */
+  static uint8_t prefix(uint8_t* buf, uint8_t type, uint16_t count);
+
   /**
    * Write data tag to given stream.
    * @param[in] type data type tag.
@@ -304,6 +767,16 @@ protected:
    */
   void write(uint8_t type, uint16_t count);
 
+  /**
+   * Write data tag and given vector with given element size to
+   * stream in a single device write.
+   * @param[in] type data type tag.
+   * @param[in] count number of elements in sequence.
+   * @param[in] buf pointer to vector.
+   * @param[in] size of element in bytes.
+   */
+  void write(uint8_t type, uint16_t count, const void* buf, size_t size);
+
   IOStream::Device* m_dev;
 };
 
@@ -0,0 +1,164 @@
+/**
+ * @file CosaCiaoBenchmark.ino
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * @section Description
+ * Benchmark of the Ciao data stream encoder and decoder. An integer
+ * vector and a vector of user data type values are written to a
+ * buffer and decoded; pulled from the buffer device and pushed to
+ * the decoder in small partial buffers. The user data type values
+ * are written with a compiled layout plan. Prints the encode and
+ * decode time and throughput.
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#include <Ciao.h>
+
+#include "Cosa/IOBuffer.hh"
+#include "Cosa/RTT.hh"
+#include "Cosa/Trace.hh"
+#include "Cosa/UART.hh"
+#include "Cosa/Watchdog.hh"
+
+// A Point data type
+struct Point {
+  int16_t x;
+  int16_t y;
+};
+
+// Ciao data type descriptor in program memory for Point
+const uint16_t Point_ID = 0x1042;
+const char Point_name[] __PROGMEM = "::Point";
+const char Point_x_name[] __PROGMEM = "x";
+const char Point_y_name[] __PROGMEM = "y";
+const Ciao::Descriptor::member_t Point_members[] __PROGMEM = {
+  {
+    Ciao::INT16_TYPE,
+    1,
+    Point_x_name,
+    0
+  },
+  {
+    Ciao::INT16_TYPE,
+    1,
+    Point_y_name,
+    0
+  }
+};
+const Ciao::Descriptor::user_t Point_desc __PROGMEM = {
+  Point_ID,
+  Point_name,
+  Point_members,
+  membersof(Point_members)
+};
+
+// Point layout plan; compiled once
+const Ciao::Layout Point_layout(&Point_desc);
+
+// Data stream buffer and values
+static const uint16_t COUNT = 50;
+IOBuffer<512> buffer;
+int16_t vec[COUNT];
+Point point[COUNT];
+
+// Write the values to the data stream buffer; return number of bytes
+static uint16_t produce()
+{
+  Ciao cout(&buffer);
+  buffer.empty();
+  cout.write(vec, COUNT);
+  cout.write(Point_layout, point, COUNT);
+  return (buffer.available());
+}
+
+static void result(str_P name, uint32_t us, uint16_t bytes)
+{
+  trace << name << us << PSTR(" us, ")
+	<< (bytes * 1000L) / us << PSTR(" kbyte/s, ")
+	<< (us * (F_CPU / 1000000L)) / bytes << PSTR(" cycles/byte")
+	<< endl;
+}
+
+void setup()
+{
+  Watchdog::begin();
+  RTT::begin();
+  uart.begin(57600);
+  trace.begin(&uart, PSTR("CosaCiaoBenchmark: started"));
+
+  for (uint16_t i = 0; i < COUNT; i++) {
+    vec[i] = i * 7 - 300;
+    point[i].x = i;
+    point[i].y = -i;
+  }
+}
+
+void loop()
+{
+  uint32_t start, us;
+  uint16_t bytes;
+
+  // Encode to the buffer device
+  start = RTT::micros();
+  bytes = produce();
+  us = RTT::micros() - start;
+  result(PSTR("encode:"), us, bytes);
+
+  // Pull decode from the buffer device; bulk read into the vectors
+  memset(vec, 0, sizeof(vec));
+  memset(point, 0, sizeof(point));
+  Ciao::Decoder cin(&buffer);
+  start = RTT::micros();
+  ASSERT(cin.read(vec, COUNT) == COUNT);
+  ASSERT(cin.read(&Point_desc, point, COUNT) == COUNT);
+  us = RTT::micros() - start;
+  ASSERT(vec[COUNT - 1] == (COUNT - 1) * 7 - 300);
+  ASSERT(point[COUNT - 1].y == -(COUNT - 1));
+  result(PSTR("pull:"), us, bytes);
+
+  // Push decode; feed partial buffers of 16 bytes to the parser
+  bytes = produce();
+  uint8_t stream[bytes];
+  buffer.read(stream, bytes);
+  memset(vec, 0, sizeof(vec));
+  memset(point, 0, sizeof(point));
+  Ciao::Decoder parser;
+  uint16_t values = 0;
+  start = RTT::micros();
+  for (uint16_t pos = 0; pos < bytes; pos += 16) {
+    parser.feed(stream + pos, (bytes - pos < 16) ? bytes - pos : 16);
+    int event;
+    while ((event = parser.next()) > 0) {
+      if (event == Ciao::Decoder::VALUE_EVENT) {
+	values += 1;
+	continue;
+      }
+      if (parser.type() == Ciao::INT16_TYPE)
+	parser.bind(vec, sizeof(vec));
+      else if (parser.id() == Point_ID)
+	parser.bind(Point_layout, point, COUNT);
+    }
+    ASSERT(event == Ciao::Decoder::NO_EVENT);
+  }
+  us = RTT::micros() - start;
+  ASSERT(values == 2);
+  ASSERT(vec[COUNT - 1] == (COUNT - 1) * 7 - 300);
+  ASSERT(point[COUNT - 1].y == -(COUNT - 1));
+  result(PSTR("push:"), us, bytes);
+
+  sleep(5);
+}
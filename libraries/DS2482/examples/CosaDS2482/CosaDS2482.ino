@@ -31,8 +31,7 @@
 #include "Cosa/RTT.hh"
 #include "Cosa/Trace.hh"
 #include "Cosa/UART.hh"
-
-#include <util/crc16.h>
+#include "Cosa/CRC.hh"
 
 DS2482 owi;
 
@@ -108,7 +107,7 @@ void setup()
     ASSERT(owi.one_wire_write_byte(READ_ROM));
     for (int i = 0; i < (int) sizeof(rom); i++) {
       rom[i] = owi.one_wire_read_byte();
-      crc = _crc_ibutton_update(crc, rom[i]);
+      crc = CRC::Dallas::update(crc, rom[i]);
     }
     ASSERT(crc == 0);
   }
@@ -182,7 +181,7 @@ void loop()
   MEASURE("Validate check sum:", 1) {
     uint8_t* p = (uint8_t*) &scratchpad;
     for (int i = 0; i < (int) sizeof(scratchpad); i++) {
-      crc = _crc_ibutton_update(crc, p[i]);
+      crc = CRC::Dallas::update(crc, p[i]);
     }
     ASSERT(crc == 0);
   }
@@ -58,10 +58,10 @@ uint32_t FAT16::fatStartBlock;
 uint32_t FAT16::rootDirStartBlock;
 uint32_t FAT16::dataStartBlock;
 
-uint32_t FAT16::cacheBlockNumber = 0XFFFFFFFF;
-FAT16::cache16_t FAT16::cacheBuffer;
-uint8_t FAT16::cacheDirty = 0;
-uint32_t FAT16::cacheMirrorBlock = 0;
+FAT16::cache_t FAT16::cache[CACHE_MAX];
+BitSet<FAT16::FAT_BLOCK_MAX> FAT16::fatFree;
+BitSet<FAT16::FAT_BLOCK_MAX> FAT16::fatEmpty;
+FAT16::fat_t FAT16::freeHint;
 void (*FAT16::dateTime)(uint16_t* date, uint16_t* time) = NULL;
 
 bool
@@ -71,20 +71,22 @@ FAT16::begin(SD* sd, uint8_t part)
   if (UNLIKELY(part > 4)) return (false);
   device = sd;
   uint32_t volumeStartBlock = 0;
+  cache16_t* c;
+  cacheInvalidate();
 
   // If part == 0 assume super floppy with FAT16 boot sector in block zero
   // If part > 0 assume mbr volume with partition table
   if (part) {
-    if (!cacheRawBlock(volumeStartBlock)) return (false);
-    volumeStartBlock = cacheBuffer.mbr.part[part - 1].firstSector;
+    if (!(c = cacheRawBlock(volumeStartBlock))) return (false);
+    volumeStartBlock = c->mbr.part[part - 1].firstSector;
   }
-  if (!cacheRawBlock(volumeStartBlock)) return (false);
+  if (!(c = cacheRawBlock(volumeStartBlock))) return (false);
 
   // Check boot block signature
-  if (cacheBuffer.data[510] != BOOTSIG0 ||
-      cacheBuffer.data[511] != BOOTSIG1) return (false);
+  if (c->data[510] != BOOTSIG0 ||
+      c->data[511] != BOOTSIG1) return (false);
 
-  bpb_t* bpb = &cacheBuffer.fbs.bpb;
+  bpb_t* bpb = &c->fbs.bpb;
   fatCount = bpb->fatCount;
   blocksPerCluster = bpb->sectorsPerCluster;
   blocksPerFat = bpb->sectorsPerFat16;
@@ -107,6 +109,23 @@ FAT16::begin(SD* sd, uint8_t part)
       || (bpb->sectorsPerCluster & (bpb->sectorsPerCluster - 1))) {
     return (false);
   }
+
+  // Build free space summary; one bit per FAT block for blocks with
+  // free entries and for blocks with only free entries
+  fatFree.empty();
+  fatEmpty.empty();
+  for (uint16_t block = 0; block <= ((clusterCount + 1) >> 8); block++) {
+    if (!(c = cacheRawBlock(fatStartBlock + block))) return (false);
+    uint16_t free = 0;
+    for (uint16_t i = 0; i < 256; i++) {
+      fat_t cluster = (block << 8) + i;
+      if (cluster < 2 || cluster > clusterCount + 1) continue;
+      if (c->fat[i] == 0) free++;
+    }
+    if (free != 0) fatFree += block;
+    if (free == 256) fatEmpty += block;
+  }
+  freeHint = 2;
   volumeInitialized = true;
   return (true);
 }
@@ -216,6 +235,7 @@ FAT16::File::open(uint16_t index, uint8_t oflag)
 
   m_curCluster = 0;
   m_curPosition = 0;
+  mapReset();
   m_dirEntryIndex = index;
   m_fileSize = d->fileSize;
   m_firstCluster = d->firstClusterLow;
@@ -262,22 +282,31 @@ FAT16::File::read(void* buf, size_t nbyte)
     uint8_t blkOfCluster = blockOfCluster(m_curPosition);
     uint16_t blockOffset = cacheDataOffset(m_curPosition);
     if (blkOfCluster == 0 && blockOffset == 0) {
-      // Start next cluster
-      if (m_curCluster == 0) {
-        m_curCluster = m_firstCluster;
-      } else {
-        if (!fatGet(m_curCluster, &m_curCluster)) return (IOStream::EOF);
-      }
-      // Return error if bad cluster chain
-      if (m_curCluster < 2 || isEOC(m_curCluster)) return (IOStream::EOF);
+      // Start next cluster; return error if bad cluster chain
+      fat_t next = mapCluster(clusterIndex(m_curPosition));
+      if (next == 0 || isEOC(next)) return (IOStream::EOF);
+      m_curCluster = next;
+    }
+
+    // Read whole contiguous blocks directly to the caller's buffer
+    if (blockOffset == 0 && nToRead >= 512) {
+      uint32_t lba = dataBlockLba(m_curCluster, blkOfCluster);
+      uint8_t count = contiguousBlocks(blkOfCluster, nToRead);
+      if (!cacheBypass(lba, count, CACHE_FOR_READ)) return (IOStream::EOF);
+      if (!device->read(lba, dst, count)) return (IOStream::EOF);
+      uint16_t n = count << 9;
+      m_curPosition += n;
+      dst += n;
+      nToRead -= n;
+      continue;
     }
 
     // Cache data block
-    if (!cacheRawBlock(dataBlockLba(m_curCluster, blkOfCluster)))
-      return (IOStream::EOF);
+    cache16_t* c = cacheRawBlock(dataBlockLba(m_curCluster, blkOfCluster));
+    if (c == NULL) return (IOStream::EOF);
 
     // Location of data in cache
-    uint8_t* src = cacheBuffer.data + blockOffset;
+    uint8_t* src = c->data + blockOffset;
 
     // Max number of byte available in block
     uint16_t n = 512 - blockOffset;
@@ -313,36 +342,37 @@ FAT16::File::write(const void* buf, size_t nbyte)
     uint8_t blkOfCluster = blockOfCluster(m_curPosition);
     uint16_t blockOffset = cacheDataOffset(m_curPosition);
     if (blkOfCluster == 0 && blockOffset == 0) {
-      // Start of new cluster
-      if (m_curCluster == 0) {
-        if (m_firstCluster == 0) {
-          // Allocate first cluster of file
-          if (!addCluster()) return (IOStream::EOF);
-        } else {
-          m_curCluster = m_firstCluster;
-        }
+      // Start of new cluster; add cluster if at end of chain
+      fat_t next = mapCluster(clusterIndex(m_curPosition));
+      if (next == 0) return (IOStream::EOF);
+      if (isEOC(next)) {
+        if (!addCluster()) return (IOStream::EOF);
       } else {
-        fat_t next;
-        if (!fatGet(m_curCluster, &next)) return (IOStream::EOF);
-        if (isEOC(next)) {
-          // Add cluster if at end of chain
-          if (!addCluster()) return (IOStream::EOF);
-        } else {
-          m_curCluster = next;
-        }
+        m_curCluster = next;
       }
     }
-    uint32_t lba = dataBlockLba(m_curCluster, blkOfCluster);
-    if (blockOffset == 0 && m_curPosition >= m_fileSize) {
-      // Start of new block don't need to read into cache
-      if (!cacheFlush()) return (IOStream::EOF);
-      cacheBlockNumber = lba;
-      cacheSetDirty();
-    } else {
-      // Rewrite part of block
-      if (!cacheRawBlock(lba, CACHE_FOR_WRITE)) return (IOStream::EOF);
+    // Write whole contiguous blocks directly from the caller's buffer
+    if (blockOffset == 0 && nToWrite >= 512) {
+      uint32_t lba = dataBlockLba(m_curCluster, blkOfCluster);
+      uint8_t count = contiguousBlocks(blkOfCluster, nToWrite);
+      if (!cacheBypass(lba, count, CACHE_FOR_WRITE)) return (IOStream::EOF);
+      if (!device->write(lba, src, count)) return (IOStream::EOF);
+      uint16_t n = count << 9;
+      m_curPosition += n;
+      src += n;
+      nToWrite -= n;
+      continue;
     }
-    uint8_t* dst = cacheBuffer.data + blockOffset;
+
+    // Start of new block don't need to read into cache otherwise
+    // rewrite part of block
+    uint32_t lba = dataBlockLba(m_curCluster, blkOfCluster);
+    uint8_t action = CACHE_FOR_WRITE;
+    if (blockOffset == 0 && m_curPosition >= m_fileSize)
+      action = CACHE_FOR_OVERWRITE;
+    cache16_t* c = cacheRawBlock(lba, action);
+    if (c == NULL) return (IOStream::EOF);
+    uint8_t* dst = c->data + blockOffset;
 
     // Max space in block
     uint16_t n = 512 - blockOffset;
@@ -394,17 +424,11 @@ FAT16::File::seek(uint32_t pos, uint8_t whence)
     m_curPosition = 0;
     return (true);
   }
-  fat_t n = ((pos - 1) >> 9) / blocksPerCluster;
-  if (pos < m_curPosition || m_curPosition == 0) {
-    // Must follow chain from first cluster
-    m_curCluster = m_firstCluster;
-  } else {
-    // Advance from curPosition
-    n -= ((m_curPosition - 1) >> 9)/blocksPerCluster;
-  }
-  while (n--) {
-    if (!fatGet(m_curCluster, &m_curCluster)) return (false);
-  }
+  // Lookup cluster of the last byte before the position in the
+  // extent map
+  fat_t cluster = mapCluster(clusterIndex(pos - 1));
+  if (cluster == 0 || isEOC(cluster)) return (false);
+  m_curCluster = cluster;
   m_curPosition = pos;
   return (true);
 }
@@ -417,13 +441,15 @@ FAT16::File::truncate(uint32_t length)
 
   if (length > m_fileSize) return (false);
 
-  // Filesize and length are zero - nothing to do
-  if (m_fileSize == 0) return (true);
+  // No clusters allocated - nothing to do
+  m_flags &= ~F_FILE_PREALLOC;
+  if (m_firstCluster == 0) return (true);
   uint32_t newPos = m_curPosition > length ? length : m_curPosition;
   if (length == 0) {
     // Free all clusters
     if (!freeChain(m_firstCluster)) return (false);
     m_curCluster = m_firstCluster = 0;
+    mapReset();
   }
   else {
     fat_t toFree;
@@ -433,6 +459,7 @@ FAT16::File::truncate(uint32_t length)
       // Free extra clusters
       if (!fatPut(m_curCluster, EOC16)) return (false);
       if (!freeChain(toFree)) return (false);
+      mapReset();
     }
   }
   m_fileSize = length;
@@ -441,6 +468,39 @@ FAT16::File::truncate(uint32_t length)
   return seek(newPos);
 }
 
+bool
+FAT16::File::preallocate(uint32_t size)
+{
+  // Error if file is not open for write or not empty
+  if (!(m_flags & O_WRITE) || m_firstCluster != 0) return (false);
+  if (size == 0) return (true);
+
+  // Find a run of contiguous free clusters
+  uint32_t clusterSize = ((uint32_t) blocksPerCluster) << 9;
+  uint32_t count = (size - 1) / clusterSize + 1;
+  if (count > clusterCount) return (false);
+  fat_t first = fatFindFree(freeHint, count);
+  if (first == 0) return (false);
+
+  // Link the cluster chain and update directory entry
+  fat_t last = first + count - 1;
+  for (fat_t cluster = first; cluster < last; cluster++)
+    if (!fatPut(cluster, cluster + 1)) return (false);
+  if (!fatPut(last, EOC16)) return (false);
+  freeHint = last + 1;
+  m_firstCluster = first;
+  m_curCluster = 0;
+  m_flags |= (F_FILE_DIR_DIRTY | F_FILE_PREALLOC);
+
+  // The chain is a single extent; map it so that writes do not need
+  // to access the FAT
+  mapReset();
+  m_extent[0].cluster = first;
+  m_extent[0].count = count;
+  m_extents = 1;
+  return (sync());
+}
+
 bool
 FAT16::File::dirEntry(FAT16::dir_t* dir)
 {
@@ -525,25 +585,87 @@ FAT16::ls(IOStream& outs, uint8_t flags)
   }
 }
 
-bool
-FAT16::File::addCluster()
+FAT16::fat_t
+FAT16::File::mapCluster(fat_t index)
 {
-  // Start search after last cluster of file or at cluster two in FAT
-  fat_t freeCluster = m_curCluster ? m_curCluster : 1;
+  // Search the extent map for the cluster index
+  extent_t* ep = m_extent;
+  fat_t base = 0;
+  for (uint8_t i = 0; i < m_extents; i++, ep++) {
+    if (index < base + ep->count) return (ep->cluster + (index - base));
+    base += ep->count;
+  }
 
-  for (fat_t i = 0; ; i++) {
-    // Return no free clusters
-    if (i >= clusterCount) return (false);
-    // Fat has clusterCount + 2 entries
-    if (freeCluster > clusterCount) freeCluster = 1;
-    freeCluster++;
-    fat_t value;
-    if (!fatGet(freeCluster, &value)) return (false);
-    if (value == 0) break;
+  // Extend the map by following the cluster chain from the last
+  // mapped cluster. When the map is full the chain is followed
+  // without recording, from the latest cluster found if possible
+  if (m_firstCluster == 0) return (EOC16);
+  if (m_extents == 0) {
+    m_extent[0].cluster = m_firstCluster;
+    m_extent[0].count = 1;
+    m_extents = 1;
+    base = 1;
   }
+  ep = &m_extent[m_extents - 1];
+  fat_t cluster = ep->cluster + ep->count - 1;
+  bool record = true;
+  if (m_hintIndex >= base && m_hintIndex <= index) {
+    cluster = m_hintCluster;
+    base = m_hintIndex + 1;
+    record = false;
+  }
+  while (base <= index) {
+    fat_t next;
+    if (!fatGet(cluster, &next) || next < 2) return (0);
+    if (isEOC(next)) return (EOC16);
+    if (record) {
+      if (next == cluster + 1) {
+	ep->count += 1;
+      }
+      else if (m_extents < EXTENT_MAX) {
+	ep += 1;
+	ep->cluster = next;
+	ep->count = 1;
+	m_extents += 1;
+      }
+      else record = false;
+    }
+    cluster = next;
+    base += 1;
+  }
+  if (!record) {
+    m_hintIndex = index;
+    m_hintCluster = cluster;
+  }
+  return (cluster);
+}
+
+uint8_t
+FAT16::File::contiguousBlocks(uint8_t blkOfCluster, uint16_t nbyte)
+{
+  // Follow the cluster chain while the clusters are contiguous
+  fat_t index = clusterIndex(m_curPosition);
+  uint16_t max = nbyte >> 9;
+  uint16_t count = blocksPerCluster - blkOfCluster;
+  while (count < max) {
+    fat_t next = mapCluster(++index);
+    if (next != m_curCluster + 1) break;
+    m_curCluster = next;
+    count += blocksPerCluster;
+  }
+  return (count < max ? count : max);
+}
+
+bool
+FAT16::File::addCluster()
+{
+  // Start search after last cluster of file or at the allocation hint
+  fat_t freeCluster = fatFindFree(m_curCluster ? m_curCluster + 1 : freeHint, 1);
+  if (freeCluster == 0) return (false);
 
   // Mark cluster allocated
   if (!fatPut(freeCluster, EOC16)) return (false);
+  freeHint = freeCluster + 1;
 
   if (m_curCluster != 0) {
     // Link cluster to chain
@@ -561,49 +683,178 @@ FAT16::dir_t*
 FAT16::cacheDirEntry(uint16_t index, uint8_t action)
 {
   if (index >= rootDirEntryCount) return NULL;
-  if (!cacheRawBlock(rootDirStartBlock + (index >> 4), action)) return NULL;
-  return &cacheBuffer.dir[index & 0XF];
+  cache16_t* c = cacheRawBlock(rootDirStartBlock + (index >> 4), action);
+  if (c == NULL) return NULL;
+  return &c->dir[index & 0XF];
 }
 
-uint8_t
-FAT16::cacheFlush(void)
+void
+FAT16::cacheInvalidate(void)
 {
-  if (cacheDirty) {
-    if (!device->write(cacheBlockNumber, cacheBuffer.data)) {
-      return (false);
+  for (uint8_t i = 0; i < CACHE_MAX; i++) {
+    cache[i].lba = CACHE_INVALID;
+    cache[i].age = i;
+    cache[i].dirty = 0;
+  }
+}
+
+void
+FAT16::cacheTouch(cache_t* slot)
+{
+  // Age all blocks more recent than the given block
+  uint8_t age = slot->age;
+  for (uint8_t i = 0; i < CACHE_MAX; i++)
+    if (cache[i].age < age) cache[i].age += 1;
+  slot->age = 0;
+}
+
+bool
+FAT16::cacheWrite(cache_t* slot)
+{
+  if (!device->write(slot->lba, slot->buf.data)) return (false);
+
+  // Update mirror blocks for FAT copies
+  if (isFatBlock(slot->lba)) {
+    uint32_t lba = slot->lba;
+    for (uint8_t i = 1; i < fatCount; i++) {
+      lba += blocksPerFat;
+      if (!device->write(lba, slot->buf.data)) return (false);
     }
-    if (cacheMirrorBlock) {
-      if (!device->write(cacheMirrorBlock, cacheBuffer.data)) {
-        return (false);
-      }
-      cacheMirrorBlock = 0;
+  }
+  slot->dirty = 0;
+  return (true);
+}
+
+bool
+FAT16::cacheBypass(uint32_t blockNumber, uint8_t count, uint8_t action)
+{
+  // Write back cached blocks in the range before read. Drop cached
+  // blocks in the range on write
+  for (uint8_t i = 0; i < CACHE_MAX; i++) {
+    cache_t* slot = &cache[i];
+    if (slot->lba < blockNumber || slot->lba >= blockNumber + count) continue;
+    if (action & CACHE_FOR_WRITE) {
+      slot->lba = CACHE_INVALID;
+      slot->dirty = 0;
     }
-    cacheDirty = 0;
+    else if (slot->dirty && !cacheWrite(slot)) return (false);
   }
   return (true);
 }
 
 uint8_t
+FAT16::cacheFlush(void)
+{
+  // Write dirty blocks in block number order
+  while (1) {
+    cache_t* slot = NULL;
+    for (uint8_t i = 0; i < CACHE_MAX; i++) {
+      if (cache[i].dirty && (slot == NULL || cache[i].lba < slot->lba))
+	slot = &cache[i];
+    }
+    if (slot == NULL) return (true);
+    if (!cacheWrite(slot)) return (false);
+  }
+}
+
+FAT16::cache16_t*
 FAT16::cacheRawBlock(uint32_t blockNumber, uint8_t action)
 {
-  if (cacheBlockNumber != blockNumber) {
-    if (!cacheFlush()) return (false);
-    if (!device->read(blockNumber, cacheBuffer.data)) return (false);
-    cacheBlockNumber = blockNumber;
+  // Check if the block is already in the cache
+  cache_t* slot = NULL;
+  for (uint8_t i = 0; i < CACHE_MAX; i++) {
+    if (cache[i].lba == blockNumber) {
+      slot = &cache[i];
+      break;
+    }
   }
-  cacheDirty |= action;
-  return (true);
+
+  // Replace the least recently used block. FAT blocks always use the
+  // first slot; other blocks the remaining slots (if any)
+  if (slot == NULL) {
+    bool fat = isFatBlock(blockNumber);
+    uint8_t i = (fat || CACHE_MAX == 1) ? 0 : 1;
+    uint8_t end = fat ? 1 : CACHE_MAX;
+    slot = &cache[i];
+    for (; i < end; i++)
+      if (cache[i].age > slot->age) slot = &cache[i];
+    if (slot->dirty && !cacheWrite(slot)) return (NULL);
+    slot->lba = CACHE_INVALID;
+    if ((action & CACHE_FOR_OVERWRITE) != CACHE_FOR_OVERWRITE) {
+      if (!device->read(blockNumber, slot->buf.data)) return (NULL);
+    }
+    slot->lba = blockNumber;
+  }
+  cacheTouch(slot);
+  slot->dirty |= (action & CACHE_FOR_WRITE);
+  return (&slot->buf);
+}
+
+FAT16::fat_t
+FAT16::fatFindFree(fat_t start, fat_t count)
+{
+  fat_t last = clusterCount + 1;
+  fat_t cluster = (start < 2 || start > last) ? 2 : start;
+  fat_t first = 0;
+  fat_t run = 0;
+  uint16_t free = 0;
+  bool whole = false;
+
+  for (uint32_t n = 0; n < clusterCount; n++, cluster++) {
+    // Restart at cluster two; a run may not wrap around
+    if (cluster > last || cluster < 2) {
+      cluster = 2;
+      run = 0;
+      whole = false;
+    }
+
+    // Skip FAT block without free entries. Take FAT block with only
+    // free entries without reading it
+    uint8_t block = cluster >> 8;
+    uint8_t index = cluster & 0xff;
+    if (index == 0) {
+      if (!fatFree[block] || (fatEmpty[block] && cluster + 255 <= last)) {
+	if (fatFree[block]) {
+	  if (run == 0) first = cluster;
+	  run += 256;
+	  if (run >= count) return (first);
+	}
+	else run = 0;
+	n += 255;
+	cluster += 255;
+	continue;
+      }
+      whole = true;
+      free = 0;
+    }
+
+    // Check entry; extend or restart run
+    fat_t value;
+    if (!fatGet(cluster, &value)) return (0);
+    if (value == 0) {
+      if (run == 0) first = cluster;
+      run += 1;
+      free += 1;
+      if (run >= count) return (first);
+    }
+    else run = 0;
+
+    // Update free space summary when a whole block was scanned
+    if (whole && (index == 0xff || cluster == last)) {
+      if (free == 0) fatFree -= block;
+      whole = false;
+    }
+  }
+  return (0);
 }
 
 bool
 FAT16::fatGet(fat_t cluster, fat_t* value)
 {
   if (cluster > (clusterCount + 1)) return (false);
-  uint32_t lba = fatStartBlock + (cluster >> 8);
-  if (lba != cacheBlockNumber) {
-    if (!cacheRawBlock(lba)) return (false);
-  }
-  *value = cacheBuffer.fat[cluster & 0XFF];
+  cache16_t* c = cacheRawBlock(fatStartBlock + (cluster >> 8));
+  if (c == NULL) return (false);
+  *value = c->fat[cluster & 0XFF];
   return (true);
 }
 
@@ -612,13 +863,16 @@ FAT16::fatPut(fat_t cluster, fat_t value)
 {
   if (cluster < 2) return (false);
   if (cluster > (clusterCount + 1)) return (false);
-  uint32_t lba = fatStartBlock + (cluster >> 8);
-  if (lba != cacheBlockNumber) {
-    if (!cacheRawBlock(lba)) return (false);
+  cache16_t* c = cacheRawBlock(fatStartBlock + (cluster >> 8), CACHE_FOR_WRITE);
+  if (c == NULL) return (false);
+  c->fat[cluster & 0XFF] = value;
+
+  // Update free space summary and allocation hint
+  if (value == 0) {
+    fatFree += (cluster >> 8);
+    if (cluster < freeHint) freeHint = cluster;
   }
-  cacheBuffer.fat[cluster & 0XFF] = value;
-  cacheSetDirty();
-  if (fatCount > 1) cacheMirrorBlock = lba + blocksPerFat;
+  else fatEmpty -= (cluster >> 8);
   return (true);
 }
 
@@ -26,6 +26,27 @@
 
 #include "Cosa/IOStream.hh"
 #include "Cosa/FS.hh"
+#include "Cosa/BitSet.hh"
+
+/**
+ * Number of 512 byte blocks in the FAT16 block cache. Each block
+ * costs 518 bytes of static RAM. The default is a single block shared
+ * by the FAT, directory and data blocks. With two or more blocks the
+ * first is reserved for the FAT and the others are replaced in LRU
+ * order, so cluster chain access will not evict the directory or
+ * data block in use. The free space summary adds 64 bytes.
+ */
+#if !defined(FAT16_CACHE_MAX)
+#define FAT16_CACHE_MAX 1
+#endif
+
+/**
+ * Number of extents (runs of contiguous clusters) in the cluster map
+ * of an open file.
+ */
+#if !defined(FAT16_EXTENT_MAX)
+#define FAT16_EXTENT_MAX 4
+#endif
 
 /*
  * FAT16 file structures on SD card. Note: may only access files on the
@@ -612,11 +633,27 @@ public:
      */
     bool close()
     {
+      if ((m_flags & F_FILE_PREALLOC) && !truncate(m_fileSize)) return false;
       if (!sync()) return false;
       m_flags = 0;
       return true;
     }
 
+    /**
+     * Preallocate a contiguous run of clusters for the given number
+     * of bytes. The file must be open for write and empty. Writes
+     * within the preallocated size are sequential block writes
+     * without FAT updates. Clusters beyond the end of file are
+     * released on close(). Intended for data logging at high sample
+     * rates.
+     * @param[in] size number of bytes to preallocate.
+     * @return bool, true if successful otherwise false for
+     * failure. Reasons for failure include the file is not open for
+     * write, not empty, no contiguous free run of the size or an I/O
+     * error occurred.
+     */
+    bool preallocate(uint32_t size);
+
     /**
      * Sets the file's read/write position relative to mode.
      * @param[in] pos new position in bytes from given mode.
@@ -693,15 +730,48 @@ public:
     virtual int read(void* buf, size_t size);
 
   protected:
+    /**
+     * Extent; run of contiguous clusters in the file cluster chain.
+     */
+    struct extent_t {
+      fat_t cluster;		// first cluster of run
+      fat_t count;		// number of clusters in run
+    };
+    static const uint8_t EXTENT_MAX = FAT16_EXTENT_MAX;
+
     uint8_t m_flags;          // see above for bit definitions
     int16_t m_dirEntryIndex;  // index of directory entry for open file
     fat_t m_firstCluster;     // first cluster of file
     uint32_t m_fileSize;      // fileSize
     fat_t m_curCluster;       // current cluster
     uint32_t m_curPosition;   // current byte offset
+    uint8_t m_extents;        // number of extents in map
+    extent_t m_extent[EXTENT_MAX]; // cluster map of file prefix
+    fat_t m_hintIndex;        // index of latest cluster found beyond map
+    fat_t m_hintCluster;      // latest cluster found beyond map
 
     static uint8_t isEOC(fat_t cluster) { return cluster >= 0XFFF8; }
     bool addCluster();
+    uint8_t contiguousBlocks(uint8_t blkOfCluster, uint16_t nbyte);
+
+    /**
+     * Return cluster with given index in the file cluster chain.
+     * The extent map is searched first and extended by following the
+     * chain when needed. Returns EOC16 if the index is beyond the end
+     * of the chain, zero on error.
+     * @param[in] index of cluster in file.
+     * @return cluster, EOC16 or zero.
+     */
+    fat_t mapCluster(fat_t index);
+
+    /**
+     * Reset the extent map. Called when the cluster chain is changed.
+     */
+    void mapReset()
+    {
+      m_extents = 0;
+      m_hintIndex = 0;
+    }
     bool freeChain(fat_t cluster);
     bool open(uint16_t entry, uint8_t oflag);
     bool dirEntry(dir_t* dir);
@@ -786,19 +856,38 @@ protected:
   static uint32_t rootDirStartBlock;	// start of root dir
   static uint32_t dataStartBlock;	// start of data clusters
 
-  // block cache
+  // block cache; N blocks with LRU replacement and per-block dirty
+  // state. With more than one slot, slot zero is reserved for FAT
+  // blocks and FAT blocks only use slot zero, so cluster chain access
+  // and free cluster scans will not evict the directory or data block
+  // in use. A single slot is shared by all blocks
   static uint8_t const CACHE_FOR_READ  = 0;    // cache a block for read
   static uint8_t const CACHE_FOR_WRITE = 1;    // cache a block and set dirty
-  static cache16_t cacheBuffer;		// 512 byte cache for raw blocks
-  static uint32_t cacheBlockNumber; 	// Logical number of block in the cache
-  static uint8_t cacheDirty;         	// cacheFlush() will write block if true
-  static uint32_t cacheMirrorBlock;  	// mirror block for second FAT
+  static uint8_t const CACHE_FOR_OVERWRITE = 3; // as above but no read
+  static uint8_t const CACHE_MAX = FAT16_CACHE_MAX;
+  static uint32_t const CACHE_INVALID = 0XFFFFFFFF;
+  static_assert(CACHE_MAX >= 1, "FAT16_CACHE_MAX must be one or more");
+  struct cache_t {
+    uint32_t lba;			// Logical number of block in slot
+    uint8_t age;			// LRU order; zero most recent
+    uint8_t dirty;			// cacheFlush() will write block if set
+    cache16_t buf;			// 512 byte cache for raw block
+  };
+  static cache_t cache[CACHE_MAX];
+
+  // free space summary; one bit per FAT block with free entries and
+  // with only free entries, and next free cluster hint
+  static uint16_t const FAT_BLOCK_MAX = 256;
+  static BitSet<FAT_BLOCK_MAX> fatFree;
+  static BitSet<FAT_BLOCK_MAX> fatEmpty;
+  static fat_t freeHint;
 
   // callback function for date/time
   static void (*dateTime)(uint16_t* date, uint16_t* time);
 
   // define fields in flags_ require sync directory entry
   static uint8_t const F_OFLAG = O_RDWR | O_APPEND | O_SYNC;
+  static uint8_t const F_FILE_PREALLOC = 0X40;
   static uint8_t const F_FILE_DIR_DIRTY = 0X80;
 
   static bool make83Name(const char* str, uint8_t* name);
@@ -807,16 +896,25 @@ protected:
   {
     return (position >> 9) & (blocksPerCluster - 1);
   }
+  static fat_t clusterIndex(uint32_t position)
+  {
+    return (position >> 9) / blocksPerCluster;
+  }
   static uint16_t cacheDataOffset(uint32_t position)
   {
     return position & 0X1FF;
   }
   static dir_t* cacheDirEntry(uint16_t index, uint8_t action = 0);
-  static uint8_t cacheRawBlock(uint32_t blockNumber, uint8_t action = 0);
+  static cache16_t* cacheRawBlock(uint32_t blockNumber, uint8_t action = 0);
   static uint8_t cacheFlush(void);
-  static void cacheSetDirty(void)
+  static bool cacheWrite(cache_t* slot);
+  static void cacheTouch(cache_t* slot);
+  static void cacheInvalidate(void);
+  static bool cacheBypass(uint32_t blockNumber, uint8_t count, uint8_t action);
+  static bool isFatBlock(uint32_t blockNumber)
   {
-    cacheDirty |= CACHE_FOR_WRITE;
+    return (blockNumber >= fatStartBlock &&
+	    blockNumber < fatStartBlock + blocksPerFat);
   }
   static uint32_t dataBlockLba(fat_t cluster, uint8_t blockOfCluster)
   {
@@ -825,6 +923,7 @@ protected:
 	    blockOfCluster);
   }
 
+  static fat_t fatFindFree(fat_t start, fat_t count);
   static bool fatGet(fat_t cluster, fat_t* value);
   static bool fatPut(fat_t cluster, fat_t value);
 
@@ -0,0 +1,116 @@
+/**
+ * @file CosaFAT16benchmark.ino
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * @section Description
+ * Data logger benchmark of the FAT16/SD file access class; streaming
+ * write and read of fixed size log entries. Prints throughput and
+ * max latency of an entry write; normal append and with the log file
+ * preallocated. The number of blocks in the FAT16 block cache is
+ * given by FAT16_CACHE_MAX (default 1, see FAT16.hh).
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#include <SD.h>
+#include <FAT16.h>
+
+#include "Cosa/RTT.hh"
+#include "Cosa/Trace.hh"
+#include "Cosa/UART.hh"
+#include "Cosa/Watchdog.hh"
+
+//#define USE_SD_ADAPTER
+#define USE_SD_DATA_LOGGING_SHIELD
+//#define USE_ETHERNET_SHIELD
+//#define USE_TFT_ST7735
+
+#if defined(WICKEDDEVICE_WILDFIRE) || defined(USE_SD_ADAPTER)
+SD sd;
+
+#elif defined(USE_ETHERNET_SHIELD)
+SD sd(Board::D4);
+OutputPin eth(Board::D10, 1);
+
+#elif defined(USE_TFT_ST7735)
+SD sd;
+OutputPin tft(Board::D10, 1);
+
+#elif defined(USE_SD_DATA_LOGGING_SHIELD)
+SD sd(Board::D10);
+#endif
+
+#define CLOCK SPI::DIV2_CLOCK
+
+// Log size in bytes and entry sizes
+static const uint32_t LOG_SIZE = 100 * 1024L;
+static const size_t ENTRY_SIZE[] = { 16, 64, 512 };
+static const size_t ENTRY_MAX = 512;
+
+void setup()
+{
+  Watchdog::begin();
+  RTT::begin();
+  uart.begin(9600);
+  trace.begin(&uart, PSTR("CosaFAT16benchmark: started"));
+  ASSERT(sd.begin(CLOCK));
+  ASSERT(FAT16::begin(&sd));
+}
+
+void loop()
+{
+  uint8_t buf[ENTRY_MAX];
+  uint32_t start, ms, us, max;
+  FAT16::File file;
+
+  for (uint8_t i = 0; i < membersof(ENTRY_SIZE); i++) {
+    size_t size = ENTRY_SIZE[i];
+    for (size_t j = 0; j < size; j++) buf[j] = j;
+
+    // Streaming write of log entries; append and preallocated
+    for (uint8_t prealloc = 0; prealloc < 2; prealloc++) {
+      max = 0;
+      ASSERT(file.open("LOG.BIN", O_TRUNC | O_WRITE | O_CREAT));
+      start = RTT::millis();
+      if (prealloc) ASSERT(file.preallocate(LOG_SIZE));
+      for (uint32_t pos = 0; pos < LOG_SIZE; pos += size) {
+	us = RTT::micros();
+	ASSERT(file.write(buf, size) == (int) size);
+	us = RTT::since(us);
+	if (us > max) max = us;
+      }
+      ASSERT(file.close());
+      ms = RTT::since(start);
+      trace << (prealloc ? PSTR("preallocate:") : PSTR("append:"))
+	    << PSTR("write(") << size << PSTR("):")
+	    << (LOG_SIZE / ms) << PSTR(" kbyte/s, max ")
+	    << max << PSTR(" us")
+	    << endl;
+    }
+
+    // Streaming read of log entries
+    ASSERT(file.open("LOG.BIN", O_READ));
+    start = RTT::millis();
+    while (file.read(buf, size) == (int) size);
+    ms = RTT::since(start);
+    ASSERT(file.close());
+    trace << PSTR("read(") << size << PSTR("):")
+	  << (LOG_SIZE / ms) << PSTR(" kbyte/s")
+	  << endl;
+  }
+  ASSERT(FAT16::rm("LOG.BIN"));
+  ASSERT(true == false);
+}
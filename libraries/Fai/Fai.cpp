@@ -37,36 +37,38 @@ Fai::begin()
 
 #if defined(BOARD_ATTINYX5)
 
-void
-Fai::write(uint32_t mask)
+uint32_t
+Fai::pins()
 {
-  digital_pins_t dgl;
-  dgl.values = (PINB & mask);
-  Ciao::write(&Descriptor::digital_pins_t, &dgl, 1);
+  return (PINB);
 }
 
 #elif defined(BOARD_ATTINYX4) || defined(BOARD_ATTINYX61)
 
-void
-Fai::write(uint32_t mask)
+uint32_t
+Fai::pins()
 {
-  digital_pins_t dgl;
-  dgl.values = ((PINB << 8) | PINA) & mask;
-  Ciao::write(&Descriptor::digital_pins_t, &dgl, 1);
+  return ((PINB << 8) | PINA);
 }
 
 #else
 
+uint32_t
+Fai::pins()
+{
+  return ((PINB << 8) | PIND);
+}
+
+#endif
+
 void
 Fai::write(uint32_t mask)
 {
   digital_pins_t dgl;
-  dgl.values = ((PINB << 8) | PIND) & mask;
+  dgl.values = pins() & mask;
   Ciao::write(&Descriptor::digital_pins_t, &dgl, 1);
 }
 
-#endif
-
 void
 Fai::write(Pin* pin)
 {
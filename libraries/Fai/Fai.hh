@@ -44,7 +44,11 @@ public:
       DIGITAL_PINS_ID,
       EVENT_ID,
       SAMPLE_REQUEST_ID,
-      SET_MODE_ID
+      SET_MODE_ID,
+      STREAM_ID,
+      ANALOG_KEYFRAME_ID,
+      ANALOG_DELTA_ID,
+      STREAM_REQUEST_ID = Ciao::Descriptor::COSA_FAI_ID + 0x80
     };
     static const Ciao::Descriptor::user_t analog_pin_t PROGMEM;
     static const Ciao::Descriptor::user_t digital_pin_t PROGMEM;
@@ -52,6 +56,10 @@ public:
     static const Ciao::Descriptor::user_t event_t PROGMEM;
     static const Ciao::Descriptor::user_t sample_request_t PROGMEM;
     static const Ciao::Descriptor::user_t set_mode_t PROGMEM;
+    static const Ciao::Descriptor::user_t stream_t PROGMEM;
+    static const Ciao::Descriptor::user_t stream_request_t PROGMEM;
+    static const Ciao::Descriptor::user_t analog_keyframe_t PROGMEM;
+    static const Ciao::Descriptor::user_t analog_delta_t PROGMEM;
   };
 
   /**
@@ -78,7 +86,7 @@ public:
   };
 
   /**
-   * Stream sample request. The identity code is SAMPLE_REQUEST_ID(0x20).
+   * Stream sample request. The identity code is SAMPLE_REQUEST_ID(0x14).
    */
   struct sample_request_t {
     uint32_t pins;
@@ -86,13 +94,246 @@ public:
   };
 
   /**
-   * Stream set mode request. The identity code is SET_MODE_ID(0x21).
+   * Stream set mode request. The identity code is SET_MODE_ID(0x15).
    */
   struct set_mode_t {
     uint8_t pin;
     uint8_t mode;
   };
 
+  /**
+   * Stream configuration; analog pins (bit mask of Board::AnalogPin
+   * channels 0..15), digital pins (bit mask), sample period (ms) and
+   * keyframe interval (frames, zero for initial keyframe only). The
+   * identity code is STREAM_ID(0x16). The same structure is used for
+   * a stream request with the identity code STREAM_REQUEST_ID(0x90).
+   */
+  struct stream_t {
+    uint16_t pins;
+    uint32_t digital;
+    uint16_t period;
+    uint8_t keyframe;
+  };
+  typedef stream_t stream_request_t;
+
+  /**
+   * Stream analog keyframe; sequence of values for the analog pins in
+   * the stream configuration. The identity code is
+   * ANALOG_KEYFRAME_ID(0x17).
+   */
+  struct analog_keyframe_t {
+    uint16_t value;
+  };
+
+  /**
+   * Stream analog delta frame; sequence of bytes. The first byte is
+   * the bit width of the deltas followed by the zig-zag encoded deltas
+   * to the previous values for the analog pins in the stream
+   * configuration, bit-packed least significant bit first. The
+   * identity code is ANALOG_DELTA_ID(0x18).
+   */
+  struct analog_delta_t {
+    uint8_t data;
+  };
+
+  /** Max number of analog pins in stream. */
+  static const uint8_t CHANNEL_MAX = 16;
+
+  /** Max bit width of deltas; a keyframe is written if wider. */
+  static const uint8_t WIDTH_MAX = 15;
+
+  /** Max size of delta frame in bytes. */
+  static const uint8_t FRAME_MAX = 1 + (CHANNEL_MAX * WIDTH_MAX + 7) / 8;
+
+  /**
+   * Delta compressed periodic sample stream encoder. Analog samples
+   * are written as a keyframe followed by delta frames. A keyframe
+   * is written on the keyframe interval or when a delta does not fit
+   * in WIDTH_MAX bits. Digital pins are written when changed (and
+   * after a keyframe).
+   */
+  class StreamEncoder {
+  public:
+    /**
+     * Construct stream encoder for given data stream.
+     * @param[in] fai data stream.
+     */
+    StreamEncoder(Fai* fai) :
+      m_fai(fai),
+      m_count(0),
+      m_frame(0),
+      m_sync(false),
+      m_digital_sync(false),
+      m_digital(0L)
+    {
+      m_config.pins = 0;
+      m_config.digital = 0L;
+    }
+
+    /**
+     * Start stream with given analog and digital pins, sample period
+     * and keyframe interval. Writes the stream descriptors and
+     * configuration.
+     * @param[in] pins analog pins (bit mask of channels).
+     * @param[in] digital digital pins (bit mask, default none).
+     * @param[in] period sample period in milli-seconds (default 10).
+     * @param[in] keyframe interval in frames (default 100).
+     */
+    void begin(uint16_t pins,
+	       uint32_t digital = 0L,
+	       uint16_t period = 10,
+	       uint8_t keyframe = 100);
+
+    /**
+     * Start stream with given stream request.
+     * @param[in] request stream configuration.
+     */
+    void begin(const stream_request_t& request)
+    {
+      begin(request.pins, request.digital, request.period, request.keyframe);
+    }
+
+    /**
+     * Return stream configuration.
+     * @return configuration.
+     */
+    const stream_t& config() const
+    {
+      return (m_config);
+    }
+
+    /**
+     * Return number of analog pins in stream.
+     * @return channels.
+     */
+    uint8_t channels() const
+    {
+      return (m_count);
+    }
+
+    /**
+     * Write given analog values for the analog pins in the stream
+     * configuration (in channel order) as a keyframe or delta frame.
+     * @param[in] values analog values.
+     */
+    void analog(const uint16_t* values);
+
+    /**
+     * Write given digital pin values if changed.
+     * @param[in] values digital pins.
+     */
+    void digital(uint32_t values);
+
+    /**
+     * Sample and write the analog and digital pins in the stream
+     * configuration. Should be called with the sample period.
+     */
+    void sample();
+
+  protected:
+    Fai* m_fai;				//!< Data stream.
+    stream_t m_config;			//!< Stream configuration.
+    uint8_t m_count;			//!< Number of analog pins.
+    uint8_t m_frame;			//!< Frames since keyframe.
+    bool m_sync;			//!< Keyframe written.
+    bool m_digital_sync;		//!< Digital pins written.
+    uint32_t m_digital;			//!< Previous digital pins.
+    uint16_t m_value[CHANNEL_MAX];	//!< Previous analog values.
+
+    /**
+     * Write given analog values as a keyframe.
+     * @param[in] values analog values.
+     */
+    void keyframe(const uint16_t* values);
+  };
+
+  /**
+   * Delta compressed periodic sample stream decoder. Reads records
+   * from a Ciao data stream decoder and maintains the stream
+   * configuration, analog values and digital pins. Other records
+   * with Fai (or Ciao header) data types are skipped.
+   */
+  class StreamDecoder {
+  public:
+    /**
+     * Construct stream decoder for given data stream decoder.
+     * @param[in] in data stream decoder.
+     */
+    StreamDecoder(Ciao::Decoder* in) :
+      m_in(in),
+      m_count(0),
+      m_digital(0L)
+    {
+      m_config.pins = 0;
+      m_config.digital = 0L;
+      m_config.period = 0;
+      m_config.keyframe = 0;
+    }
+
+    /**
+     * Read next stream record. Returns the identity code of the
+     * record (STREAM_ID, ANALOG_KEYFRAME_ID, ANALOG_DELTA_ID or
+     * DIGITAL_PINS_ID), zero(0) if more input is needed, otherwise a
+     * negative error code (EINVAL for malformed or unknown records).
+     * @return identity code, zero or negative error code.
+     */
+    int read();
+
+    /**
+     * Return stream configuration.
+     * @return configuration.
+     */
+    const stream_t& config() const
+    {
+      return (m_config);
+    }
+
+    /**
+     * Return number of analog pins in stream.
+     * @return channels.
+     */
+    uint8_t channels() const
+    {
+      return (m_count);
+    }
+
+    /**
+     * Return analog values for the analog pins in the stream
+     * configuration (in channel order).
+     * @return values.
+     */
+    const uint16_t* values() const
+    {
+      return (m_value);
+    }
+
+    /**
+     * Return digital pins.
+     * @return digital pins.
+     */
+    uint32_t digital() const
+    {
+      return (m_digital);
+    }
+
+  protected:
+    Ciao::Decoder* m_in;		//!< Data stream decoder.
+    stream_t m_config;			//!< Stream configuration.
+    uint8_t m_count;			//!< Number of analog pins.
+    uint32_t m_digital;			//!< Digital pins.
+    uint16_t m_value[CHANNEL_MAX];	//!< Analog values.
+    uint8_t m_frame[FRAME_MAX];		//!< Delta frame.
+
+    /**
+     * Apply delta frame with given size to the analog values. The
+     * size must match the bit width and number of values. Returns
+     * zero(0) or negative error code (EINVAL).
+     * @param[in] size of frame in bytes.
+     * @return zero or negative error code.
+     */
+    int delta(uint16_t size);
+  };
+
   /**
    * Construct data streaming for given device.
    * @param[in] dev output device.
@@ -104,6 +345,12 @@ public:
    */
   void begin();
 
+  /**
+   * Read digital pins value.
+   * @return digital pins.
+   */
+  static uint32_t pins();
+
   /**
    * Write digital pins value to data stream.
    * @param[in] mask digital pins to write to data stream.
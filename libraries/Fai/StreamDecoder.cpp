@@ -0,0 +1,124 @@
+/**
+ * @file StreamDecoder.cpp
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#include "Fai.hh"
+
+int
+Fai::StreamDecoder::read()
+{
+  int res;
+  while ((res = m_in->next()) > 0) {
+    // Skip values, strings and descriptors other than user data
+    uint8_t type = m_in->type();
+    if (((type != USER8_TYPE) && (type != USER16_TYPE)) || m_in->is_member())
+      continue;
+
+    // Bind stream records to the decoder state; skip other records
+    uint16_t id = m_in->id();
+    if (res == Ciao::Decoder::TAG_EVENT) {
+      switch (id) {
+      case Descriptor::STREAM_ID:
+	m_in->bind(&Descriptor::stream_t, &m_config, 1);
+	break;
+      case Descriptor::ANALOG_KEYFRAME_ID:
+	// Check the number of values before the current state is changed
+	if (UNLIKELY(m_in->count() != m_count)) return (EINVAL);
+	m_in->bind(&Descriptor::analog_keyframe_t, m_value, CHANNEL_MAX);
+	break;
+      case Descriptor::ANALOG_DELTA_ID:
+	m_in->bind(&Descriptor::analog_delta_t, m_frame, FRAME_MAX);
+	break;
+      case Descriptor::DIGITAL_PINS_ID:
+	m_in->bind(&Descriptor::digital_pins_t, &m_digital, 1);
+	break;
+      case Ciao::Descriptor::HEADER_ID:
+	m_in->bind(&Ciao::Descriptor::header_t, NULL, 0);
+	break;
+      case Descriptor::ANALOG_PIN_ID:
+	m_in->bind(&Descriptor::analog_pin_t, NULL, 0);
+	break;
+      case Descriptor::DIGITAL_PIN_ID:
+	m_in->bind(&Descriptor::digital_pin_t, NULL, 0);
+	break;
+      case Descriptor::EVENT_ID:
+	m_in->bind(&Descriptor::event_t, NULL, 0);
+	break;
+      case Descriptor::SAMPLE_REQUEST_ID:
+	m_in->bind(&Descriptor::sample_request_t, NULL, 0);
+	break;
+      case Descriptor::SET_MODE_ID:
+	m_in->bind(&Descriptor::set_mode_t, NULL, 0);
+	break;
+      case Descriptor::STREAM_REQUEST_ID:
+	m_in->bind(&Descriptor::stream_request_t, NULL, 0);
+	break;
+      default:
+	return (EINVAL);
+      }
+      continue;
+    }
+
+    // Update decoder state with the stream record
+    switch (id) {
+    case Descriptor::STREAM_ID:
+      m_count = 0;
+      for (uint16_t pins = m_config.pins; pins != 0; pins >>= 1)
+	if (pins & 1) m_count += 1;
+      if (UNLIKELY(m_count > CHANNEL_MAX)) return (EINVAL);
+      return (id);
+    case Descriptor::ANALOG_KEYFRAME_ID:
+      return (id);
+    case Descriptor::ANALOG_DELTA_ID:
+      res = delta(m_in->count());
+      if (UNLIKELY(res < 0)) return (res);
+      return (id);
+    case Descriptor::DIGITAL_PINS_ID:
+      return (id);
+    }
+  }
+  return (res);
+}
+
+int
+Fai::StreamDecoder::delta(uint16_t size)
+{
+  if (UNLIKELY((size == 0) || (size > FRAME_MAX))) return (EINVAL);
+  uint8_t width = m_frame[0];
+  if (UNLIKELY(width > WIDTH_MAX)) return (EINVAL);
+  if (UNLIKELY(size != 1 + (m_count * width + 7) / 8)) return (EINVAL);
+
+  // Unpack the zig-zag encoded deltas and update the values
+  uint16_t mask = (1 << width) - 1;
+  uint32_t acc = 0L;
+  uint8_t n = 0;
+  uint8_t ix = 1;
+  for (uint8_t i = 0; i < m_count; i++) {
+    while (n < width) {
+      if (UNLIKELY(ix == size)) return (EINVAL);
+      acc |= (uint32_t) m_frame[ix++] << n;
+      n += 8;
+    }
+    uint16_t zz = acc & mask;
+    acc >>= width;
+    n -= width;
+    m_value[i] += (zz >> 1) ^ -(zz & 1);
+  }
+  return (0);
+}
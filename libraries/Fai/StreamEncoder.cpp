@@ -0,0 +1,128 @@
+/**
+ * @file StreamEncoder.cpp
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#include "Fai.hh"
+
+void
+Fai::StreamEncoder::begin(uint16_t pins,
+			  uint32_t digital,
+			  uint16_t period,
+			  uint8_t keyframe)
+{
+  m_config.pins = pins;
+  m_config.digital = digital;
+  m_config.period = period;
+  m_config.keyframe = keyframe;
+  m_count = 0;
+  for (; pins != 0; pins >>= 1)
+    if (pins & 1) m_count += 1;
+  m_frame = 0;
+  m_sync = false;
+  m_digital_sync = false;
+
+  // Write stream descriptors and configuration
+  m_fai->Ciao::write(&Descriptor::stream_t);
+  m_fai->Ciao::write(&Descriptor::analog_keyframe_t);
+  m_fai->Ciao::write(&Descriptor::analog_delta_t);
+  m_fai->Ciao::write(&Descriptor::stream_t, &m_config, 1);
+}
+
+void
+Fai::StreamEncoder::analog(const uint16_t* values)
+{
+  if (!m_sync) {
+    keyframe(values);
+    return;
+  }
+
+  // Bit width of the zig-zag encoded deltas
+  uint16_t bits = 0;
+  for (uint8_t i = 0; i < m_count; i++) {
+    int16_t delta = values[i] - m_value[i];
+    bits |= ((uint16_t) delta << 1) ^ (uint16_t) (delta >> 15);
+  }
+  uint8_t width = 0;
+  for (; bits != 0; bits >>= 1) width += 1;
+  if (width > WIDTH_MAX) {
+    keyframe(values);
+    return;
+  }
+
+  // Bit-pack the deltas, least significant bit first
+  uint8_t frame[FRAME_MAX];
+  uint8_t size = 0;
+  uint32_t acc = 0L;
+  uint8_t n = 0;
+  frame[size++] = width;
+  for (uint8_t i = 0; i < m_count; i++) {
+    int16_t delta = values[i] - m_value[i];
+    uint16_t zz = ((uint16_t) delta << 1) ^ (uint16_t) (delta >> 15);
+    acc |= (uint32_t) zz << n;
+    n += width;
+    while (n >= 8) {
+      frame[size++] = acc;
+      acc >>= 8;
+      n -= 8;
+    }
+    m_value[i] = values[i];
+  }
+  if (n != 0) frame[size++] = acc;
+  m_fai->Ciao::write(&Descriptor::analog_delta_t, frame, size);
+
+  // Check for keyframe interval
+  m_frame += 1;
+  if ((m_config.keyframe != 0) && (m_frame >= m_config.keyframe))
+    m_sync = false;
+}
+
+void
+Fai::StreamEncoder::keyframe(const uint16_t* values)
+{
+  memcpy(m_value, values, m_count * sizeof(uint16_t));
+  m_fai->Ciao::write(&Descriptor::analog_keyframe_t, m_value, m_count);
+  m_frame = 0;
+  m_sync = true;
+  m_digital_sync = false;
+}
+
+void
+Fai::StreamEncoder::digital(uint32_t values)
+{
+  if (m_config.digital == 0L) return;
+  values &= m_config.digital;
+  if (m_digital_sync && (values == m_digital)) return;
+  digital_pins_t dgl;
+  dgl.values = values;
+  m_fai->Ciao::write(&Descriptor::digital_pins_t, &dgl, 1);
+  m_digital = values;
+  m_digital_sync = true;
+}
+
+void
+Fai::StreamEncoder::sample()
+{
+  uint16_t values[CHANNEL_MAX];
+  uint8_t ix = 0;
+  uint16_t mask = m_config.pins;
+  for (uint8_t pin = 0; mask != 0; pin++, mask >>= 1)
+    if (mask & 1) values[ix++] = AnalogPin::sample((Board::AnalogPin) pin);
+  if (m_count != 0) analog(values);
+  digital(pins());
+}
@@ -0,0 +1,90 @@
+/**
+ * @file CosaFaiStream.ino
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * @section Description
+ * Demonstration of Cosa Fai delta compressed sample streaming. The
+ * analog pins A0..A5 are sampled at 100 Hz and streamed as keyframes
+ * and delta frames. The digital pins D2..D7 are streamed when
+ * changed. The binary stream is written to the serial port. A host
+ * program may send a stream request (Fai::stream_request_t) to
+ * change the stream configuration.
+ *
+ * @section Circuit
+ * This example requires no special circuit. Uses serial output,
+ * samples analog pins A0..A5 and digital pins D2..D7.
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#include <Ciao.h>
+#include <Fai.h>
+
+#include "Cosa/AnalogPin.hh"
+#include "Cosa/Periodic.hh"
+#include "Cosa/RTT.hh"
+#include "Cosa/UART.hh"
+
+// Fai::Ciao data stream over the UART
+Fai cout(&uart);
+Ciao::Decoder cin(&uart);
+
+// Delta compressed sample stream encoder
+Fai::StreamEncoder stream(&cout);
+
+// Stream configuration; A0..A5, D2..D7, 10 ms period, keyframe every 100
+static const uint16_t PINS = 0x003f;
+static const uint32_t DIGITAL = 0x000000fcL;
+static const uint16_t PERIOD = 10;
+static const uint8_t KEYFRAME = 100;
+
+void setup()
+{
+  uart.begin(57600);
+  RTT::begin();
+  AnalogPin::powerup();
+  cout.begin();
+  stream.begin(PINS, DIGITAL, PERIOD, KEYFRAME);
+}
+
+void loop()
+{
+  // Check for stream request from host; restart the stream. Other
+  // user data types cannot be skipped; reset the decoder
+  static Fai::stream_request_t request;
+  int event = cin.next();
+  if (event == Ciao::Decoder::TAG_EVENT) {
+    if (cin.type() == Ciao::USER8_TYPE) {
+      if (cin.id() == Fai::Descriptor::STREAM_REQUEST_ID)
+	cin.bind(&Fai::Descriptor::stream_request_t, &request, 1);
+      else
+	cin.reset();
+    }
+  }
+  else if (event == Ciao::Decoder::VALUE_EVENT) {
+    if ((cin.type() == Ciao::USER8_TYPE)
+	&& (cin.id() == Fai::Descriptor::STREAM_REQUEST_ID))
+      stream.begin(request);
+  }
+  else if (event < 0) {
+    cin.reset();
+  }
+
+  // Sample and stream with the configured period
+  periodic(timer, stream.config().period) {
+    stream.sample();
+  }
+}
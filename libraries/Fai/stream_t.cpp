@@ -0,0 +1,67 @@
+/**
+ * @file stream_t.cpp
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#include "Fai.hh"
+
+#if defined(NREFLECTION)
+#define descr_name 0
+#define pins_name 0
+#define digital_name 0
+#define period_name 0
+#define keyframe_name 0
+#else
+static const char descr_name[] __PROGMEM = "Cosa::Fai::stream_t";
+static const char pins_name[] __PROGMEM = "pins";
+static const char digital_name[] __PROGMEM = "digital";
+static const char period_name[] __PROGMEM = "period";
+static const char keyframe_name[] __PROGMEM = "keyframe";
+#endif
+static const Ciao::Descriptor::member_t descr_members[] __PROGMEM = {
+  {
+    Ciao::UINT16_TYPE,
+    1,
+    pins_name,
+    0
+  },
+  {
+    Ciao::UINT32_TYPE,
+    1,
+    digital_name,
+    0
+  },
+  {
+    Ciao::UINT16_TYPE,
+    1,
+    period_name,
+    0
+  },
+  {
+    Ciao::UINT8_TYPE,
+    1,
+    keyframe_name,
+    0
+  }
+};
+const Ciao::Descriptor::user_t Fai::Descriptor::stream_t __PROGMEM = {
+  Fai::Descriptor::STREAM_ID,
+  descr_name,
+  descr_members,
+  membersof(descr_members)
+};
@@ -0,0 +1,553 @@
+/**
+ * @file FlashKV.cpp
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#include "FlashKV.hh"
+#include "Cosa/CRC.hh"
+
+/**
+ * Return true if the given buffer is erased (all bytes 0xff)
+ * otherwise false.
+ * @param[in] buf buffer to check.
+ * @param[in] size of buffer.
+ * @return bool.
+ */
+static bool
+is_erased(const void* buf, size_t size)
+{
+  const uint8_t* bp = (const uint8_t*) buf;
+  while (size--) if (*bp++ != 0xff) return (false);
+  return (true);
+}
+
+/**
+ * Return updated CRC-16 (CCITT) with the given buffer.
+ * @param[in] crc current checksum.
+ * @param[in] buf buffer.
+ * @param[in] size of buffer.
+ * @return checksum.
+ */
+static uint16_t
+crc16(uint16_t crc, const void* buf, size_t size)
+{
+  return (CRC::CCITT::update(crc, buf, size));
+}
+
+/**
+ * Return home slot of given key in index with given number of
+ * entries.
+ * @param[in] key identity.
+ * @param[in] max number of entries.
+ * @return slot.
+ */
+static inline uint16_t
+hash(uint16_t key, uint16_t max)
+{
+  return (((uint16_t) (key * 0x9e37U)) % max);
+}
+
+bool
+FlashKV::begin()
+{
+  // Check the configuration; locations are 16-bit
+  const uint16_t UNITS = segment_units();
+  if (UNLIKELY(m_segments < RESERVE + 2)) return (false);
+  if (UNLIKELY((uint32_t) m_segments * UNITS > 0x10000L)) return (false);
+  clear();
+
+  // Find the oldest and newest segment
+  segment_t header;
+  uint16_t tail = 0;
+  uint32_t min = 0L;
+  m_used = 0;
+  m_seq = 0L;
+  for (uint16_t segment = 0; segment < m_segments; segment++) {
+    if (m_device->read(&header, loc_addr(segment * UNITS), sizeof(header))
+	!= sizeof(header))
+      return (false);
+    if (header.magic != SEGMENT_MAGIC) continue;
+    if ((m_used == 0) || (header.seq < min)) {
+      min = header.seq;
+      tail = segment;
+    }
+    if ((m_used == 0) || (header.seq > m_seq)) {
+      m_seq = header.seq;
+      m_head = segment;
+    }
+    m_used += 1;
+  }
+
+  // Load the checkpoint; valid if the head segment is still in the log
+  uint16_t segment = tail;
+  uint16_t unit = 1;
+  uint16_t head;
+  int res = restore(head, unit);
+
+  // Empty store; the first segment is opened on write
+  if (m_used == 0) {
+    clear();
+    m_head = m_segments - 1;
+    m_unit = UNITS;
+    return (true);
+  }
+  m_used = ((m_head + m_segments - tail) % m_segments) + 1;
+  if (res == 0) {
+    if ((m_device->read(&header, loc_addr(head * UNITS), sizeof(header))
+	 == sizeof(header))
+	&& (header.magic == SEGMENT_MAGIC)
+	&& (header.seq == m_checkpoint_seq))
+      segment = head;
+    else {
+      clear();
+      unit = 1;
+    }
+  }
+
+  // Replay the log from the checkpoint or the oldest segment
+  while (1) {
+    if (m_device->read(&header, loc_addr(segment * UNITS), sizeof(header))
+	!= sizeof(header))
+      return (false);
+    if (header.magic == SEGMENT_MAGIC) {
+      int32_t end = replay(segment, unit);
+      if (end < 0) return (false);
+      m_unit = end;
+    }
+    else m_unit = UNITS;
+    if (segment == m_head) break;
+    segment = (segment + 1) % m_segments;
+    unit = 1;
+  }
+  return (true);
+}
+
+int
+FlashKV::get(uint16_t key, void* buf, size_t size)
+{
+  // Lookup the record location
+  index_t* entry = &m_index[lookup(key)];
+  if (entry->key == NO_KEY) return (ENOENT);
+
+  // Read record header and value
+  header_t header;
+  uint32_t addr = loc_addr(entry->loc);
+  if (m_device->read(&header, addr, sizeof(header)) != sizeof(header))
+    return (EIO);
+  if (size > header.size) size = header.size;
+  if (m_device->read(buf, addr + sizeof(header), size) != (int) size)
+    return (EIO);
+  return (header.size);
+}
+
+int
+FlashKV::put(uint16_t key, const void* buf, size_t size)
+{
+  if (UNLIKELY(key == NO_KEY || size == 0 || size > VALUE_MAX))
+    return (EINVAL);
+
+  // Check that there is an index entry for a new key
+  if ((m_index[lookup(key)].key == NO_KEY) && (m_count >= m_index_max - 1))
+    return (ENOSPC);
+
+  // Append the record and update the index
+  int res = reserve(record_units(size));
+  if (res < 0) return (res);
+  int32_t loc = append(key, buf, size, 0L);
+  if (loc < 0) return (loc);
+  set(key, loc);
+  return (size);
+}
+
+int
+FlashKV::remove(uint16_t key)
+{
+  if (m_index[lookup(key)].key == NO_KEY) return (ENOENT);
+
+  // Append a tombstone and remove the key from the index
+  int res = reserve(record_units(0));
+  if (res < 0) return (res);
+  int32_t loc = append(key, NULL, 0, 0L);
+  if (loc < 0) return (loc);
+  erase(lookup(key));
+  return (0);
+}
+
+int
+FlashKV::checkpoint()
+{
+  if (!m_checkpoint) return (ENOSYS);
+  if (UNIT + (uint32_t) m_count * sizeof(index_t) > m_device->SECTOR_BYTES)
+    return (E2BIG);
+
+  // Erase the oldest checkpoint sector
+  uint32_t addr = checkpoint_addr(m_checkpoint_next);
+  if (m_device->erase(addr, m_device->SECTOR_BYTES / 1024) != 0)
+    return (EIO);
+
+  // Write the index entries in blocks
+  const uint8_t BUF_MAX = 8;
+  index_t buf[BUF_MAX];
+  uint32_t dest = addr + UNIT;
+  uint16_t crc = 0;
+  uint8_t n = 0;
+  for (uint16_t slot = 0; slot < m_index_max; slot++) {
+    if (m_index[slot].key != NO_KEY) buf[n++] = m_index[slot];
+    if ((n < BUF_MAX) && (slot < m_index_max - 1)) continue;
+    if (n == 0) continue;
+    size_t size = n * sizeof(index_t);
+    if (m_device->write(dest, buf, size) != (int) size) return (EIO);
+    crc = crc16(crc, buf, size);
+    dest += size;
+    n = 0;
+  }
+
+  // Write the header last; commits the checkpoint
+  checkpoint_t header;
+  header.magic = CHECKPOINT_MAGIC;
+  header.count = m_count;
+  header.seq = m_seq;
+  header.head = m_head;
+  header.unit = m_unit;
+  header.crc = crc16(crc, &header, offsetof(checkpoint_t, crc));
+  if (m_device->write(addr, &header, sizeof(header)) != sizeof(header))
+    return (EIO);
+  m_checkpoint_seq = m_seq;
+  m_checkpoint_next ^= 1;
+  return (0);
+}
+
+int
+FlashKV::collect()
+{
+  // Check that free segments are low and there is an older segment
+  if ((m_used < 2) || (m_segments - m_used > RESERVE + 1)) return (0);
+
+  // Check that the oldest segment holds deleted or replaced records
+  const uint16_t UNITS = segment_units();
+  uint16_t base = tail() * UNITS;
+  uint16_t unit = 1;
+  while (unit < UNITS) {
+    header_t header;
+    if (m_device->read(&header, loc_addr(base + unit), sizeof(header))
+	!= sizeof(header))
+      return (EIO);
+    if (is_erased(&header, sizeof(header))) break;
+    if (!is_live(&header, base + unit)) {
+      int res = compact();
+      return (res < 0 ? res : 1);
+    }
+    unit += record_units(header.size);
+  }
+  return (0);
+}
+
+uint16_t
+FlashKV::lookup(uint16_t key) const
+{
+  uint16_t slot = hash(key, m_index_max);
+  while ((m_index[slot].key != NO_KEY) && (m_index[slot].key != key))
+    if (++slot == m_index_max) slot = 0;
+  return (slot);
+}
+
+bool
+FlashKV::set(uint16_t key, uint16_t loc)
+{
+  index_t* entry = &m_index[lookup(key)];
+  if (entry->key == NO_KEY) {
+    if (m_count >= m_index_max - 1) return (false);
+    entry->key = key;
+    m_count += 1;
+  }
+  entry->loc = loc;
+  return (true);
+}
+
+void
+FlashKV::erase(uint16_t slot)
+{
+  // Move back entries in the probe sequence that would not be found
+  uint16_t free = slot;
+  while (1) {
+    if (++slot == m_index_max) slot = 0;
+    if (m_index[slot].key == NO_KEY) break;
+    uint16_t home = hash(m_index[slot].key, m_index_max);
+    if ((free <= slot)
+	? ((free < home) && (home <= slot))
+	: ((free < home) || (home <= slot)))
+      continue;
+    m_index[free] = m_index[slot];
+    free = slot;
+  }
+  m_index[free].key = NO_KEY;
+  m_count -= 1;
+}
+
+int
+FlashKV::checksum(const header_t* header, const void* buf, uint32_t addr,
+		  uint16_t& crc)
+{
+  crc = crc16(0, header, offsetof(header_t, crc));
+  if (buf != NULL) {
+    crc = crc16(crc, buf, header->size);
+    return (0);
+  }
+
+  // Read value from flash in blocks
+  uint8_t block[UNIT];
+  for (uint8_t size = header->size; size != 0;) {
+    uint8_t n = (size > sizeof(block)) ? sizeof(block) : size;
+    if (m_device->read(block, addr, n) != n) return (EIO);
+    crc = crc16(crc, block, n);
+    addr += n;
+    size -= n;
+  }
+  return (0);
+}
+
+int
+FlashKV::is_clean(uint32_t addr)
+{
+  uint8_t block[UNIT * 2];
+  for (uint32_t offset = 0; offset < m_device->SECTOR_BYTES;
+       offset += sizeof(block)) {
+    if (m_device->read(block, addr + offset, sizeof(block))
+	!= sizeof(block))
+      return (EIO);
+    if (!is_erased(block, sizeof(block))) return (0);
+  }
+  return (1);
+}
+
+int32_t
+FlashKV::allocate(uint8_t units)
+{
+  // Open the next segment when the head is full
+  const uint16_t UNITS = segment_units();
+  if (m_unit + units > UNITS) {
+    if (m_used == m_segments) return (ENOSPC);
+    uint16_t segment = (m_head + 1) % m_segments;
+    uint32_t addr = loc_addr(segment * UNITS);
+    // An interrupted erase may leave records after an erased header
+    int res = is_clean(addr);
+    if (res < 0) return (res);
+    if ((res == 0)
+	&& (m_device->erase(addr, m_device->SECTOR_BYTES / 1024) != 0))
+      return (EIO);
+    segment_t header;
+    // Write the sequence number and then the magic; commits the segment
+    header.magic = SEGMENT_MAGIC;
+    header.seq = m_seq + 1;
+    if ((m_device->write(addr + offsetof(segment_t, seq),
+			 &header.seq, sizeof(header.seq))
+	 != sizeof(header.seq))
+	|| (m_device->write(addr, &header.magic, sizeof(header.magic))
+	    != sizeof(header.magic)))
+      return (EIO);
+    m_seq = header.seq;
+    m_head = segment;
+    m_used += 1;
+    m_unit = 1;
+  }
+
+  // Allocate units in the head segment
+  uint16_t loc = m_head * UNITS + m_unit;
+  m_unit += units;
+  return (loc);
+}
+
+int32_t
+FlashKV::append(uint16_t key, const void* buf, uint8_t size, uint32_t addr)
+{
+  // Build record header with checksum
+  header_t header;
+  header.key = key;
+  header.size = size;
+  int res = checksum(&header, buf, addr, header.crc);
+  if (res < 0) return (res);
+
+  // Allocate and write header and value
+  int32_t loc = allocate(record_units(size));
+  if (loc < 0) return (loc);
+  uint32_t dest = loc_addr(loc);
+  if (m_device->write(dest, &header, sizeof(header)) != sizeof(header))
+    return (EIO);
+  dest += sizeof(header);
+  if (buf != NULL) {
+    if (m_device->write(dest, buf, size) != size) return (EIO);
+    return (loc);
+  }
+
+  // Copy value from flash in blocks
+  uint8_t block[UNIT * 2];
+  while (size != 0) {
+    uint8_t n = (size > sizeof(block)) ? sizeof(block) : size;
+    if (m_device->read(block, addr, n) != n) return (EIO);
+    if (m_device->write(dest, block, n) != n) return (EIO);
+    addr += n;
+    dest += n;
+    size -= n;
+  }
+  return (loc);
+}
+
+int
+FlashKV::reserve(uint8_t units)
+{
+  // Check if the record fits in the head segment. The reserve segment
+  // may be in use after an interrupted compaction; restore it first
+  if ((m_unit + units <= segment_units())
+      && (m_segments - m_used >= RESERVE))
+    return (0);
+
+  // Compact oldest segments until there is a free segment in addition
+  // to the reserve; give up after a full turn
+  for (uint16_t i = 0; m_segments - m_used <= RESERVE; i++) {
+    if (i == m_segments) return (ENOSPC);
+    int res = compact();
+    if (res < 0) return (res);
+  }
+  return (0);
+}
+
+int
+FlashKV::compact()
+{
+  if (m_used < 2) return (ENOSPC);
+
+  // Copy live records in the oldest segment to the head
+  const uint16_t UNITS = segment_units();
+  uint16_t segment = tail();
+  uint16_t base = segment * UNITS;
+  uint16_t unit = 1;
+  while (unit < UNITS) {
+    header_t header;
+    uint16_t loc = base + unit;
+    uint32_t addr = loc_addr(loc);
+    if (m_device->read(&header, addr, sizeof(header)) != sizeof(header))
+      return (EIO);
+    if (is_erased(&header, sizeof(header))) break;
+    if (is_live(&header, loc)) {
+      int32_t res = append(header.key, NULL, header.size,
+			   addr + sizeof(header));
+      if (res < 0) return (res);
+      m_index[lookup(header.key)].loc = res;
+    }
+    unit += record_units(header.size);
+  }
+
+  // Erase the segment
+  if (m_device->erase(loc_addr(base), m_device->SECTOR_BYTES / 1024) != 0)
+    return (EIO);
+  m_used -= 1;
+  return (0);
+}
+
+int32_t
+FlashKV::replay(uint16_t segment, uint16_t unit)
+{
+  const uint16_t UNITS = segment_units();
+  uint16_t base = segment * UNITS;
+  while (unit < UNITS) {
+    // Read record header; erased header is the end of the segment
+    header_t header;
+    uint16_t loc = base + unit;
+    uint32_t addr = loc_addr(loc);
+    if (m_device->read(&header, addr, sizeof(header)) != sizeof(header))
+      return (EIO);
+    if (is_erased(&header, sizeof(header))) break;
+    uint8_t units = record_units(header.size);
+    if (unit + units > UNITS) return (UNITS);
+    unit += units;
+
+    // Skip torn records; update index with key value or tombstone
+    if ((header.key == NO_KEY) || (header.size > VALUE_MAX)) continue;
+    uint16_t crc;
+    int res = checksum(&header, NULL, addr + sizeof(header), crc);
+    if (res < 0) return (res);
+    if (crc != header.crc) continue;
+    if (header.size != 0) {
+      if (!set(header.key, loc)) return (ENOSPC);
+    }
+    else {
+      uint16_t slot = lookup(header.key);
+      if (m_index[slot].key != NO_KEY) erase(slot);
+    }
+  }
+  return (unit);
+}
+
+int
+FlashKV::restore(uint16_t& head, uint16_t& unit)
+{
+  if (!m_checkpoint) return (ENOENT);
+
+  // Read both checkpoint headers; try the latest first
+  checkpoint_t header[2];
+  bool valid[2];
+  for (uint8_t ix = 0; ix < 2; ix++) {
+    if (m_device->read(&header[ix], checkpoint_addr(ix), sizeof(checkpoint_t))
+	!= sizeof(checkpoint_t))
+      return (EIO);
+    valid[ix] = (header[ix].magic == CHECKPOINT_MAGIC)
+      && (header[ix].count < m_index_max)
+      && (header[ix].head < m_segments)
+      && (UNIT + (uint32_t) header[ix].count * sizeof(index_t)
+	  <= m_device->SECTOR_BYTES);
+  }
+  uint8_t ix = 0;
+  if (valid[1]
+      && (!valid[0]
+	  || (header[1].seq > header[0].seq)
+	  || ((header[1].seq == header[0].seq)
+	      && (header[1].unit > header[0].unit))))
+    ix = 1;
+  m_checkpoint_next = ix ^ 1;
+
+  for (uint8_t i = 0; i < 2; i++, ix ^= 1) {
+    if (!valid[ix]) continue;
+
+    // Load the index entries in blocks and verify the checksum
+    const uint8_t BUF_MAX = 8;
+    index_t buf[BUF_MAX];
+    uint32_t addr = checkpoint_addr(ix) + UNIT;
+    uint16_t crc = 0;
+    clear();
+    for (uint16_t count = header[ix].count; count != 0;) {
+      uint8_t n = (count > BUF_MAX) ? BUF_MAX : count;
+      size_t size = n * sizeof(index_t);
+      if (m_device->read(buf, addr, size) != (int) size) return (EIO);
+      crc = crc16(crc, buf, size);
+      for (uint8_t j = 0; j < n; j++) set(buf[j].key, buf[j].loc);
+      addr += size;
+      count -= n;
+    }
+    if (crc16(crc, &header[ix], offsetof(checkpoint_t, crc)) != header[ix].crc)
+      continue;
+
+    // Return the log position of the checkpoint
+    m_checkpoint_seq = header[ix].seq;
+    m_checkpoint_next = ix ^ 1;
+    head = header[ix].head;
+    unit = header[ix].unit;
+    return (0);
+  }
+  clear();
+  return (ENOENT);
+}
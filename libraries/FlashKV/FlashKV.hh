@@ -0,0 +1,493 @@
+/**
+ * @file FlashKV.hh
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#ifndef COSA_FLASHKV_HH
+#define COSA_FLASHKV_HH
+
+#include "Cosa/Types.h"
+#include "Cosa/Flash.hh"
+#include "Cosa/Periodic.hh"
+
+/**
+ * Log-structured key/value store on a Flash::Device (S25FL127S,
+ * W25X40CL). The store is a ring of segments, one flash sector each.
+ * Records (key, value) are appended to the head segment; a put()
+ * of an existing key appends a new record and a remove() appends a
+ * tombstone. The latest record of each key is found with a RAM hash
+ * index (key to record location) with constant time get() and put().
+ *
+ * Compaction copies the live records of the oldest segment (the tail)
+ * to the head and erases the segment. As segments are reused in ring
+ * order all sectors wear evenly. One free segment is kept in reserve
+ * for compaction. Compaction is performed by put() when the store is
+ * full, or incrementally in the background by collect() or a
+ * Collector job.
+ *
+ * On begin() the index is rebuilt by replaying the log from the tail.
+ * With checkpoints enabled two extra sectors after the log hold a
+ * copy of the index written by checkpoint(); only the records written
+ * after the latest checkpoint are replayed. Each record has a CRC-16
+ * checksum and records torn by power loss are skipped.
+ *
+ * @section Limitations
+ * Max 1 Mbyte log (64K units of 16 bytes) and value size VALUE_MAX.
+ * Key 0xffff is reserved. The index must hold more entries than keys.
+ */
+class FlashKV {
+public:
+  /** Max value size. */
+  static const uint8_t VALUE_MAX = 251;
+
+  /** Reserved key value. */
+  static const uint16_t NO_KEY = 0xffff;
+
+  /**
+   * Mount the store; load the latest checkpoint and replay the log to
+   * rebuild the index. Return true(1) if successful otherwise
+   * false(0).
+   * @return bool.
+   */
+  bool begin();
+
+  /**
+   * Read value of given key into the given buffer with given max
+   * size. Return value size or negative error code (ENOENT if the
+   * key has no value, EIO).
+   * @param[in] key identity.
+   * @param[in] buf buffer to read into.
+   * @param[in] size of buffer.
+   * @return size of value or negative error code.
+   */
+  int get(uint16_t key, void* buf, size_t size);
+
+  /**
+   * Write value of given key from given buffer with given size.
+   * Return size or negative error code (EINVAL if illegal key or
+   * size, ENOSPC if the store or index is full, EIO).
+   * @param[in] key identity.
+   * @param[in] buf buffer with value.
+   * @param[in] size of value.
+   * @return size or negative error code.
+   */
+  int put(uint16_t key, const void* buf, size_t size);
+
+  /**
+   * Template function to read value of given key and type.
+   * @param[in] key identity.
+   * @param[out] value variable.
+   * @return size of value or negative error code.
+   */
+  template<class T> int get(uint16_t key, T* value)
+  {
+    return (get(key, value, sizeof(T)));
+  }
+
+  /**
+   * Template function to write value of given key and type.
+   * @param[in] key identity.
+   * @param[in] value variable.
+   * @return size or negative error code.
+   */
+  template<class T> int put(uint16_t key, const T* value)
+  {
+    return (put(key, value, sizeof(T)));
+  }
+
+  /**
+   * Remove the given key. Return zero(0) if successful otherwise
+   * negative error code (ENOENT, ENOSPC, EIO).
+   * @param[in] key identity.
+   * @return zero or negative error code.
+   */
+  int remove(uint16_t key);
+
+  /**
+   * Write the index to the oldest checkpoint sector. Return zero(0)
+   * if successful otherwise negative error code (ENOSYS if
+   * checkpoints are not enabled, E2BIG if the index does not fit in
+   * a sector, EIO).
+   * @return zero or negative error code.
+   */
+  int checkpoint();
+
+  /**
+   * Perform one incremental compaction step when the number of free
+   * segments is low. Returns one(1) if a segment was compacted,
+   * zero(0) if there was nothing to do otherwise a negative error
+   * code (ENOSPC, EIO).
+   * @return one, zero or negative error code.
+   */
+  int collect();
+
+  /**
+   * Return number of keys in the store.
+   * @return keys.
+   */
+  uint16_t keys() const
+  {
+    return (m_count);
+  }
+
+  /**
+   * Return number of free segments.
+   * @return segments.
+   */
+  uint16_t available() const
+  {
+    return (m_segments - m_used);
+  }
+
+  /**
+   * Periodic job to run the compaction incrementally.
+   */
+  class Collector : public Periodic {
+  public:
+    /**
+     * Construct compaction job for the given store with given period
+     * in the scheduler time base.
+     * @param[in] scheduler for the periodic job.
+     * @param[in] kv key/value store.
+     * @param[in] period between compaction steps.
+     */
+    Collector(Job::Scheduler* scheduler, FlashKV* kv, uint32_t period) :
+      Periodic(scheduler, period),
+      m_kv(kv)
+    {}
+
+    /**
+     * @override{Periodic}
+     * Perform a compaction step.
+     */
+    virtual void run()
+    {
+      m_kv->collect();
+    }
+
+  protected:
+    FlashKV* m_kv;
+  };
+
+protected:
+  /** Record alignment and location unit in bytes. */
+  static const uint8_t UNIT = 16;
+
+  /** Number of free segments reserved for compaction. */
+  static const uint8_t RESERVE = 1;
+
+  /** Segment and checkpoint magic. */
+  static const uint16_t SEGMENT_MAGIC = 0xc0a5;
+  static const uint16_t CHECKPOINT_MAGIC = 0xc0a6;
+
+  /**
+   * Index entry; key and record location (in units from the start of
+   * the log). Free entries have key NO_KEY.
+   */
+  struct index_t {
+    uint16_t key;		//!< Key identity.
+    uint16_t loc;		//!< Record location.
+  };
+
+  /**
+   * Segment header in the first unit of the sector. The sequence
+   * number is incremented for each new segment.
+   */
+  struct segment_t {
+    uint16_t magic;		//!< Segment magic.
+    uint32_t seq;		//!< Segment sequence number.
+  };
+
+  /**
+   * Record header. Followed by the value. Checksum is CRC-16 over key,
+   * size and value. Size zero(0) is a tombstone.
+   */
+  struct header_t {
+    uint16_t key;		//!< Key identity.
+    uint8_t size;		//!< Value size.
+    uint16_t crc;		//!< Checksum.
+  };
+
+  /**
+   * Checkpoint header in the first unit of a checkpoint sector.
+   * Followed by the index entries. The header is written last.
+   * Checksum is CRC-16 over the entries and header fields.
+   */
+  struct checkpoint_t {
+    uint16_t magic;		//!< Checkpoint magic.
+    uint16_t count;		//!< Number of index entries.
+    uint32_t seq;		//!< Sequence number of head segment.
+    uint16_t head;		//!< Head segment.
+    uint16_t unit;		//!< Next free unit in head segment.
+    uint16_t crc;		//!< Checksum.
+  };
+
+  /**
+   * Construct key/value store on given device, sectors and index
+   * storage. Used by sub-class with index storage.
+   * @param[in] device flash device.
+   * @param[in] addr start address of store (sector aligned).
+   * @param[in] segments number of log segments (sectors).
+   * @param[in] checkpoint enable checkpoint sectors after the log.
+   * @param[in] index index entry vector.
+   * @param[in] index_max number of index entries.
+   */
+  FlashKV(Flash::Device* device, uint32_t addr, uint16_t segments,
+	  bool checkpoint, index_t* index, uint16_t index_max) :
+    m_device(device),
+    m_addr(addr),
+    m_segments(segments),
+    m_checkpoint(checkpoint),
+    m_index(index),
+    m_index_max(index_max),
+    m_count(0),
+    m_head(0),
+    m_unit(0),
+    m_used(0),
+    m_seq(0L),
+    m_checkpoint_seq(0L),
+    m_checkpoint_next(0)
+  {}
+
+  /** Flash device. */
+  Flash::Device* const m_device;
+
+  /** Start address, number of segments and checkpoint enable. */
+  const uint32_t m_addr;
+  const uint16_t m_segments;
+  const bool m_checkpoint;
+
+  /** Hash index and number of keys. */
+  index_t* const m_index;
+  const uint16_t m_index_max;
+  uint16_t m_count;
+
+  /** Head segment, next free unit in head and number of segments used. */
+  uint16_t m_head;
+  uint16_t m_unit;
+  uint16_t m_used;
+
+  /** Sequence number of head segment. */
+  uint32_t m_seq;
+
+  /** Latest checkpoint sequence number and next checkpoint sector. */
+  uint32_t m_checkpoint_seq;
+  uint8_t m_checkpoint_next;
+
+  /**
+   * Return number of units in a segment.
+   * @return units.
+   */
+  uint16_t segment_units() const
+  {
+    return (m_device->SECTOR_BYTES / UNIT);
+  }
+
+  /**
+   * Return flash address of given location.
+   * @param[in] loc record location.
+   * @return address.
+   */
+  uint32_t loc_addr(uint16_t loc) const
+  {
+    return (m_addr + (uint32_t) loc * UNIT);
+  }
+
+  /**
+   * Return number of units of record with given value size.
+   * @param[in] size of value.
+   * @return units.
+   */
+  static uint8_t record_units(uint8_t size)
+  {
+    return ((sizeof(header_t) + size + UNIT - 1) / UNIT);
+  }
+
+  /**
+   * Return index of the oldest segment.
+   * @return segment.
+   */
+  uint16_t tail() const
+  {
+    return ((m_head + m_segments - m_used + 1) % m_segments);
+  }
+
+  /**
+   * Return flash address of given checkpoint sector.
+   * @param[in] ix checkpoint sector index (0..1).
+   * @return address.
+   */
+  uint32_t checkpoint_addr(uint8_t ix) const
+  {
+    return (m_addr + (uint32_t) (m_segments + ix) * m_device->SECTOR_BYTES);
+  }
+
+  /**
+   * Remove all entries in the index.
+   */
+  void clear()
+  {
+    memset(m_index, 0xff, m_index_max * sizeof(index_t));
+    m_count = 0;
+  }
+
+  /**
+   * Return slot in index with given key or free slot if not found.
+   * @param[in] key identity.
+   * @return slot.
+   */
+  uint16_t lookup(uint16_t key) const;
+
+  /**
+   * Set location of given key in index. Return true(1) if successful
+   * otherwise false(0) if the index is full.
+   * @param[in] key identity.
+   * @param[in] loc record location.
+   * @return bool.
+   */
+  bool set(uint16_t key, uint16_t loc);
+
+  /**
+   * Return true(1) if the record with the given header and location
+   * is the latest value of the key otherwise false(0).
+   * @param[in] header record header.
+   * @param[in] loc record location.
+   * @return bool.
+   */
+  bool is_live(const header_t* header, uint16_t loc) const
+  {
+    if ((header->key == NO_KEY) || (header->size == 0)) return (false);
+    const index_t* entry = &m_index[lookup(header->key)];
+    return ((entry->key == header->key) && (entry->loc == loc));
+  }
+
+  /**
+   * Remove entry in given index slot; following entries in the probe
+   * sequence are moved back.
+   * @param[in] slot index.
+   */
+  void erase(uint16_t slot);
+
+  /**
+   * Calculate checksum of record with the given header. The value is
+   * read from the given buffer, or from flash at given address if
+   * NULL. Return zero(0) if successful otherwise negative error code
+   * (EIO).
+   * @param[in] header record header.
+   * @param[in] buf value buffer or NULL.
+   * @param[in] addr value address in flash.
+   * @param[out] crc checksum.
+   * @return zero or negative error code.
+   */
+  int checksum(const header_t* header, const void* buf, uint32_t addr,
+	       uint16_t& crc);
+
+  /**
+   * Check that the sector with the given address is erased. Return
+   * one(1) if erased, zero(0) if not, otherwise a negative error code
+   * (EIO).
+   * @param[in] addr sector address.
+   * @return one, zero or negative error code.
+   */
+  int is_clean(uint32_t addr);
+
+  /**
+   * Allocate given number of units at the head; open the next segment
+   * if needed. The segment sector is erased unless clean. Return
+   * location or negative error code (ENOSPC if all segments are used,
+   * EIO).
+   * @param[in] units number of units.
+   * @return location or negative error code.
+   */
+  int32_t allocate(uint8_t units);
+
+  /**
+   * Append record with given key and value. The value is copied from
+   * the buffer, or from flash at given address if NULL. Return
+   * location or negative error code.
+   * @param[in] key identity.
+   * @param[in] buf value buffer or NULL.
+   * @param[in] size of value.
+   * @param[in] addr value address in flash.
+   * @return location or negative error code.
+   */
+  int32_t append(uint16_t key, const void* buf, uint8_t size, uint32_t addr);
+
+  /**
+   * Ensure there is room at the head for the given number of units;
+   * compact while only the reserve is left. Return zero(0) if
+   * successful otherwise negative error code (ENOSPC, EIO).
+   * @param[in] units number of units.
+   * @return zero or negative error code.
+   */
+  int reserve(uint8_t units);
+
+  /**
+   * Copy the live records of the oldest segment to the head and erase
+   * it. Tombstones are dropped. Return zero(0) if successful otherwise
+   * negative error code (ENOSPC, EIO).
+   * @return zero or negative error code.
+   */
+  int compact();
+
+  /**
+   * Replay the records of given segment from given unit and update
+   * the index. Return the unit after the last record or negative
+   * error code (EIO).
+   * @param[in] segment index.
+   * @param[in] unit first unit to replay.
+   * @return unit or negative error code.
+   */
+  int32_t replay(uint16_t segment, uint16_t unit);
+
+  /**
+   * Load the latest valid checkpoint into the index. Return zero(0)
+   * and the head segment and unit of the checkpoint if successful
+   * otherwise negative error code (ENOENT).
+   * @param[out] head segment.
+   * @param[out] unit next free unit in segment.
+   * @return zero or negative error code.
+   */
+  int restore(uint16_t& head, uint16_t& unit);
+};
+
+/**
+ * Key/value store with index storage for given number of entries.
+ * @param[in] INDEX_MAX number of index entries (max keys + 1).
+ */
+template<uint16_t INDEX_MAX>
+class FlashKVStore : public FlashKV {
+  static_assert(INDEX_MAX > 1, "INDEX_MAX too small");
+public:
+  /**
+   * Construct key/value store on given device and sectors.
+   * @param[in] device flash device.
+   * @param[in] addr start address of store (sector aligned).
+   * @param[in] segments number of log segments (sectors).
+   * @param[in] checkpoint enable checkpoint sectors (default false).
+   */
+  FlashKVStore(Flash::Device* device, uint32_t addr, uint16_t segments,
+	       bool checkpoint = false) :
+    FlashKV(device, addr, segments, checkpoint, m_index_buf, INDEX_MAX)
+  {}
+
+private:
+  index_t m_index_buf[INDEX_MAX];
+};
+
+#endif
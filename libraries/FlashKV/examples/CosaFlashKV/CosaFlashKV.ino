@@ -0,0 +1,125 @@
+/**
+ * @file CosaFlashKV.ino
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * @section Description
+ * Cosa demonstration of the log-structured key/value store on SPI
+ * flash; a boot counter and a device registry of sample records
+ * that are updated continuously. Prints mount time, put/get rate
+ * and the number of free segments. A checkpoint is written every
+ * 1000 updates and compaction is run between updates.
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#include <FlashKV.h>
+
+#include "Cosa/RTT.hh"
+#include "Cosa/Trace.hh"
+#include "Cosa/UART.hh"
+#include "Cosa/Watchdog.hh"
+
+//#define USE_FLASH_S25FL127S
+#define USE_FLASH_W25X40CL
+
+#if defined(USE_FLASH_S25FL127S)
+#include <S25FL127S.h>
+S25FL127S flash;
+// Log of 8 sectors (64 Kbyte) and two checkpoint sectors
+static const uint16_t SEGMENTS = 8;
+#endif
+
+#if defined(USE_FLASH_W25X40CL)
+#include <W25X40CL.h>
+W25X40CL flash;
+// Log of 32 sectors (4 Kbyte) and two checkpoint sectors
+static const uint16_t SEGMENTS = 32;
+#endif
+
+// Store with index for 255 keys; checkpoints enabled
+FlashKVStore<256> kv(&flash, 0L, SEGMENTS, true);
+
+// Keys; boot counter and device records
+static const uint16_t BOOTS = 0;
+static const uint16_t DEVICE = 1;
+static const uint16_t DEVICE_MAX = 200;
+
+// Device record
+struct device_t {
+  uint32_t timestamp;
+  uint16_t count;
+  int16_t value;
+};
+
+void setup()
+{
+  Watchdog::begin();
+  RTT::begin();
+  uart.begin(57600);
+  trace.begin(&uart, PSTR("CosaFlashKV: started"));
+  ASSERT(flash.begin());
+
+  // Mount the store and update the boot counter
+  uint32_t start = RTT::millis();
+  ASSERT(kv.begin());
+  uint32_t ms = RTT::since(start);
+  trace << PSTR("begin:") << ms << PSTR(" ms, ")
+	<< kv.keys() << PSTR(" keys, ")
+	<< kv.available() << PSTR(" free segments")
+	<< endl;
+  uint16_t boots = 0;
+  kv.get(BOOTS, &boots);
+  boots += 1;
+  ASSERT(kv.put(BOOTS, &boots) == sizeof(boots));
+  TRACE(boots);
+}
+
+void loop()
+{
+  static uint16_t updates = 0;
+  const uint16_t COUNT = 100;
+  device_t device;
+  uint32_t start, ms;
+
+  // Update device records
+  start = RTT::millis();
+  for (uint16_t i = 0; i < COUNT; i++) {
+    uint16_t key = DEVICE + (updates + i) % DEVICE_MAX;
+    if (kv.get(key, &device) < 0) memset(&device, 0, sizeof(device));
+    device.timestamp = RTT::millis();
+    device.count += 1;
+    device.value = key * 10 + device.count;
+    ASSERT(kv.put(key, &device) == sizeof(device));
+  }
+  ms = RTT::since(start);
+  trace << PSTR("get+put:") << (COUNT * 1000L) / ms << PSTR(" records/s, ")
+	<< kv.keys() << PSTR(" keys, ")
+	<< kv.available() << PSTR(" free segments")
+	<< endl;
+  updates += COUNT;
+
+  // Checkpoint the index periodically
+  if ((updates % 1000) == 0) {
+    start = RTT::millis();
+    int res = kv.checkpoint();
+    ms = RTT::since(start);
+    trace << PSTR("checkpoint:") << res << ':' << ms << PSTR(" ms") << endl;
+  }
+
+  // Background compaction
+  while (kv.collect() > 0);
+  sleep(1);
+}
@@ -0,0 +1,157 @@
+/**
+ * @file CosaFlashKVRAM.ino
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * @section Description
+ * Cosa verification of the log-structured key/value store on a
+ * RAM-backed flash device. Each round performs random put, remove,
+ * checkpoint and compaction operations and checks the store against
+ * a reference copy after a remount. The round ends with a simulated
+ * power loss during an update; after the remount the key must hold
+ * either the old or the new value, and all other keys must be
+ * unchanged. Prints the number of rounds, keys, free segments and
+ * device operations.
+ *
+ * @section Circuit
+ * This example requires no special circuit. Uses serial output,
+ * internal timer for RTC and watchdog.
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#include <FlashKV.h>
+#include "RAMFlash.hh"
+
+#include "Cosa/RTT.hh"
+#include "Cosa/Trace.hh"
+#include "Cosa/UART.hh"
+#include "Cosa/Watchdog.hh"
+
+// RAM-backed flash; log of 4 sectors and two checkpoint sectors
+static const uint16_t SECTOR_BYTES = 128;
+static const uint16_t SEGMENTS = 4;
+static const uint16_t SECTORS = SEGMENTS + 2;
+static uint8_t mem[SECTOR_BYTES * SECTORS];
+RAMFlash flash(mem, SECTOR_BYTES, SECTORS);
+
+// Store with index for 15 keys; checkpoints enabled
+FlashKVStore<16> kv(&flash, 0L, SEGMENTS, true);
+
+// Reference copy of the keys
+static const uint16_t KEY_MAX = 12;
+static uint16_t value[KEY_MAX];
+static bool present[KEY_MAX];
+
+// Number of operations per round
+static const uint16_t COUNT = 100;
+
+/**
+ * Remount the store and check all keys against the reference copy.
+ */
+static void verify()
+{
+  ASSERT(kv.begin());
+  uint16_t keys = 0;
+  for (uint16_t key = 0; key < KEY_MAX; key++) {
+    uint16_t v;
+    int res = kv.get(key, &v);
+    if (present[key]) {
+      ASSERT(res == sizeof(v));
+      ASSERT(v == value[key]);
+      keys += 1;
+    }
+    else {
+      ASSERT(res == ENOENT);
+    }
+  }
+  ASSERT(kv.keys() == keys);
+}
+
+void setup()
+{
+  Watchdog::begin();
+  RTT::begin();
+  uart.begin(57600);
+  trace.begin(&uart, PSTR("CosaFlashKVRAM: started"));
+
+  // Mount the empty store
+  ASSERT(kv.begin());
+  ASSERT(kv.keys() == 0);
+}
+
+void loop()
+{
+  static uint16_t rounds = 0;
+
+  // Random updates; check the result of each operation
+  for (uint16_t i = 0; i < COUNT; i++) {
+    uint16_t key = rand() % KEY_MAX;
+    uint8_t op = rand() % 100;
+    if (op < 75) {
+      uint16_t v = rand();
+      ASSERT(kv.put(key, &v) == sizeof(v));
+      value[key] = v;
+      present[key] = true;
+    }
+    else if (op < 95) {
+      int res = kv.remove(key);
+      ASSERT((res == 0) == present[key]);
+      present[key] = false;
+    }
+    else if (op < 98) {
+      ASSERT(kv.checkpoint() == 0);
+    }
+    else {
+      ASSERT(kv.collect() >= 0);
+    }
+  }
+
+  // Round trip after remount
+  verify();
+
+  // Power loss during an update (with possible compaction)
+  uint16_t key = rand() % KEY_MAX;
+  uint16_t v = rand();
+  flash.power_loss(1 + rand() % 4);
+  kv.put(key, &v);
+  kv.collect();
+  flash.power_restore();
+  ASSERT(kv.begin());
+  uint16_t w;
+  int res = kv.get(key, &w);
+  if ((res == sizeof(w)) && (w == v)) {
+    value[key] = v;
+    present[key] = true;
+  }
+  else if (present[key]) {
+    ASSERT(res == sizeof(w));
+    ASSERT(w == value[key]);
+  }
+  else {
+    ASSERT(res == ENOENT);
+  }
+  verify();
+
+  // Print statistics
+  rounds += 1;
+  trace << PSTR("rounds:") << rounds
+	<< PSTR(", keys:") << kv.keys()
+	<< PSTR(", free:") << kv.available()
+	<< PSTR(", reads:") << flash.reads
+	<< PSTR(", writes:") << flash.writes
+	<< PSTR(", erases:") << flash.erases
+	<< endl;
+}
@@ -0,0 +1,189 @@
+/**
+ * @file RAMFlash.hh
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#ifndef COSA_RAM_FLASH_HH
+#define COSA_RAM_FLASH_HH
+
+#include "Cosa/Flash.hh"
+#include <string.h>
+
+/**
+ * RAM-backed Flash Device for testing of flash data structures.
+ * Follows the flash programming rules; write may only clear bits
+ * and erase sets all bytes in a sector to 0xff. Counts read, write
+ * and erase operations. A power loss may be simulated; after a given
+ * number of write/erase operations the operation in progress is only
+ * partially performed and the following operations are ignored until
+ * power is restored.
+ */
+class RAMFlash : public Flash::Device {
+public:
+  /**
+   * Construct RAM-backed flash device with given memory, sector size
+   * and number of sectors. The memory is erased.
+   * @param[in] mem memory buffer (bytes * count).
+   * @param[in] bytes sector size.
+   * @param[in] count number of sectors.
+   */
+  RAMFlash(uint8_t* mem, uint32_t bytes, uint16_t count) :
+    Flash::Device(bytes, count),
+    reads(0),
+    writes(0),
+    erases(0),
+    m_mem(mem),
+    m_budget(-1)
+  {
+    memset(m_mem, 0xff, DEVICE_BYTES);
+  }
+
+  /**
+   * Simulate power loss after the given number of write and erase
+   * operations.
+   * @param[in] ops number of operations.
+   */
+  void power_loss(uint16_t ops)
+  {
+    m_budget = ops;
+  }
+
+  /**
+   * Return true(1) if the power is lost otherwise false(0).
+   * @return bool.
+   */
+  bool is_power_lost() const
+  {
+    return (m_budget == 0);
+  }
+
+  /**
+   * Restore power; all operations are performed.
+   */
+  void power_restore()
+  {
+    m_budget = -1;
+  }
+
+  /**
+   * @override{Flash::Device}
+   * Always ready.
+   * @return true(1).
+   */
+  virtual bool is_ready()
+  {
+    return (true);
+  }
+
+  /**
+   * @override{Flash::Device}
+   * Read block from the RAM memory.
+   * @param[in] dest buffer to read from flash into.
+   * @param[in] src address in flash to read from.
+   * @param[in] size number of bytes to read.
+   * @return number of bytes or negative error code.
+   */
+  virtual int read(void* dest, uint32_t src, size_t size)
+  {
+    if (UNLIKELY(src + size > DEVICE_BYTES)) return (EINVAL);
+    memcpy(dest, m_mem + src, size);
+    reads += 1;
+    return (size);
+  }
+
+  /**
+   * @override{Flash::Device}
+   * Erase the sector with the given address. An erase interrupted by
+   * power loss only erases the first half of the sector.
+   * @param[in] dest address in sector to erase.
+   * @param[in] size of sector in Kbyte (ignored).
+   * @return zero or negative error code.
+   */
+  virtual int erase(uint32_t dest, uint8_t size)
+  {
+    UNUSED(size);
+    if (UNLIKELY(dest >= DEVICE_BYTES)) return (EINVAL);
+    size_t bytes = SECTOR_BYTES;
+    if (m_budget == 0) return (0);
+    if ((m_budget > 0) && (--m_budget == 0)) bytes /= 2;
+    memset(m_mem + (dest & ~SECTOR_MASK), 0xff, bytes);
+    erases += 1;
+    return (0);
+  }
+
+  /**
+   * @override{Flash::Device}
+   * Program the given block; clear bits. A write interrupted by power
+   * loss only programs the first half of the block.
+   * @param[in] dest address in flash to write to.
+   * @param[in] src buffer to write to flash.
+   * @param[in] size number of bytes to write.
+   * @return number of bytes or negative error code.
+   */
+  virtual int write(uint32_t dest, const void* src, size_t size)
+  {
+    if (UNLIKELY(dest + size > DEVICE_BYTES)) return (EINVAL);
+    size_t bytes = size;
+    if (m_budget == 0) return (size);
+    if ((m_budget > 0) && (--m_budget == 0)) bytes /= 2;
+    const uint8_t* sp = (const uint8_t*) src;
+    uint8_t* dp = m_mem + dest;
+    while (bytes--) *dp++ &= *sp++;
+    writes += 1;
+    return (size);
+  }
+
+  /**
+   * @override{Flash::Device}
+   * Program the given block in program memory; clear bits.
+   * @param[in] dest address in flash to write to.
+   * @param[in] src buffer in program memory to write to flash.
+   * @param[in] size number of bytes to write.
+   * @return number of bytes or negative error code.
+   */
+  virtual int write_P(uint32_t dest, const void* src, size_t size)
+  {
+    uint8_t buf[16];
+    const uint8_t* sp = (const uint8_t*) src;
+    size_t res = size;
+    while (size != 0) {
+      size_t n = (size > sizeof(buf)) ? sizeof(buf) : size;
+      memcpy_P(buf, sp, n);
+      int count = write(dest, buf, n);
+      if (UNLIKELY(count < 0)) return (count);
+      dest += n;
+      sp += n;
+      size -= n;
+    }
+    return (res);
+  }
+
+  /** Number of read, write and erase operations. */
+  uint32_t reads;
+  uint32_t writes;
+  uint32_t erases;
+
+protected:
+  /** Flash memory. */
+  uint8_t* m_mem;
+
+  /** Number of operations before power loss (or negative). */
+  int16_t m_budget;
+};
+
+#endif
@@ -37,12 +37,24 @@
  */
 class HammingCodec_7_4 : public VWI::Codec {
 public:
+  /** Bits per symbol. */
+  static const uint8_t BITS_PER_SYMBOL = 7;
+
+  /** Start symbol. */
+  static const uint16_t START_SYMBOL = 0x12d5;
+
+  /** Symbol mask. */
+  static const uint8_t SYMBOL_MASK = (1 << BITS_PER_SYMBOL) - 1;
+
+  /** Symbol MSB. */
+  static const uint16_t BITS_MSB = 1 << (BITS_PER_SYMBOL * 2 - 1);
+
   /**
    * Construct Hamming(7,4) codec with given bits per symbol, start
    * symbol, and preamble size.
    */
   HammingCodec_7_4() :
-    VWI::Codec(7, 0x12d5, 8)
+    VWI::Codec(BITS_PER_SYMBOL, START_SYMBOL, 8)
   {
   }
 
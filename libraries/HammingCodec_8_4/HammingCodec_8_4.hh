@@ -37,12 +37,24 @@
  */
 class HammingCodec_8_4 : public VWI::Codec {
 public:
+  /** Bits per symbol. */
+  static const uint8_t BITS_PER_SYMBOL = 8;
+
+  /** Start symbol. */
+  static const uint16_t START_SYMBOL = 0x5a55;
+
+  /** Symbol mask. */
+  static const uint8_t SYMBOL_MASK = (1 << BITS_PER_SYMBOL) - 1;
+
+  /** Symbol MSB. */
+  static const uint16_t BITS_MSB = 1 << (BITS_PER_SYMBOL * 2 - 1);
+
   /**
    * Construct Hamming(8,4) codec with given bits per symbol, start
    * symbol, and preamble size.
    */
   HammingCodec_8_4() :
-    VWI::Codec(8, 0x5a55, 8)
+    VWI::Codec(BITS_PER_SYMBOL, START_SYMBOL, 8)
   {
   }
 
@@ -29,12 +29,24 @@
  */
 class ManchesterCodec : public VWI::Codec {
 public:
+  /** Bits per symbol. */
+  static const uint8_t BITS_PER_SYMBOL = 8;
+
+  /** Start symbol. */
+  static const uint16_t START_SYMBOL = 0x5d55;
+
+  /** Symbol mask. */
+  static const uint8_t SYMBOL_MASK = (1 << BITS_PER_SYMBOL) - 1;
+
+  /** Symbol MSB. */
+  static const uint16_t BITS_MSB = 1 << (BITS_PER_SYMBOL * 2 - 1);
+
   /**
    * Construct Manchester Phase codec with given bits per symbol,
    * start symbol, and preamble size.
    */
   ManchesterCodec() :
-    VWI::Codec(8, 0x5d55, 8)
+    VWI::Codec(BITS_PER_SYMBOL, START_SYMBOL, 8)
   {
   }
 
@@ -65,7 +77,15 @@ public:
    * @param[in] symbol to decode.
    * @return 4-bit data.
    */
-  virtual uint8_t decode4(uint8_t symbol);
+  virtual uint8_t decode4(uint8_t symbol)
+  {
+    uint8_t res = 0;
+    if (symbol & 1) res |= 1;
+    if (symbol & 4) res |= 2;
+    if (symbol & 16) res |= 4;
+    if (symbol & 64) res |= 8;
+    return (res);
+  }
 
 private:
   /** Symbol mapping table: 4 to 8 bits */
@@ -24,6 +24,7 @@
  */
 
 #include "OWI.hh"
+#include "Cosa/CRC.hh"
 
 bool
 OWI::reset()
@@ -50,7 +51,6 @@ uint8_t
 OWI::read(uint8_t bits)
 {
   uint8_t res = 0;
-  uint8_t mix = 0;
   uint8_t adjust = CHARBITS - bits;
   while (bits--) {
     synchronized {
@@ -61,16 +61,8 @@ OWI::read(uint8_t bits)
       mode(INPUT_MODE);
       DELAY(9);
       res >>= 1;
-      if (is_set()) {
-	res |= 0x80;
-	mix = (m_crc ^ 1);
-      }
-      else {
-	mix = (m_crc ^ 0);
-      }
+      if (is_set()) res |= 0x80;
     }
-    m_crc >>= 1;
-    if (mix & 1) m_crc ^= 0x8C;
     DELAY(55);
   }
   res >>= adjust;
@@ -81,15 +73,13 @@ bool
 OWI::read(void* buf, uint8_t size)
 {
   uint8_t* bp = (uint8_t*) buf;
-  m_crc = 0;
-  while (size--) *bp++ = read();
-  return (m_crc == 0);
+  for (uint8_t i = 0; i < size; i++) *bp++ = read();
+  return (CRC::Dallas::update(CRC::Dallas::INIT, buf, size) == 0);
 }
 
 void
 OWI::write(uint8_t value, uint8_t bits, bool power)
 {
-  uint8_t mix = 0;
   mode(OUTPUT_MODE);
   set();
   while (bits--) {
@@ -99,18 +89,14 @@ OWI::write(uint8_t value, uint8_t bits, bool power)
 	DELAY(6);
 	set();
 	DELAY(64);
-	mix = (m_crc ^ 1);
       }
       else {
 	DELAY(60);
 	set();
 	DELAY(10);
-	mix = (m_crc ^ 0);
       }
     }
     value >>= 1;
-    m_crc >>= 1;
-    if (mix & 1) m_crc ^= 0x8C;
   }
   if (!power) power_off();
 }
@@ -221,8 +221,7 @@ public:
   OWI(Board::DigitalPin pin) :
     IOPin(pin),
     m_devices(0),
-    m_device(NULL),
-    m_crc(0)
+    m_device(NULL)
   {}
 
   /**
@@ -242,7 +241,8 @@ public:
 
   /**
    * Read given number of bytes from one wire bus (slave) to given
-   * buffer. Return true(1) if correctly read otherwise false(0).
+   * buffer. Return true(1) if the CRC-8 (Dallas) check sum over the
+   * buffer is correct otherwise false(0).
    * @param[in] buf buffer pointer.
    * @param[in] size number of bytes to read.
    * @return bool.
@@ -298,9 +298,6 @@ private:
 
   /** List of slave devices. */
   Driver* m_device;
-
-  /** Intermediate CRC sum. */
-  uint8_t m_crc;
 };
 
 /**
@@ -22,7 +22,7 @@
 #if !defined(BOARD_ATTINY)
 #include "RS485.hh"
 #include "Cosa/RTT.hh"
-#include <util/crc16.h>
+#include "Cosa/CRC.hh"
 
 static uint8_t
 crc7(const void* buf, size_t size)
@@ -42,11 +42,7 @@ crc7(const void* buf, size_t size)
 static uint16_t
 crc_xmodem(const void* buf, size_t len)
 {
-  if (UNLIKELY(len == 0)) return (0);
-  uint8_t* bp = (uint8_t*) buf;
-  uint16_t crc = 0;
-  do crc = _crc_xmodem_update(crc, *bp++); while (--len);
-  return (crc);
+  return (CRC::XModem::update(CRC::XModem::INIT, buf, len));
 }
 
 int
@@ -50,6 +50,127 @@ Registry::lookup(const uint8_t* path, size_t count)
   return (item);
 }
 
+Registry::item_P
+Registry::find(const char* path)
+{
+  // Check for root path; leading slashes are ignored
+  if (UNLIKELY(path == NULL)) return ((item_P) m_root);
+  while (*path == '/') path++;
+  if (*path == 0) return ((item_P) m_root);
+  if (m_index == NULL) return (walk(path));
+
+  // Strip trailing slashes; the hash is over the normalised path name
+  size_t len = strlen(path);
+  while (path[len - 1] == '/') len--;
+
+  // Hash the path name and locate the leaf name
+  uint32_t h = FNV_OFFSET;
+  const char* leaf = path;
+  for (size_t i = 0; i < len; i++) {
+    h = hash(h, path[i]);
+    if (path[i] == '/') leaf = path + i + 1;
+  }
+
+  // Binary search for the hash in the index
+  uint8_t low = 0;
+  uint8_t high = m_index_count;
+  while (low < high) {
+    uint8_t mid = (low + high) / 2;
+    uint32_t key = m_index[mid].hash;
+    if (key < h) {
+      low = mid + 1;
+    }
+    else if (key > h) {
+      high = mid;
+    }
+    else {
+      // Fall back to tree walk on hash collision in the index
+      if ((mid > 0 && m_index[mid - 1].hash == h)
+	  || (mid + 1 < m_index_count && m_index[mid + 1].hash == h))
+	break;
+      item_P item = m_index[mid].item;
+      str_P name = get_name(item);
+      size_t n = path + len - leaf;
+      if (strncmp_P(leaf, name, n) == 0
+	  && pgm_read_byte((const char*) name + n) == 0)
+	return (item);
+      break;
+    }
+  }
+
+  // Not in the index; items deeper than PATH_MAX are not indexed
+  return (walk(path));
+}
+
+Registry::item_P
+Registry::walk(const char* path)
+{
+  item_P item = (item_P) m_root;
+  while (*path) {
+    // Check that the current item is a list
+    item_list_P list = to_list(item);
+    if (list == NULL) return (NULL);
+
+    // Find the item with the next name in the path
+    const char* sp = strchr(path, '/');
+    size_t len = (sp == NULL) ? strlen(path) : sp - path;
+    Iterator iter(list);
+    while ((item = iter.next()) != NULL) {
+      str_P name = get_name(item);
+      if (strncmp_P(path, name, len) == 0
+	  && pgm_read_byte((const char*) name + len) == 0)
+	break;
+    }
+    if (item == NULL) return (NULL);
+    path += len;
+    if (*path == '/') path += 1;
+  }
+  return (item);
+}
+
+int
+Registry::build_index(item_list_P list, uint32_t parent, uint8_t depth,
+		      index_t* index, uint8_t count, uint8_t max)
+{
+  Iterator iter(list);
+  item_P item;
+  while ((item = iter.next()) != NULL) {
+    // Hash of the path name; parent path and item name
+    uint32_t h = (depth == 0) ? FNV_OFFSET : hash(parent, '/');
+    const char* name = (const char*) get_name(item);
+    char c;
+    while ((c = pgm_read_byte(name++)) != 0) h = hash(h, c);
+
+    // Insert into the index; sorted on hash value
+    if (UNLIKELY(count == max)) return (ENOSPC);
+    uint8_t i = count++;
+    for (; i > 0 && index[i - 1].hash > h; i--)
+      index[i] = index[i - 1];
+    index[i].hash = h;
+    index[i].item = item;
+
+    // Add items of sub-lists
+    if (get_type(item) == ITEM_LIST && depth + 1 < PATH_MAX) {
+      int res = build_index((item_list_P) item, h, depth + 1, index, count, max);
+      if (UNLIKELY(res < 0)) return (res);
+      count = res;
+    }
+  }
+  return (count);
+}
+
+int
+Registry::build_index(index_t* index, uint8_t max)
+{
+  m_index = NULL;
+  m_index_count = 0;
+  int res = build_index(m_root, FNV_OFFSET, 0, index, 0, max);
+  if (UNLIKELY(res < 0)) return (res);
+  m_index = index;
+  m_index_count = res;
+  return (res);
+}
+
 void
 Registry::print(IOStream& outs, const uint8_t* path, size_t count)
 {
@@ -138,6 +259,8 @@ Registry::set_value(blob_P blob, const void* buf, size_t len)
   storage_t storage = get_storage(&blob->item);
   if (storage == IN_SRAM)
     memcpy((void*) pgm_read_word(&blob->value), buf, size);
+  else if (storage == IN_EEMEM && m_journal != NULL && m_journal->is_active())
+    return (m_journal->write((void*) pgm_read_word(&blob->value), buf, size));
   else if (storage == IN_EEMEM && m_eeprom != NULL)
     m_eeprom->write((void*) pgm_read_word(&blob->value), buf, size);
   else return (EINVAL);
@@ -332,6 +332,131 @@ public:
   /** Max length of a path. */
   static const size_t PATH_MAX = 8;
 
+  /**
+   * Registry journal for EEMEM blob values. When a transaction is
+   * active set_value() appends the new value to a journal region in
+   * EEPROM instead of writing to the blob. On commit() the journal is
+   * marked complete and then applied; only bytes that differ are
+   * written. An interrupted commit is completed by recover(). Several
+   * blob updates within a transaction are thereby atomic. Note that
+   * get_value() returns the previous value until commit.
+   */
+  class Journal {
+  public:
+    /**
+     * Construct journal in given EEPROM region.
+     * @param[in] addr start address of journal region.
+     * @param[in] size of journal region in bytes.
+     * @param[in] eeprom device driver (default internal EEPROM).
+     */
+    Journal(void* addr, size_t size,
+	    EEPROM::Device* eeprom = &EEPROM::Device::eeprom) :
+      m_eeprom(eeprom),
+      m_addr((uint8_t*) addr),
+      m_size(size),
+      m_length(0),
+      m_count(0),
+      m_active(false)
+    {}
+
+    /**
+     * Complete any committed but not yet applied transaction. Should
+     * be called on startup before accessing EEMEM blob values. Return
+     * number of applied records or negative error code.
+     * @return number of records or negative error code.
+     */
+    int recover();
+
+    /**
+     * Start a transaction. Following EEMEM blob updates are journaled
+     * until commit() or abort(). A committed transaction that was not
+     * applied (e.g. commit() failed) is completed first; the new
+     * records would otherwise overwrite it while the journal header
+     * is still committed. Return zero or negative error code.
+     * @return zero or negative error code.
+     */
+    int begin();
+
+    /**
+     * Commit the transaction; mark the journal complete and apply the
+     * journaled updates. Return number of applied records or negative
+     * error code.
+     * @return number of records or negative error code.
+     */
+    int commit();
+
+    /**
+     * Abort the transaction; journaled updates are discarded.
+     */
+    void abort()
+    {
+      m_active = false;
+    }
+
+    /**
+     * Return true(1) if a transaction is active otherwise false(0).
+     * @return bool.
+     */
+    bool is_active() const
+    {
+      return (m_active);
+    }
+
+    /**
+     * Append an update of the given EEPROM address to the journal.
+     * Return number of bytes or negative error code (ENOSPC if the
+     * journal is full).
+     * @param[in] dest address in EEPROM.
+     * @param[in] src buffer with new value.
+     * @param[in] size number of bytes.
+     * @return number of bytes or negative error code.
+     */
+    int write(void* dest, const void* src, size_t size);
+
+  protected:
+    /** Journal header state. */
+    static const uint8_t EMPTY = 0xff;
+    static const uint8_t COMMITTED = 0xa5;
+
+    /** Journal header; state is written last on commit. */
+    struct header_t {
+      uint16_t length;		//!< Number of bytes of records.
+      uint8_t count;		//!< Number of records.
+      uint8_t state;		//!< Journal state.
+    };
+
+    /** Journal record header; followed by value. */
+    struct record_t {
+      uint16_t dest;		//!< Address in EEPROM.
+      uint8_t size;		//!< Number of bytes.
+    };
+
+    EEPROM m_eeprom;
+    uint8_t* const m_addr;
+    const size_t m_size;
+    uint16_t m_length;
+    uint8_t m_count;
+    bool m_active;
+
+    /**
+     * Apply given number of records with given length in the journal
+     * and mark the journal empty. Return number of records or negative
+     * error code.
+     * @param[in] count number of records.
+     * @param[in] length of records.
+     * @return number of records or negative error code.
+     */
+    int apply(uint8_t count, uint16_t length);
+  };
+
+  /**
+   * Registry name index entry; hash of path name and item.
+   */
+  struct index_t {
+    uint32_t hash;		//!< Hash of path name.
+    item_P item;		//!< Item in program memory.
+  };
+
   /**
    * Construct registery root object.
    * @param[in] root item list.
@@ -339,9 +464,35 @@ public:
    */
   Registry(item_list_P root, EEPROM::Device* eeprom = NULL) :
     m_root(root),
-    m_eeprom(eeprom == NULL ? &EEPROM::Device::eeprom : eeprom)
+    m_eeprom(eeprom == NULL ? &EEPROM::Device::eeprom : eeprom),
+    m_index(NULL),
+    m_index_count(0),
+    m_journal(NULL)
   {}
 
+  /**
+   * Build name index in the given vector with given max number of
+   * entries. The registry tree is walked once and a hash of the path
+   * name of each item is stored in the index, sorted on the hash
+   * value. Path name lookups are then a binary search. Return number
+   * of entries or negative error code (ENOSPC if the vector is too
+   * small). The index holds at most 255 entries; larger registries
+   * are not indexed and find() falls back to a walk of the tree.
+   * @param[in] index vector.
+   * @param[in] max number of entries in vector.
+   * @return number of entries or negative error code.
+   */
+  int build_index(index_t* index, uint8_t max);
+
+  /**
+   * Set journal for EEMEM blob updates.
+   * @param[in] journal to use (or NULL to disable).
+   */
+  void journal(Journal* journal)
+  {
+    m_journal = journal;
+  }
+
   /**
    * Lookup registry item for given path. Returns pointer to item if
    * found otherwise NULL. Default parameters will give root item.
@@ -351,6 +502,19 @@ public:
    */
   item_P lookup(const uint8_t* path = NULL, size_t count = 0);
 
+  /**
+   * Lookup registry item for given path name; item names separated
+   * with slash, e.g. "config/network". Leading and trailing slashes
+   * are ignored. The empty string is the root item. Uses the name
+   * index if available; paths not in the index (deeper than
+   * PATH_MAX, hash collisions or not found) fall back to a walk of
+   * the registry tree.
+   * Returns pointer to item if found otherwise NULL.
+   * @param[in] path name string.
+   * @return item pointer or NULL.
+   */
+  item_P find(const char* path);
+
   void print(IOStream& outs, const uint8_t* path, size_t count);
 
   /**
@@ -375,6 +539,49 @@ private:
 
   /** EEPROM device driver. */
   EEPROM::Device* m_eeprom;
+
+  /** Name index and number of entries. */
+  index_t* m_index;
+  uint8_t m_index_count;
+
+  /** Journal for EEMEM blob updates. */
+  Journal* m_journal;
+
+  /** FNV-1a hash constants. */
+  static const uint32_t FNV_OFFSET = 2166136261UL;
+  static const uint32_t FNV_PRIME = 16777619UL;
+
+  /**
+   * Return hash of given character and hash.
+   * @param[in] hash current hash.
+   * @param[in] c character.
+   * @return hash.
+   */
+  static uint32_t hash(uint32_t hash, char c)
+  {
+    return ((hash ^ (uint8_t) c) * FNV_PRIME);
+  }
+
+  /**
+   * Add items in given list with given parent path hash and depth to
+   * the name index. Return number of entries or negative error code.
+   * @param[in] list item list.
+   * @param[in] parent path hash.
+   * @param[in] depth of list.
+   * @param[in] index vector.
+   * @param[in] count number of entries in vector.
+   * @param[in] max number of entries in vector.
+   * @return number of entries or negative error code.
+   */
+  static int build_index(item_list_P list, uint32_t parent, uint8_t depth,
+			 index_t* index, uint8_t count, uint8_t max);
+
+  /**
+   * Walk registry tree and lookup item for given path name.
+   * @param[in] path name string.
+   * @return item pointer or NULL.
+   */
+  item_P walk(const char* path);
 };
 
 /**
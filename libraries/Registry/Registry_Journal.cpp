@@ -0,0 +1,142 @@
+/**
+ * @file Registry_Journal.cpp
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#include "Registry.hh"
+
+int
+Registry::Journal::begin()
+{
+  // Complete any committed transaction before the records are reused
+  int res = recover();
+  if (UNLIKELY(res < 0)) return (res);
+  m_length = 0;
+  m_count = 0;
+  m_active = true;
+  return (0);
+}
+
+int
+Registry::Journal::write(void* dest, const void* src, size_t size)
+{
+  if (UNLIKELY(!m_active)) return (EINVAL);
+  if (UNLIKELY(size > UINT8_MAX)) return (E2BIG);
+
+  // Check that there is room for the record
+  uint16_t offset = sizeof(header_t) + m_length;
+  if (UNLIKELY(offset + sizeof(record_t) + size > m_size)) return (ENOSPC);
+
+  // Append record header and value to the journal
+  record_t record;
+  record.dest = (uint16_t) dest;
+  record.size = size;
+  if (UNLIKELY(m_eeprom.write(m_addr + offset, &record, sizeof(record))
+	       != sizeof(record)))
+    return (EIO);
+  offset += sizeof(record);
+  if (UNLIKELY(m_eeprom.write(m_addr + offset, src, size) != (int) size))
+    return (EIO);
+  m_length += sizeof(record) + size;
+  m_count += 1;
+  return (size);
+}
+
+int
+Registry::Journal::commit()
+{
+  if (UNLIKELY(!m_active)) return (EINVAL);
+  m_active = false;
+  if (m_count == 0) return (0);
+
+  // Mark the journal committed; the state is written last
+  header_t header;
+  header.length = m_length;
+  header.count = m_count;
+  header.state = COMMITTED;
+  if (UNLIKELY(m_eeprom.write(m_addr, &header, offsetof(header_t, state))
+	       != offsetof(header_t, state)))
+    return (EIO);
+  if (UNLIKELY(m_eeprom.write(m_addr + offsetof(header_t, state),
+			      &header.state, sizeof(header.state))
+	       != sizeof(header.state)))
+    return (EIO);
+
+  // Apply the journaled updates
+  return (apply(m_count, m_length));
+}
+
+int
+Registry::Journal::recover()
+{
+  header_t header;
+  if (UNLIKELY(m_eeprom.read(&header, m_addr, sizeof(header))
+	       != sizeof(header)))
+    return (EIO);
+  if (header.state != COMMITTED) return (0);
+  return (apply(header.count, header.length));
+}
+
+int
+Registry::Journal::apply(uint8_t count, uint16_t length)
+{
+  const uint8_t BUF_MAX = 16;
+  uint8_t buf[BUF_MAX];
+  uint8_t old[BUF_MAX];
+  uint16_t offset = sizeof(header_t);
+  uint16_t end = offset + length;
+
+  for (uint8_t i = 0; i < count && offset < end; i++) {
+    // Read next record header
+    record_t record;
+    if (UNLIKELY(m_eeprom.read(&record, m_addr + offset, sizeof(record))
+		 != sizeof(record)))
+      return (EIO);
+    offset += sizeof(record);
+
+    // Copy value in chunks; only write the bytes that differ
+    uint8_t* dest = (uint8_t*) record.dest;
+    size_t size = record.size;
+    while (size > 0) {
+      size_t n = (size > BUF_MAX) ? BUF_MAX : size;
+      m_eeprom.read(buf, m_addr + offset, n);
+      m_eeprom.read(old, dest, n);
+      for (size_t j = 0; j < n; ) {
+	if (buf[j] == old[j]) {
+	  j++;
+	  continue;
+	}
+	size_t k = j + 1;
+	while (k < n && buf[k] != old[k]) k++;
+	if (UNLIKELY(m_eeprom.write(dest + j, &buf[j], k - j) != (int) (k - j)))
+	  return (EIO);
+	j = k;
+      }
+      offset += n;
+      dest += n;
+      size -= n;
+    }
+  }
+
+  // Mark the journal empty
+  uint8_t state = EMPTY;
+  if (UNLIKELY(m_eeprom.write(m_addr + offsetof(header_t, state),
+			      &state, sizeof(state)) != sizeof(state)))
+    return (EIO);
+  return (count);
+}
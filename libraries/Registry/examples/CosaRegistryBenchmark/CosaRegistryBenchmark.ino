@@ -0,0 +1,137 @@
+/**
+ * @file CosaRegistryBenchmark.ino
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * @section Description
+ * Cosa Registry benchmark; lookups per second for index path, path
+ * name with tree walk and path name with name index, on a registry
+ * with 110 items (10 lists with 10 blobs each). Also measures an
+ * EEMEM multi-field update through the journal.
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#include <Registry.h>
+
+#include "Cosa/RTT.hh"
+#include "Cosa/Trace.hh"
+#include "Cosa/UART.hh"
+
+// Generate 10 blobs and an item list with the blobs
+#define BLOB(p,n) REGISTRY_BLOB_VAR(uint8_t, p ## _ ## n, "v" #n, n, false)
+#define BLOBS(p)							\
+  BLOB(p,0) BLOB(p,1) BLOB(p,2) BLOB(p,3) BLOB(p,4)			\
+  BLOB(p,5) BLOB(p,6) BLOB(p,7) BLOB(p,8) BLOB(p,9)
+#define ITEM(p,n) REGISTRY_BLOB_ITEM(p ## _ ## n)
+#define LIST(p)								\
+  BLOBS(p)								\
+  REGISTRY_BEGIN(p, #p)							\
+    ITEM(p,0) ITEM(p,1) ITEM(p,2) ITEM(p,3) ITEM(p,4)			\
+    ITEM(p,5) ITEM(p,6) ITEM(p,7) ITEM(p,8) ITEM(p,9)			\
+  REGISTRY_END(p)
+
+LIST(L0) LIST(L1) LIST(L2) LIST(L3) LIST(L4)
+LIST(L5) LIST(L6) LIST(L7) LIST(L8) LIST(L9)
+
+REGISTRY_BEGIN(ROOT, "root")
+  REGISTRY_LIST_ITEM(L0) REGISTRY_LIST_ITEM(L1)
+  REGISTRY_LIST_ITEM(L2) REGISTRY_LIST_ITEM(L3)
+  REGISTRY_LIST_ITEM(L4) REGISTRY_LIST_ITEM(L5)
+  REGISTRY_LIST_ITEM(L6) REGISTRY_LIST_ITEM(L7)
+  REGISTRY_LIST_ITEM(L8) REGISTRY_LIST_ITEM(L9)
+REGISTRY_END(ROOT)
+
+Registry reg(&ROOT);
+Registry::index_t name_index[112];
+
+// Configuration in EEMEM and journal region
+struct config_t {
+  uint16_t network;
+  uint8_t device;
+  uint16_t period;
+};
+static config_t CONFIG EEMEM;
+static uint16_t BOOTS EEMEM;
+REGISTRY_BLOB(CONFIG, "config", EEMEM, false)
+REGISTRY_BLOB(BOOTS, "boots", EEMEM, false)
+Registry::Journal journal((void*) 512, 64);
+
+static const uint16_t COUNT = 1000;
+static const char* const name[] = {
+  "L0/v0", "L3/v7", "L9/v9", "L5/v4"
+};
+
+void setup()
+{
+  uart.begin(9600);
+  trace.begin(&uart, PSTR("CosaRegistryBenchmark: started"));
+  RTT::begin();
+}
+
+void loop()
+{
+  uint32_t start, us;
+
+  // Index path lookup
+  uint8_t path[2] = { 9, 9 };
+  start = RTT::micros();
+  for (uint16_t i = 0; i < COUNT; i++) {
+    path[1] = i & 7;
+    ASSERT(reg.lookup(path, sizeof(path)) != NULL);
+  }
+  us = RTT::since(start) / 1000L;
+  trace << PSTR("lookup(path):") << (1000000L * COUNT) / us / 1000L
+	<< PSTR(" lookups/s") << endl;
+
+  // Path name lookup with tree walk
+  start = RTT::micros();
+  for (uint16_t i = 0; i < COUNT; i++)
+    ASSERT(reg.find(name[i & 3]) != NULL);
+  us = RTT::since(start) / 1000L;
+  trace << PSTR("find(name):") << (1000000L * COUNT) / us / 1000L
+	<< PSTR(" lookups/s") << endl;
+
+  // Path name lookup with name index
+  start = RTT::micros();
+  int entries = reg.build_index(name_index, membersof(name_index));
+  us = RTT::since(start);
+  trace << PSTR("build_index:") << entries << PSTR(" entries, ")
+	<< us << PSTR(" us") << endl;
+  start = RTT::micros();
+  for (uint16_t i = 0; i < COUNT; i++)
+    ASSERT(reg.find(name[i & 3]) != NULL);
+  us = RTT::since(start) / 1000L;
+  trace << PSTR("find(name,index):") << (1000000L * COUNT) / us / 1000L
+	<< PSTR(" lookups/s") << endl;
+
+  // Journaled multi-field update of EEMEM blobs
+  config_t config = { 0xc05a, 0x42, 100 };
+  uint16_t boots = 0;
+  reg.journal(&journal);
+  journal.recover();
+  reg.get_value(&BOOTS_blob, &boots);
+  boots += 1;
+  start = RTT::micros();
+  journal.begin();
+  reg.set_value(&CONFIG_blob, &config);
+  reg.set_value(&BOOTS_blob, &boots);
+  int res = journal.commit();
+  us = RTT::since(start);
+  trace << PSTR("commit:") << res << PSTR(" records, ")
+	<< us << PSTR(" us, boots = ") << boots << endl;
+
+  sleep(5);
+}
@@ -229,3 +229,72 @@ Rotary::Encoder::detect()
   return ((Direction) (m_state & 0xf0));
 }
 
+
+/**
+ * Quadrature transition table. Index is previous state (bit 3..2)
+ * and current state (bit 1..0) of DT and CLK. Valid transitions are
+ * one quarter-step clock-wise (+1) or anti-clock-wise (-1). No
+ * change and invalid (double) transitions are ignored (0).
+ */
+const int8_t Rotary::Decoder::transition_table[16] __PROGMEM = {
+   0, +1, -1,  0,
+  -1,  0,  0, +1,
+  +1,  0,  0, -1,
+   0, -1, +1,  0
+};
+
+void
+Rotary::Decoder::SignalPin::on_interrupt(uint16_t arg)
+{
+  UNUSED(arg);
+  m_decoder->detect();
+}
+
+void
+Rotary::Decoder::detect()
+{
+  uint8_t pins = ((m_dt.is_set() << 1) | m_clk.is_set());
+  int8_t step = (int8_t) pgm_read_byte(&transition_table[(m_state << 2) | pins]);
+  m_state = pins;
+  if (step == 0) return;
+  m_count += step;
+  if (m_pending) return;
+  m_pending = Event::push(Event::CHANGE_TYPE, this);
+}
+
+void
+Rotary::Decoder::on_event(uint8_t type, uint16_t value)
+{
+  UNUSED(type);
+  UNUSED(value);
+
+  // Collect accumulated quarter-steps and allow a new event
+  int16_t count;
+  synchronized {
+    count = m_count;
+    m_count = 0;
+    m_pending = false;
+  }
+
+  // Convert to steps and keep the remainder for the next dispatch
+  count += m_remainder;
+  int16_t delta = count / m_counts;
+  m_remainder = count - delta * m_counts;
+
+  // Update the velocity estimate (steps per second); average with
+  // the previous estimate unless the knob has been idle. After idle
+  // the elapsed time is clamped to the velocity window
+  uint32_t now = RTT::millis();
+  uint32_t ms = now - m_latest;
+  m_latest = now;
+  if (ms > VELOCITY_MS) {
+    m_velocity = (delta * 1000L) / VELOCITY_MS;
+  }
+  else {
+    if (ms == 0) ms = 1;
+    int32_t velocity = (delta * 1000L) / (int32_t) ms;
+    m_velocity = (m_velocity + velocity) / 2;
+  }
+
+  if (delta != 0) on_change(delta);
+}
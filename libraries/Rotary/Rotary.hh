@@ -175,6 +175,163 @@ public:
     Direction detect();
   };
 
+  /**
+   * Table-driven Rotary Quadrature Decoder using pin change
+   * interrupts. The interrupt handler looks up the transition from
+   * the previous to the current pin state in a 16-entry table and
+   * accumulates a signed count of quarter-steps. At most one
+   * Event::CHANGE_TYPE is pending at a time; the accumulated count is
+   * collected on dispatch and delivered as a single delta to
+   * on_change(). Fast turns will not fill the event queue.
+   *
+   * The decoder also maintains a smoothed estimate of the turn
+   * velocity (steps per second) that may be used to accelerate
+   * scrolling.
+   *
+   * @section Circuit
+   * @code
+   *                       Rotary Encoder
+   *                       +------------+
+   * (PCIc)--------------1-|CLK         |
+   * (PCId)--------------2-|DT          |
+   *                     3-|SW   (/)    |
+   * (VCC)---------------4-|VCC         |
+   * (GND)---------------5-|GND         |
+   *                       +------------+
+   * @endcode
+   */
+  class Decoder : public Event::Handler {
+  public:
+    /**
+     * Create Rotary Decoder with given interrupt pins and number of
+     * quarter-steps per step (detent). Setup must call
+     * InterruptPin::begin() to initiate handling of pins.
+     * @param[in] clk pin.
+     * @param[in] dt pin.
+     * @param[in] counts quarter-steps per step (default 4).
+     */
+    Decoder(Board::InterruptPin clk, Board::InterruptPin dt,
+	    uint8_t counts = 4) :
+      m_clk(clk, this),
+      m_dt(dt, this),
+      m_state(0),
+      m_pending(false),
+      m_count(0),
+      m_counts(counts),
+      m_remainder(0),
+      m_latest(0L),
+      m_velocity(0)
+    {
+      m_state = ((m_dt.is_set() << 1) | m_clk.is_set());
+      enable();
+    }
+
+    /**
+     * Enable the decoder.
+     */
+    void enable()
+      __attribute__((always_inline))
+    {
+      m_clk.enable();
+      m_dt.enable();
+    }
+
+    /**
+     * Disable the decoder.
+     */
+    void disable()
+      __attribute__((always_inline))
+    {
+      m_clk.disable();
+      m_dt.disable();
+    }
+
+    /**
+     * Return estimated turn velocity in steps per second; positive
+     * for clock-wise and negative for anti-clock-wise. Decays to zero
+     * when the knob is not turned.
+     * @return velocity.
+     */
+    int16_t velocity() const
+    {
+      if (RTT::since(m_latest) > VELOCITY_MS) return (0);
+      return (m_velocity);
+    }
+
+    /**
+     * @override{Rotary::Decoder}
+     * Called on dispatch with the number of steps accumulated since
+     * the previous call; positive for clock-wise and negative for
+     * anti-clock-wise. Default is null function.
+     * @param[in] delta number of steps.
+     */
+    virtual void on_change(int16_t delta)
+    {
+      UNUSED(delta);
+    }
+
+  protected:
+    /**
+     * Rotary signal pin handler (pin change interrupt). Delegates to
+     * Rotary Decoder to accumulate transition count.
+     */
+    class SignalPin : public PinChangeInterrupt {
+    public:
+      SignalPin(Board::InterruptPin pin, Decoder* decoder) :
+	PinChangeInterrupt(pin),
+	m_decoder(decoder)
+      {}
+
+    private:
+      Decoder* m_decoder;
+
+      /**
+       * @override{Interrupt::Handler}
+       * Signal pin interrupt handler. Accumulate transition count and
+       * push Event::CHANGE_TYPE if not already pending.
+       */
+      virtual void on_interrupt(uint16_t arg);
+    };
+
+    /** Quadrature transition table; index is previous and current state. */
+    static const int8_t transition_table[16] PROGMEM;
+
+    /** Time constant for velocity decay (ms). */
+    static const uint16_t VELOCITY_MS = 250;
+
+    /** Signal pins and previous state. */
+    SignalPin m_clk;
+    SignalPin m_dt;
+    uint8_t m_state;
+
+    /** Event pending flag and accumulated quarter-steps. */
+    volatile bool m_pending;
+    volatile int16_t m_count;
+
+    /** Quarter-steps per step and remainder from previous dispatch. */
+    uint8_t m_counts;
+    int16_t m_remainder;
+
+    /** Timestamp of previous dispatch (ms) and smoothed velocity. */
+    uint32_t m_latest;
+    int16_t m_velocity;
+
+    /**
+     * Accumulate quarter-step transition for current pin state.
+     * Called from the signal pin interrupt handler.
+     */
+    void detect();
+
+    /**
+     * @override{Event::Handler}
+     * Collect accumulated count, update velocity estimate and call
+     * on_change() with the step delta.
+     * @param[in] type the event type.
+     * @param[in] value the event value.
+     */
+    virtual void on_event(uint8_t type, uint16_t value);
+  };
+
   /**
    * Use Rotary Encoder as a simple dial (integer value). Allows a
    * dial within a given number(T) range (min, max) and a given
@@ -0,0 +1,95 @@
+/**
+ * @file CosaRotaryDecoder.ino
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * @section Description
+ * Cosa demonstration of the table-driven Rotary Decoder; coalesced
+ * step delta and velocity based acceleration of a menu index.
+ *
+ * @section Circuit
+ * KY-040 Rotary Encoder Module.
+ * @code
+ *                        Decoder/knob
+ *                       +------------+
+ * (PCI6)--------------1-|CLK         |
+ * (PCI7)--------------2-|DT          |
+ *                     3-|SW   (/)    |
+ * (VCC)---------------4-|VCC         |
+ * (GND)---------------5-|GND         |
+ *                       +------------+
+ * @endcode
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#include <Rotary.h>
+
+#include "Cosa/RTT.hh"
+#include "Cosa/Trace.hh"
+#include "Cosa/UART.hh"
+
+#if defined(BOARD_ATTINY)
+#define CLK Board::PCI1
+#define DT Board::PCI2
+#else
+#define CLK Board::PCI6
+#define DT Board::PCI7
+#endif
+
+class Knob : public Rotary::Decoder {
+public:
+  Knob(Board::InterruptPin clk, Board::InterruptPin dt) :
+    Rotary::Decoder(clk, dt),
+    m_index(0)
+  {}
+
+  virtual void on_change(int16_t delta)
+  {
+    // Accelerate when turning faster than 8 steps per second
+    int16_t speed = abs(velocity());
+    if (speed > 8) delta *= (speed / 8);
+    m_index += delta;
+    if (m_index < 0) m_index = 0;
+    else if (m_index > 999) m_index = 999;
+    trace << delta << ':' << velocity() << ':' << m_index << endl;
+  }
+
+private:
+  int16_t m_index;
+};
+
+Knob knob(CLK, DT);
+
+void setup()
+{
+  // Use the UART as output stream
+  uart.begin(9600);
+  trace.begin(&uart, PSTR("CosaRotaryDecoder: started"));
+
+  // Start the interrupt pin handler
+  PinChangeInterrupt::begin();
+
+  // Enable the RTC
+  RTT::begin();
+}
+
+void loop()
+{
+  // Rotary Decoder will push at most one event per dispatch
+  Event event;
+  Event::queue.await(&event);
+  event.dispatch();
+}
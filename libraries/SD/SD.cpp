@@ -20,6 +20,7 @@
 
 #include "SD.hh"
 #include "Cosa/RTT.hh"
+#include "Cosa/CRC.hh"
 
 // Configuration: Allow SPI transfer interleaving, table driven CRC.
 #define USE_SPI_PREFETCH
@@ -43,54 +44,18 @@ crc7(const void* buf, size_t size)
   return (crc | 1);
 }
 
-#if defined(USE_CRCTAB)
-static const uint16_t crctab[] __PROGMEM = {
-  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
-  0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
-  0x1231, 0x0210, 0x3273, 0x2252, 0x52b5, 0x4294, 0x72f7, 0x62d6,
-  0x9339, 0x8318, 0xb37b, 0xa35a, 0xd3bd, 0xc39c, 0xf3ff, 0xe3de,
-  0x2462, 0x3443, 0x0420, 0x1401, 0x64e6, 0x74c7, 0x44a4, 0x5485,
-  0xa56a, 0xb54b, 0x8528, 0x9509, 0xe5ee, 0xf5cf, 0xc5ac, 0xd58d,
-  0x3653, 0x2672, 0x1611, 0x0630, 0x76d7, 0x66f6, 0x5695, 0x46b4,
-  0xb75b, 0xa77a, 0x9719, 0x8738, 0xf7df, 0xe7fe, 0xd79d, 0xc7bc,
-  0x48c4, 0x58e5, 0x6886, 0x78a7, 0x0840, 0x1861, 0x2802, 0x3823,
-  0xc9cc, 0xd9ed, 0xe98e, 0xf9af, 0x8948, 0x9969, 0xa90a, 0xb92b,
-  0x5af5, 0x4ad4, 0x7ab7, 0x6a96, 0x1a71, 0x0a50, 0x3a33, 0x2a12,
-  0xdbfd, 0xcbdc, 0xfbbf, 0xeb9e, 0x9b79, 0x8b58, 0xbb3b, 0xab1a,
-  0x6ca6, 0x7c87, 0x4ce4, 0x5cc5, 0x2c22, 0x3c03, 0x0c60, 0x1c41,
-  0xedae, 0xfd8f, 0xcdec, 0xddcd, 0xad2a, 0xbd0b, 0x8d68, 0x9d49,
-  0x7e97, 0x6eb6, 0x5ed5, 0x4ef4, 0x3e13, 0x2e32, 0x1e51, 0x0e70,
-  0xff9f, 0xefbe, 0xdfdd, 0xcffc, 0xbf1b, 0xaf3a, 0x9f59, 0x8f78,
-  0x9188, 0x81a9, 0xb1ca, 0xa1eb, 0xd10c, 0xc12d, 0xf14e, 0xe16f,
-  0x1080, 0x00a1, 0x30c2, 0x20e3, 0x5004, 0x4025, 0x7046, 0x6067,
-  0x83b9, 0x9398, 0xa3fb, 0xb3da, 0xc33d, 0xd31c, 0xe37f, 0xf35e,
-  0x02b1, 0x1290, 0x22f3, 0x32d2, 0x4235, 0x5214, 0x6277, 0x7256,
-  0xb5ea, 0xa5cb, 0x95a8, 0x8589, 0xf56e, 0xe54f, 0xd52c, 0xc50d,
-  0x34e2, 0x24c3, 0x14a0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
-  0xa7db, 0xb7fa, 0x8799, 0x97b8, 0xe75f, 0xf77e, 0xc71d, 0xd73c,
-  0x26d3, 0x36f2, 0x0691, 0x16b0, 0x6657, 0x7676, 0x4615, 0x5634,
-  0xd94c, 0xc96d, 0xf90e, 0xe92f, 0x99c8, 0x89e9, 0xb98a, 0xa9ab,
-  0x5844, 0x4865, 0x7806, 0x6827, 0x18c0, 0x08e1, 0x3882, 0x28a3,
-  0xcb7d, 0xdb5c, 0xeb3f, 0xfb1e, 0x8bf9, 0x9bd8, 0xabbb, 0xbb9a,
-  0x4a75, 0x5a54, 0x6a37, 0x7a16, 0x0af1, 0x1ad0, 0x2ab3, 0x3a92,
-  0xfd2e, 0xed0f, 0xdd6c, 0xcd4d, 0xbdaa, 0xad8b, 0x9de8, 0x8dc9,
-  0x7c26, 0x6c07, 0x5c64, 0x4c45, 0x3ca2, 0x2c83, 0x1ce0, 0x0cc1,
-  0xef1f, 0xff3e, 0xcf5d, 0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8,
-  0x6e17, 0x7e36, 0x4e55, 0x5e74, 0x2e93, 0x3eb2, 0x0ed1, 0x1ef0
-};
-
-static inline uint16_t _crc_xmodem_update(uint16_t crc, uint8_t data)
+static inline uint16_t crc_xmodem_update(uint16_t crc, uint8_t data)
   __attribute__((always_inline));
 
 static inline uint16_t
-_crc_xmodem_update(uint16_t crc, uint8_t data)
+crc_xmodem_update(uint16_t crc, uint8_t data)
 {
-  return (pgm_read_word(&crctab[((crc >> 8) ^ data) & 0Xff]) ^ (crc << 8));
-}
-
+#if defined(USE_CRCTAB)
+  return (CRC::XModem::table(crc, data));
 #else
-#include <util/crc16.h>
+  return (CRC::XModem::update(crc, data));
 #endif
+}
 
 uint8_t
 SD::send(CMD command, uint32_t arg)
@@ -160,6 +125,16 @@ SD::await(uint16_t ms, uint8_t token)
   return (false);
 }
 
+bool
+SD::await_ready(uint16_t ms)
+{
+  uint16_t start = RTT::millis();
+  do {
+    if (spi.transfer(0xff) == 0xff) return (true);
+  } while (((uint16_t) RTT::millis()) - start < ms);
+  return (false);
+}
+
 uint32_t
 SD::receive()
 {
@@ -180,42 +155,120 @@ SD::receive()
 }
 
 bool
-SD::read(CMD command, uint32_t arg, void* buf, size_t count)
+SD::receive(void* buf, size_t count)
 {
   uint8_t* dst = (uint8_t*) buf;
   uint16_t crc = 0;
-  bool res = false;
   uint8_t data;
 
+  // Wait for start of data block
+  if (!await(READ_TIMEOUT, DATA_START_BLOCK)) return (false);
+
+#if defined(USE_SPI_PREFETCH)
+  spi.transfer_start(0xff);
+  while (--count) {
+    data = spi.transfer_next(0xff);
+    *dst++ = data;
+    crc = crc_xmodem_update(crc, data);
+  }
+  data = spi.transfer_await();
+  *dst = data;
+  crc = crc_xmodem_update(crc, data);
+#else
+  do {
+    data = spi.transfer(0xff);
+    *dst++ = data;
+    crc = crc_xmodem_update(crc, data);
+  } while (--count);
+#endif
+
+  // Receive the check sum and check
+  crc = crc_xmodem_update(crc, spi.transfer(0xff));
+  crc = crc_xmodem_update(crc, spi.transfer(0xff));
+  return (crc == 0);
+}
+
+bool
+SD::transmit(uint8_t token, const uint8_t* src)
+{
+  uint16_t crc = 0;
+  uint16_t count = BLOCK_MAX;
+  uint8_t status;
+  uint8_t data;
+
+  // Transfer token and block, calculate check sum
+  spi.transfer(token);
+
+#if defined(USE_SPI_PREFETCH)
+  data = *src++;
+  spi.transfer_start(data);
+  while (--count) {
+    crc = crc_xmodem_update(crc, data);
+    data = *src++;
+    spi.transfer_await();
+    spi.transfer_start(data);
+  }
+  crc = crc_xmodem_update(crc, data);
+  spi.transfer_await();
+#else
+  do {
+    data = *src++;
+    spi.transfer(data);
+    crc = crc_xmodem_update(crc, data);
+  } while (--count);
+#endif
+
+  // Transfer the check sum and receive data response token and check status
+  spi.transfer(crc >> 8);
+  spi.transfer(crc);
+  status = spi.transfer(0xff);
+  return ((status & DATA_RES_MASK) == DATA_RES_ACCEPTED);
+}
+
+bool
+SD::read(CMD command, uint32_t arg, void* buf, size_t count)
+{
+  bool res = false;
+
+  // Complete any asynchronous write
+  if (UNLIKELY(m_busy)) write_await();
+
   // Issue read command and receive data into buffer
   spi.acquire(this);
     spi.begin();
       if (send(command, arg)) goto error;
-      if (!await(READ_TIMEOUT, DATA_START_BLOCK)) goto error;
+      res = receive(buf, count);
+ error:
+    spi.end();
+  spi.release();
+  return (res);
+}
 
-#if defined(USE_SPI_PREFETCH)
-      spi.transfer_start(0xff);
-      while (--count) {
-	data = spi.transfer_next(0xff);
-	*dst++ = data;
-	crc = _crc_xmodem_update(crc, data);
-      }
-      data = spi.transfer_await();
-      *dst = data;
-      crc = _crc_xmodem_update(crc, data);
-#else
-      do {
-	uint8_t data = spi.transfer(0xff);
-	*dst++ = data;
-	crc = _crc_xmodem_update(crc, data);
-      } while (--count);
-#endif
+bool
+SD::read(uint32_t block, uint8_t* dst, size_t count)
+{
+  bool res = false;
 
-      // Receive the check sum and check
-      crc = _crc_xmodem_update(crc, spi.transfer(0xff));
-      crc = _crc_xmodem_update(crc, spi.transfer(0xff));
-      res = (crc == 0);
+  // Use single block read for a single block
+  if (count == 1) return (read(block, dst));
+
+  // Complete any asynchronous write
+  if (UNLIKELY(m_busy)) write_await();
+
+  // Check for byte address adjustment
+  if (m_type != TYPE_SDHC) block <<= 9;
 
+  // Issue read multiple block command and receive blocks. Stop the
+  // transmission also on error
+  spi.acquire(this);
+    spi.begin();
+      if (send(READ_MULTIPLE_BLOCK, block)) goto error;
+      while (count && receive(dst, BLOCK_MAX)) {
+	dst += BLOCK_MAX;
+	count -= 1;
+      }
+      if (send(STOP_TRANSMISSION)) goto error;
+      res = (count == 0);
  error:
     spi.end();
   spi.release();
@@ -290,6 +343,9 @@ SD::erase(uint32_t start, uint32_t end)
 {
   bool res = false;
 
+  // Complete any asynchronous write
+  if (UNLIKELY(m_busy)) write_await();
+
   // Check if block address should be mapped to byte address
   if (m_type != TYPE_SDHC) {
     start <<= 9;
@@ -313,45 +369,20 @@ SD::erase(uint32_t start, uint32_t end)
 bool
 SD::write(uint32_t block, const uint8_t* src)
 {
-  uint16_t crc = 0;
-  uint16_t count = BLOCK_MAX;
   uint8_t status;
-  uint8_t data;
   bool res = false;
 
+  // Complete any asynchronous write
+  if (UNLIKELY(m_busy)) write_await();
+
   // Check for byte address adjustment
   if (m_type != TYPE_SDHC) block <<= 9;
 
-  // Issue write block command, transfer block, calculate check sum
+  // Issue write block command and transfer block
   spi.acquire(this);
     spi.begin();
       if (send(WRITE_BLOCK, block)) goto error;
-      spi.transfer(DATA_START_BLOCK);
-
-#if defined(USE_SPI_PREFETCH)
-      data = *src++;
-      spi.transfer_start(data);
-      while (--count) {
-	crc = _crc_xmodem_update(crc, data);
-	data = *src++;
-	spi.transfer_await();
-	spi.transfer_start(data);
-      }
-      crc = _crc_xmodem_update(crc, data);
-      spi.transfer_await();
-#else
-      do {
-	data = *src++;
-	spi.transfer(data);
-	crc = _crc_xmodem_update(crc, data);
-      } while (--count);
-#endif
-
-      // Transfer the check sum and receive data response token and check status
-      spi.transfer(crc >> 8);
-      spi.transfer(crc);
-      status = spi.transfer(0xff);
-      if ((status & DATA_RES_MASK) != DATA_RES_ACCEPTED) goto error;
+      if (!transmit(DATA_START_BLOCK, src)) goto error;
 
       // Wait for the write operation to complete and check status
       if (!await(WRITE_TIMEOUT)) goto error;
@@ -366,3 +397,115 @@ SD::write(uint32_t block, const uint8_t* src)
   return (res);
 }
 
+bool
+SD::write(uint32_t block, const uint8_t* src, size_t count)
+{
+  uint8_t status;
+  bool res = false;
+
+  // Use single block write for a single block
+  if (count == 1) return (write(block, src));
+
+  // Complete any asynchronous write
+  if (UNLIKELY(m_busy)) write_await();
+
+  // Check for byte address adjustment
+  if (m_type != TYPE_SDHC) block <<= 9;
+
+  // Pre-erase the blocks and issue write multiple block command.
+  // Transfer blocks and wait for each to be programmed. Stop the
+  // transmission also on error
+  spi.acquire(this);
+    spi.begin();
+      if (send(SET_WR_BLK_ERASE_COUNT, count)) goto error;
+      if (send(WRITE_MULTIPLE_BLOCK, block)) goto error;
+      while (count && transmit(WRITE_MULTIPLE_TOKEN, src)) {
+	if (!await_ready(WRITE_TIMEOUT)) break;
+	src += BLOCK_MAX;
+	count -= 1;
+      }
+      spi.transfer(STOP_TRAN_TOKEN);
+      spi.transfer(0xff);
+      if (!await_ready(WRITE_TIMEOUT)) goto error;
+      if (count != 0) goto error;
+
+      // Check status
+      status = send(SEND_STATUS);
+      if (status != 0) goto error;
+      status = spi.transfer(0xff);
+      res = (status == 0);
+
+ error:
+    spi.end();
+  spi.release();
+  return (res);
+}
+
+bool
+SD::write_request(uint32_t block, const uint8_t* src)
+{
+  bool res = false;
+
+  // Complete any asynchronous write
+  if (UNLIKELY(m_busy)) write_await();
+
+  // Check for byte address adjustment
+  if (m_type != TYPE_SDHC) block <<= 9;
+
+  // Issue write block command and transfer block. The card is
+  // deselected while programming
+  spi.acquire(this);
+    spi.begin();
+      if (send(WRITE_BLOCK, block)) goto error;
+      if (!transmit(DATA_START_BLOCK, src)) goto error;
+      m_start = RTT::millis();
+      m_busy = true;
+      res = true;
+ error:
+    spi.end();
+  spi.release();
+  return (res);
+}
+
+bool
+SD::is_busy()
+{
+  if (!m_busy) return (false);
+  bool res = false;
+  uint8_t status;
+
+  // Check if the card is still programming; release the bus if busy
+  spi.acquire(this);
+    spi.begin();
+      if (spi.transfer(0xff) != 0xff) {
+	if (RTT::since(m_start) < WRITE_TIMEOUT) {
+	  spi.end();
+	  spi.release();
+	  return (true);
+	}
+	goto error;
+      }
+
+      // Check status of completed write
+      status = send(SEND_STATUS);
+      if (status != 0) goto error;
+      status = spi.transfer(0xff);
+      res = (status == 0);
+ error:
+    spi.end();
+  spi.release();
+
+  // Signal completion
+  m_result = res;
+  m_busy = false;
+  if (m_event_handler != NULL)
+    Event::push(Event::WRITE_COMPLETED_TYPE, m_event_handler, res);
+  return (false);
+}
+
+bool
+SD::write_await()
+{
+  while (is_busy()) yield();
+  return (m_result);
+}
@@ -23,6 +23,8 @@
 
 #include "Cosa/Types.h"
 #include "Cosa/SPI.hh"
+#include "Cosa/Event.hh"
+#include "Cosa/Periodic.hh"
 
 /**
  * Cosa SD low-level device driver class. Implements disk driver
@@ -313,6 +315,18 @@ protected:
   /** Detected card type. */
   CARD m_type;
 
+  /** Asynchronous write in progress. */
+  volatile bool m_busy;
+
+  /** Result of latest asynchronous write. */
+  bool m_result;
+
+  /** Start time of asynchronous write (ms). */
+  uint32_t m_start;
+
+  /** Asynchronous write completed event handler. */
+  Event::Handler* m_event_handler;
+
   /**
    * Send given command and argument. Returns R1 response byte.
    * @param[in] command to send.
@@ -361,12 +375,40 @@ protected:
    */
   bool await(uint16_t ms = 0, uint8_t token = 0);
 
+  /**
+   * Wait for the card to complete programming, i.e. not busy. Wait for
+   * at most given period in milli-seconds. Return true if the card is
+   * ready otherwise false if the time limit was exceeded.
+   * @param[in] ms timeout period in number of milli-seconds.
+   * @return bool.
+   */
+  bool await_ready(uint16_t ms);
+
   /**
    * Receive 32-bit response from device.
    * @return long reponse.
    */
   uint32_t receive();
 
+  /**
+   * Await data start token and receive data block into given buffer
+   * with given number of bytes. Returns true if successful and the
+   * check sum is correct otherwise false.
+   * @param[in] buf pointer to buffer for data.
+   * @param[in] count number of bytes.
+   * @return bool.
+   */
+  bool receive(void* buf, size_t count);
+
+  /**
+   * Transmit given token and source buffer with BLOCK_MAX bytes.
+   * Returns true if the data block was accepted otherwise false.
+   * @param[in] token data start token.
+   * @param[in] src pointer to source buffer.
+   * @return bool.
+   */
+  bool transmit(uint8_t token, const uint8_t* src);
+
   /**
    * Send given command and argument and transfer data response into
    * given buffer with given number of bytes. Returns true if
@@ -388,17 +430,29 @@ public:
 #if defined(BOARD_ATTINYX5)
   SD(Board::DigitalPin csn = Board::D3) :
     SPI::Driver(csn, SPI::ACTIVE_LOW, SPI::DIV128_CLOCK, 0, SPI::MSB_ORDER, NULL),
-    m_type(TYPE_UNKNOWN)
+    m_type(TYPE_UNKNOWN),
+    m_busy(false),
+    m_result(true),
+    m_start(0L),
+    m_event_handler(NULL)
   {}
 #elif defined(WICKEDDEVICE_WILDFIRE)
   SD(Board::DigitalPin csn = Board::D16) :
     SPI::Driver(csn, SPI::ACTIVE_LOW, SPI::DIV128_CLOCK, 0, SPI::MSB_ORDER, NULL),
-    m_type(TYPE_UNKNOWN)
+    m_type(TYPE_UNKNOWN),
+    m_busy(false),
+    m_result(true),
+    m_start(0L),
+    m_event_handler(NULL)
   {}
 #else
   SD(Board::DigitalPin csn = Board::D8) :
     SPI::Driver(csn, SPI::ACTIVE_LOW, SPI::DIV128_CLOCK, 0, SPI::MSB_ORDER, NULL),
-    m_type(TYPE_UNKNOWN)
+    m_type(TYPE_UNKNOWN),
+    m_busy(false),
+    m_result(true),
+    m_start(0L),
+    m_event_handler(NULL)
   {}
 #endif
 
@@ -450,6 +504,18 @@ public:
     return (read(READ_SINGLE_BLOCK, block, dst, BLOCK_MAX));
   }
 
+  /**
+   * Read given number of consecutive blocks, starting with given
+   * block, into given destination buffer. The buffer must be able to
+   * hold count * BLOCK_MAX bytes. Uses a single multiple block read
+   * command. Returns true if successful otherwise false.
+   * @param[in] block address.
+   * @param[in] dst pointer to destination buffer.
+   * @param[in] count number of blocks.
+   * @return bool.
+   */
+  bool read(uint32_t block, uint8_t* dst, size_t count);
+
   /**
    * Read card CID register. The CID contains card identification
    * information such as Manufacturer ID, Product name, Product serial
@@ -483,6 +549,88 @@ public:
    * @return bool.
    */
   bool write(uint32_t block, const uint8_t* src);
+
+  /**
+   * Write given number of blocks from given source buffer to
+   * consecutive blocks starting with given block. The blocks are
+   * pre-erased and written with a single multiple block write
+   * command. Returns true if successful otherwise false.
+   * @param[in] block address.
+   * @param[in] src pointer to source buffer.
+   * @param[in] count number of blocks.
+   * @return bool.
+   */
+  bool write(uint32_t block, const uint8_t* src, size_t count);
+
+  /**
+   * Start write of given source buffer with BLOCK_MAX bytes to the
+   * given block. Returns when the block has been transferred to the
+   * card; the buffer may be reused directly (double buffering) while
+   * the card is programming. Waits for any previous asynchronous
+   * write to complete. Completion is detected with is_busy(),
+   * write_await() or a Poller. Returns true if the block was accepted
+   * otherwise false.
+   * @param[in] block address.
+   * @param[in] src pointer to source buffer.
+   * @return bool.
+   */
+  bool write_request(uint32_t block, const uint8_t* src);
+
+  /**
+   * Poll the busy state of an asynchronous write. Returns true while
+   * the card is programming otherwise false. On completion the write
+   * status is checked and a WRITE_COMPLETED_TYPE event, with the
+   * result as value, is pushed to the event handler (if any).
+   * @return bool.
+   */
+  bool is_busy();
+
+  /**
+   * Wait for the latest asynchronous write to complete. Returns true
+   * if the write was successful otherwise false.
+   * @return bool.
+   */
+  bool write_await();
+
+  /**
+   * Set handler for asynchronous write completed events.
+   * @param[in] handler event handler (or NULL).
+   */
+  void event_handler(Event::Handler* handler)
+  {
+    m_event_handler = handler;
+  }
+
+  /**
+   * Periodic job to poll the busy state of asynchronous writes.
+   */
+  class Poller : public Periodic {
+  public:
+    /**
+     * Construct polling job for given device with given period in
+     * the scheduler time base.
+     * @param[in] scheduler for the periodic job.
+     * @param[in] sd device.
+     * @param[in] period between polls.
+     */
+    Poller(Job::Scheduler* scheduler, SD* sd, uint32_t period) :
+      Periodic(scheduler, period),
+      m_sd(sd)
+    {}
+
+    /**
+     * @override{Periodic}
+     * Poll the device busy state.
+     */
+    virtual void run()
+    {
+      m_sd->is_busy();
+    }
+
+  protected:
+    /** Device to poll. */
+    SD* m_sd;
+  };
 };
 
 #endif
@@ -0,0 +1,135 @@
+/**
+ * @file CosaSDlogger.ino
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * @section Description
+ * Cosa SD asynchronous block write demonstration; double buffered
+ * raw block logging of analog samples. One buffer is filled with
+ * samples while the other is programmed by the card. The busy state
+ * is polled by a periodic job and completion is signaled with a
+ * write completed event. Prints number of blocks written, errors and
+ * max time waiting for the card per block.
+ *
+ * @section Warning
+ * The sketch writes raw blocks from START_BLOCK and will destroy any
+ * file system on the card.
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#include <SD.h>
+
+#include "Cosa/AnalogPin.hh"
+#include "Cosa/RTT.hh"
+#include "Cosa/Trace.hh"
+#include "Cosa/UART.hh"
+#include "Cosa/Watchdog.hh"
+
+//#define USE_SD_ADAPTER
+#define USE_SD_DATA_LOGGING_SHIELD
+//#define USE_ETHERNET_SHIELD
+//#define USE_TFT_ST7735
+
+#if defined(WICKEDDEVICE_WILDFIRE) || defined(USE_SD_ADAPTER)
+SD sd;
+
+#elif defined(USE_ETHERNET_SHIELD)
+SD sd(Board::D4);
+OutputPin eth(Board::D10, 1);
+
+#elif defined(USE_TFT_ST7735)
+SD sd;
+OutputPin tft(Board::D10, 1);
+
+#elif defined(USE_SD_DATA_LOGGING_SHIELD)
+SD sd(Board::D10);
+#endif
+
+#define CLOCK SPI::DIV2_CLOCK
+
+// Raw block region and number of blocks to log
+static const uint32_t START_BLOCK = 1024;
+static const uint16_t BLOCK_COUNT = 256;
+
+// Poll the card busy state every 500 us
+RTT::Scheduler scheduler;
+SD::Poller poller(&scheduler, &sd, 500);
+
+// Count completed writes and errors
+class Logger : public Event::Handler {
+public:
+  Logger() : m_completed(0), m_errors(0) {}
+
+  virtual void on_event(uint8_t type, uint16_t value)
+  {
+    if (type != Event::WRITE_COMPLETED_TYPE) return;
+    m_completed += 1;
+    if (!value) m_errors += 1;
+  }
+
+  uint16_t m_completed;
+  uint16_t m_errors;
+};
+
+Logger logger;
+AnalogPin sensor(Board::A0);
+
+// Double buffer; one is filled while the other is programmed
+static uint16_t buf[2][SD::BLOCK_MAX / sizeof(uint16_t)];
+
+void setup()
+{
+  Watchdog::begin();
+  RTT::begin();
+  uart.begin(9600);
+  trace.begin(&uart, PSTR("CosaSDlogger: started"));
+  ASSERT(sd.begin(CLOCK));
+  sd.event_handler(&logger);
+  poller.start();
+}
+
+void loop()
+{
+  uint32_t start = RTT::millis();
+  uint32_t us, max = 0;
+  uint8_t current = 0;
+
+  for (uint16_t block = 0; block < BLOCK_COUNT; block++) {
+    // Fill the current buffer while the card programs the other
+    for (uint16_t i = 0; i < membersof(buf[current]); i++) {
+      Event event;
+      buf[current][i] = sensor.sample();
+      if (Event::queue.dequeue(&event)) event.dispatch();
+    }
+
+    // Start write of the filled buffer and swap buffers
+    us = RTT::micros();
+    ASSERT(sd.write_request(START_BLOCK + block, (uint8_t*) buf[current]));
+    us = RTT::since(us);
+    if (us > max) max = us;
+    current ^= 1;
+  }
+  sd.write_await();
+  while (Event::service(1));
+  uint32_t ms = RTT::since(start);
+
+  trace << PSTR("blocks:") << logger.m_completed
+	<< PSTR(", errors:") << logger.m_errors
+	<< PSTR(", ") << ms << PSTR(" ms, max request ")
+	<< max << PSTR(" us")
+	<< endl;
+  ASSERT(true == false);
+}
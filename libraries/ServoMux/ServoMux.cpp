@@ -0,0 +1,190 @@
+/**
+ * @file ServoMux.cpp
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#include "Cosa/Board.hh"
+#if !defined(BOARD_ATTINYX5)
+#include "ServoMux.hh"
+
+ServoMux::Channel* ServoMux::s_channel[CHANNEL_MAX];
+uint8_t ServoMux::s_channels = 0;
+ServoMux::schedule_t ServoMux::s_schedule[2];
+ServoMux::schedule_t* volatile ServoMux::s_active = &ServoMux::s_schedule[0];
+volatile bool ServoMux::s_pending = false;
+volatile uint8_t ServoMux::s_next = 0;
+
+#define US_TO_TICKS(us) ((I_CPU * (us)) / 8)
+
+/**
+ * Edges closer than this are handled in the same interrupt; the
+ * compare register could otherwise be passed before it is updated.
+ */
+#define MIN_TICKS US_TO_TICKS(12)
+
+ServoMux::Channel::Channel(Board::DigitalPin pin) :
+  OutputPin(pin),
+  m_min(MIN_WIDTH),
+  m_max(MAX_WIDTH)
+{
+  angle(INIT_ANGLE);
+  if (s_channels < CHANNEL_MAX) s_channel[s_channels++] = this;
+}
+
+void
+ServoMux::Channel::angle(uint8_t degree)
+{
+  if (UNLIKELY(degree > 180)) degree = 180;
+  uint16_t width = (((uint32_t) (m_max - m_min)) * degree) / 180L;
+  m_width = m_min + width;
+  m_angle = degree;
+}
+
+bool
+ServoMux::begin()
+{
+  // The committed schedule is swapped in by the first interrupt
+  if (UNLIKELY(!commit())) return (false);
+  synchronized {
+    s_next = 0;
+    TCCR1A = 0;
+    TCCR1B = _BV(CS11);
+    TCNT1 = 0;
+    OCR1A = US_TO_TICKS(PERIOD);
+    TIMSK1 |= _BV(OCIE1A);
+  }
+  return (true);
+}
+
+bool
+ServoMux::end()
+{
+  synchronized {
+    TIMSK1 &= ~_BV(OCIE1A);
+    for (uint8_t i = 0; i < s_channels; i++)
+      s_channel[i]->_clear();
+  }
+  return (true);
+}
+
+bool
+ServoMux::commit()
+{
+  // Retract any pending schedule; the back buffer is not used by
+  // the interrupt handler until it is marked pending again
+  synchronized s_pending = false;
+  schedule_t* schedule = &s_schedule[s_active == &s_schedule[0]];
+
+  // Sort channels on pulse width (insertion sort, small n)
+  uint8_t order[CHANNEL_MAX];
+  for (uint8_t i = 0; i < s_channels; i++) {
+    uint16_t width = s_channel[i]->m_width;
+    uint8_t j = i;
+    for (; j > 0 && s_channel[order[j - 1]]->m_width > width; j--)
+      order[j] = order[j - 1];
+    order[j] = i;
+  }
+
+  // Compile frame start port masks and the falling edges. Channels
+  // on the same port with (nearly) the same width share an edge.
+  // An edge too close to the previous on another port fires together
+  // with it; the time base (last) is then not advanced
+  schedule->ports = 0;
+  schedule->edges = 0;
+  uint16_t last = 0;
+  for (uint8_t i = 0; i < s_channels; i++) {
+    Channel* channel = s_channel[order[i]];
+    volatile uint8_t* port = channel->PORT();
+    uint8_t mask = channel->m_mask;
+    uint8_t p = 0;
+    while (p < schedule->ports && schedule->port[p].port != port) p++;
+    if (p == schedule->ports) {
+      if (UNLIKELY(p == PORT_MAX)) return (false);
+      schedule->port[p].port = port;
+      schedule->port[p].mask = 0;
+      schedule->ports += 1;
+    }
+    schedule->port[p].mask |= mask;
+    uint16_t ticks = US_TO_TICKS(channel->m_width);
+    if (schedule->edges == 0) {
+      schedule->first = ticks;
+      last = ticks;
+    }
+    else {
+      edge_t* prev = &schedule->edge[schedule->edges - 1];
+      uint16_t delta = ticks - last;
+      if (delta < MIN_TICKS) {
+	if (prev->port == port) {
+	  prev->mask |= mask;
+	  continue;
+	}
+	delta = 0;
+      }
+      prev->delta = delta;
+      if (delta != 0) last = ticks;
+    }
+    edge_t* edge = &schedule->edge[schedule->edges++];
+    edge->port = port;
+    edge->mask = mask;
+  }
+
+  // The last edge waits for the start of the next frame
+  if (schedule->edges == 0)
+    schedule->first = US_TO_TICKS(PERIOD);
+  else
+    schedule->edge[schedule->edges - 1].delta = US_TO_TICKS(PERIOD) - last;
+
+  // Hand over to the interrupt handler at next frame start
+  synchronized s_pending = true;
+  return (true);
+}
+
+ISR(TIMER1_COMPA_vect)
+{
+  uint8_t next = ServoMux::s_next;
+  ServoMux::schedule_t* schedule = ServoMux::s_active;
+
+  // Frame start; swap in any pending schedule and set channel pins
+  if (next == 0) {
+    if (ServoMux::s_pending) {
+      schedule = &ServoMux::s_schedule[schedule == &ServoMux::s_schedule[0]];
+      ServoMux::s_active = schedule;
+      ServoMux::s_pending = false;
+    }
+    ServoMux::port_t* port = schedule->port;
+    for (uint8_t i = 0; i < schedule->ports; i++, port++)
+      *port->port |= port->mask;
+    OCR1A += schedule->first;
+    if (schedule->edges != 0) ServoMux::s_next = 1;
+    return;
+  }
+
+  // Falling edge; clear pins and step to the next edge
+  ServoMux::edge_t* edge = &schedule->edge[next - 1];
+  uint16_t delta;
+  do {
+    *edge->port &= ~edge->mask;
+    delta = edge->delta;
+    edge++;
+    next++;
+  } while (delta == 0 && next <= schedule->edges);
+  OCR1A += delta;
+  ServoMux::s_next = (next > schedule->edges) ? 0 : next;
+}
+
+#endif
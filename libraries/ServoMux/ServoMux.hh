@@ -0,0 +1,198 @@
+/**
+ * @file ServoMux.hh
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#ifndef COSA_SERVO_MUX_HH
+#define COSA_SERVO_MUX_HH
+
+#include "Cosa/Types.h"
+#include "Cosa/OutputPin.hh"
+
+/**
+ * Multiplexed servo motor driver. Drives up to CHANNEL_MAX servos
+ * from Timer#1 and a single compare output register. All channel
+ * pins are set at the start of the 20 ms frame and cleared in order
+ * of increasing pulse width. The pulse schedule is sorted and
+ * compiled in the foreground by commit() so that the compare
+ * interrupt handler only has to clear a pre-computed pin mask and
+ * advance the compare register per edge.
+ *
+ * Position updates are staged with Channel::angle() and become
+ * visible to the interrupt handler with commit(). The schedule is
+ * double-buffered and swapped at the start of a frame so all staged
+ * updates take effect in the same frame.
+ *
+ * @section Limitations
+ * Cannot be used together with other classes that use Timer#1
+ * (Servo, Tone, VWI).
+ */
+class ServoMux {
+public:
+  /** Max number of servo channels. */
+  static const uint8_t CHANNEL_MAX = 18;
+
+  /**
+   * Servo channel; output pin and pulse width.
+   */
+  class Channel : private OutputPin {
+  public:
+    /**
+     * Construct servo channel connected to the given pin and register
+     * with the multiplexer. Default angle is 90 degree.
+     * @param[in] pin digital pin to use as servo control output pin.
+     */
+    Channel(Board::DigitalPin pin);
+
+    /**
+     * Set pulse limits; min and max number of micro seconds.
+     * These will correspond to angle 0 and 180.
+     * @param[in] min number of micro seconds.
+     * @param[in] max number of micro seconds.
+     */
+    void pulse(uint16_t min, uint16_t max)
+      __attribute__((always_inline))
+    {
+      m_min = min;
+      m_max = max;
+    }
+
+    /**
+     * Return staged pulse width in micro seconds.
+     * @return pulse width.
+     */
+    uint16_t width() const
+    {
+      return (m_width);
+    }
+
+    /**
+     * Stage servo angle. The new position is used after the next
+     * call of ServoMux::commit().
+     * @param[in] degree angle, 0..180.
+     */
+    void angle(uint8_t degree);
+
+    /**
+     * Return staged servo angle.
+     * @return angle in degree, 0..180.
+     */
+    uint8_t angle() const
+    {
+      return (m_angle);
+    }
+
+  private:
+    /** Min/Max/Width of pulse, angle. */
+    uint16_t m_min;
+    uint16_t m_max;
+    uint16_t m_width;
+    uint8_t m_angle;
+
+    friend class ServoMux;
+  };
+
+  /**
+   * Start servo multiplexer; commit the current channel positions
+   * and enable interrupt handler. The schedule is activated at the
+   * first frame start.
+   * @return true(1) if successful otherwise false(0).
+   */
+  static bool begin();
+
+  /**
+   * Stop servo multiplexer; disable interrupt handler and clear
+   * channel pins.
+   */
+  static bool end();
+
+  /**
+   * Sort the staged channel pulse widths and compile a new schedule.
+   * The schedule is used from the start of the next frame. Should be
+   * called after updating one or more channel angles. Returns false
+   * and keeps the current schedule if the channels are on more than
+   * PORT_MAX ports.
+   * @return true(1) if successful otherwise false(0).
+   */
+  static bool commit();
+
+  /**
+   * Return number of registered channels.
+   * @return channels.
+   */
+  static uint8_t channels()
+  {
+    return (s_channels);
+  }
+
+private:
+  /** Configuration. */
+  static const uint16_t PERIOD = 20000;
+  static const uint16_t MIN_WIDTH = 650;
+  static const uint16_t MAX_WIDTH = 2300;
+  static const uint8_t INIT_ANGLE = 90;
+
+  /** Max number of ports in the frame start mask list. */
+  static const uint8_t PORT_MAX = 4;
+
+  /** Port register and pin mask. */
+  struct port_t {
+    volatile uint8_t* port;
+    uint8_t mask;
+  };
+
+  /**
+   * Schedule edge; port pins to clear and timer ticks to the next
+   * edge. A zero delta will handle the next edge in the same
+   * interrupt.
+   */
+  struct edge_t {
+    volatile uint8_t* port;
+    uint8_t mask;
+    uint16_t delta;
+  };
+
+  /**
+   * Compiled frame schedule; pins to set at frame start, ticks to
+   * first falling edge and sorted falling edges.
+   */
+  struct schedule_t {
+    port_t port[PORT_MAX];
+    uint8_t ports;
+    uint16_t first;
+    uint8_t edges;
+    edge_t edge[CHANNEL_MAX];
+  };
+
+  /** Registered channels. */
+  static Channel* s_channel[CHANNEL_MAX];
+  static uint8_t s_channels;
+
+  /** Double-buffered schedule. */
+  static schedule_t s_schedule[2];
+  static schedule_t* volatile s_active;
+  static volatile bool s_pending;
+
+  /** Next edge index; zero(0) for frame start. */
+  static volatile uint8_t s_next;
+
+  /** Interrupt Service Routine. */
+  friend void TIMER1_COMPA_vect(void);
+};
+
+#endif
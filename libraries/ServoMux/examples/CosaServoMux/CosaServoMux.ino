@@ -0,0 +1,73 @@
+/**
+ * @file CosaServoMux.ino
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * @section Description
+ * Demonstration of the multiplexed Servo control class; twelve
+ * servos (e.g. the legs of a hexapod) driven from Timer#1.
+ *
+ * @section Circuit
+ * @code
+ *                       Servo#0..11
+ *                       +------------+
+ * (D2..D13)-----------1-|PULSE   I   |
+ * (VCC)---------------2-|VCC   ==o== |
+ * (GND)---------------3-|GND     I   |
+ *                       +------------+
+ * @endcode
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#include <ServoMux.h>
+#include "Cosa/Watchdog.hh"
+
+ServoMux::Channel leg[] = {
+  Board::D2, Board::D3, Board::D4, Board::D5,
+  Board::D6, Board::D7, Board::D8, Board::D9,
+  Board::D10, Board::D11, Board::D12, Board::D13
+};
+
+const uint8_t LEGS = membersof(leg);
+
+void setup()
+{
+  // Start watchdog for delay timing
+  Watchdog::begin();
+
+  // Set initial angle and start servo multiplexer
+  for (uint8_t i = 0; i < LEGS; i++) leg[i].angle(10 + i * 10);
+  ServoMux::begin();
+}
+
+void loop()
+{
+  static int degree = 10;
+  static int inc = 10;
+
+  // Sweep all servos with a phase shift; positions are committed
+  // together and take effect in the same frame
+  for (uint8_t i = 0; i < LEGS; i++) {
+    int pos = degree + i * 10;
+    if (pos > 170) pos = 340 - pos;
+    leg[i].angle(pos);
+  }
+  ServoMux::commit();
+  delay(128);
+
+  degree += inc;
+  if (degree >= 170 || degree <= 10) inc = -inc;
+}
@@ -0,0 +1,165 @@
+/**
+ * @file Settings.cpp
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#include "Settings.hh"
+#include "Cosa/CRC.hh"
+
+uint8_t
+Settings::checksum(const header_t* header, const uint8_t* value)
+{
+  uint8_t crc = CRC::Dallas::update(CRC_SEED, header,
+				     offsetof(header_t, crc));
+  return (CRC::Dallas::update(crc, value, header->len));
+}
+
+bool
+Settings::begin()
+{
+  if (UNLIKELY(m_slots <= m_keys)) return (false);
+
+  // Reset the cache
+  for (uint8_t key = 0; key < m_keys; key++)
+    m_entry[key].state = EMPTY;
+  m_head = m_slots - 1;
+  m_seq = 0;
+
+  // Scan all slots and keep the latest valid record for each key
+  uint8_t buf[sizeof(header_t) + VALUE_LIMIT];
+  header_t* header = (header_t*) buf;
+  uint8_t* value = buf + sizeof(header_t);
+  bool found = false;
+  for (uint16_t slot = 0; slot < m_slots; slot++) {
+    if (m_eeprom.read(buf, slot_addr(slot), m_slot_size) != m_slot_size)
+      return (false);
+    if (header->key >= m_keys || header->len > m_value_max) continue;
+    if (header->crc != checksum(header, value)) continue;
+    if (!found || is_later(header->seq, m_seq)) {
+      m_seq = header->seq;
+      m_head = slot;
+      found = true;
+    }
+    entry_t* entry = &m_entry[header->key];
+    if (entry->state != EMPTY && !is_later(header->seq, entry->seq))
+      continue;
+    entry->seq = header->seq;
+    entry->slot = slot;
+    entry->len = header->len;
+    entry->state = CLEAN;
+    memcpy(m_value + header->key * m_value_max, value, header->len);
+  }
+  return (true);
+}
+
+bool
+Settings::is_dirty() const
+{
+  for (uint8_t key = 0; key < m_keys; key++)
+    if (m_entry[key].state == DIRTY) return (true);
+  return (false);
+}
+
+int
+Settings::get(uint8_t key, void* buf, size_t size) const
+{
+  if (UNLIKELY(key >= m_keys)) return (EINVAL);
+  const entry_t* entry = &m_entry[key];
+  if (entry->state == EMPTY) return (ENOENT);
+  if (size > entry->len) size = entry->len;
+  memcpy(buf, m_value + key * m_value_max, size);
+  return (entry->len);
+}
+
+int
+Settings::put(uint8_t key, const void* buf, size_t size)
+{
+  if (UNLIKELY(key >= m_keys || size > m_value_max)) return (EINVAL);
+  entry_t* entry = &m_entry[key];
+  uint8_t* value = m_value + key * m_value_max;
+
+  // Coalesce; an unchanged value does not need to be written
+  if (entry->state != EMPTY
+      && entry->len == size
+      && !memcmp(value, buf, size))
+    return (size);
+  memcpy(value, buf, size);
+  entry->len = size;
+  entry->state = DIRTY;
+  return (size);
+}
+
+int
+Settings::flush()
+{
+  // Write dirty entries. Copying live records forward may mark
+  // further entries dirty; repeat until all are written
+  int res = 0;
+  bool dirty;
+  do {
+    dirty = false;
+    for (uint8_t key = 0; key < m_keys; key++) {
+      if (m_entry[key].state != DIRTY) continue;
+      if (UNLIKELY(!write_record(key))) return (EIO);
+      dirty = true;
+      res += 1;
+    }
+  } while (dirty);
+  return (res);
+}
+
+uint16_t
+Settings::next_slot()
+{
+  uint16_t slot = m_head;
+  while (1) {
+    if (++slot == m_slots) slot = 0;
+    uint8_t key = 0;
+    for (; key < m_keys; key++) {
+      entry_t* entry = &m_entry[key];
+      if (entry->state != EMPTY && entry->slot == slot) break;
+    }
+    if (key == m_keys) return (slot);
+
+    // Live record; leave in place and copy forward for wear leveling
+    if (m_entry[key].state == CLEAN) m_entry[key].state = DIRTY;
+  }
+}
+
+bool
+Settings::write_record(uint8_t key)
+{
+  entry_t* entry = &m_entry[key];
+  uint16_t slot = next_slot();
+  uint8_t buf[sizeof(header_t) + VALUE_LIMIT];
+  header_t* header = (header_t*) buf;
+  header->seq = m_seq + 1;
+  header->key = key;
+  header->len = entry->len;
+  memcpy(buf + sizeof(header_t), m_value + key * m_value_max, entry->len);
+  header->crc = checksum(header, buf + sizeof(header_t));
+  size_t size = sizeof(header_t) + entry->len;
+  if (m_eeprom.write(slot_addr(slot), buf, size) != (int) size)
+    return (false);
+  m_seq += 1;
+  m_head = slot;
+  entry->seq = m_seq;
+  entry->slot = slot;
+  entry->state = CLEAN;
+  return (true);
+}
@@ -0,0 +1,280 @@
+/**
+ * @file Settings.hh
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#ifndef COSA_SETTINGS_HH
+#define COSA_SETTINGS_HH
+
+#include "Cosa/Types.h"
+#include "Cosa/EEPROM.hh"
+
+/**
+ * Log-structured, wear-leveled key/value store for configuration
+ * settings and counters on an EEPROM::Device (internal EEPROM or
+ * AT24CXX). Values are kept in a RAM write-back cache; put() only
+ * updates the cache and repeated updates of a key are coalesced
+ * until flush(). Each flush appends a record per dirty key to the
+ * next free slot of a ring of fixed-size slots in the given EEPROM
+ * region. The slot of the latest record of a key is never
+ * overwritten; live records passed by the ring head are copied
+ * forward so that all cells in the region wear evenly.
+ *
+ * On begin() the region is scanned once and for each key the record
+ * with the latest sequence number (and valid checksum) is loaded
+ * into the cache. A write interrupted by power loss is detected by
+ * the checksum and the previous value of the key is recovered.
+ *
+ * @section Limitations
+ * The region must hold more slots than keys; twice the number of
+ * keys or more is recommended. Max 16K slots.
+ */
+class Settings {
+public:
+  /** Max value size supported by the record buffer. */
+  static const uint8_t VALUE_LIMIT = 32;
+
+  /**
+   * Recover latest values from the EEPROM region. Return true(1) if
+   * successful otherwise false(0).
+   * @return bool.
+   */
+  bool begin();
+
+  /**
+   * Write all dirty cache entries to the EEPROM region. Return number
+   * of records written or negative error code.
+   * @return number of records or negative error code.
+   */
+  int flush();
+
+  /**
+   * Return true(1) if there are cached values not yet written to the
+   * EEPROM region otherwise false(0).
+   * @return bool.
+   */
+  bool is_dirty() const;
+
+  /**
+   * Read value of given key into the given buffer with given max
+   * size. Return value size or negative error code(ENOENT if the
+   * key has no value, EINVAL if illegal key).
+   * @param[in] key identity.
+   * @param[in] buf buffer to read into.
+   * @param[in] size of buffer.
+   * @return size of value or negative error code.
+   */
+  int get(uint8_t key, void* buf, size_t size) const;
+
+  /**
+   * Write value of given key from given buffer with given size. The
+   * value is written to the cache and to the EEPROM region on
+   * flush(). An unchanged value will not mark the key as dirty.
+   * Return size or negative error code (EINVAL if illegal key or
+   * size).
+   * @param[in] key identity.
+   * @param[in] buf buffer with value.
+   * @param[in] size of value.
+   * @return size or negative error code.
+   */
+  int put(uint8_t key, const void* buf, size_t size);
+
+  /**
+   * Template function to read value of given key and type.
+   * @param[in] key identity.
+   * @param[out] value variable.
+   * @return size of value or negative error code.
+   */
+  template<class T> int get(uint8_t key, T* value) const
+  {
+    return (get(key, value, sizeof(T)));
+  }
+
+  /**
+   * Template function to write value of given key and type.
+   * @param[in] key identity.
+   * @param[in] value variable.
+   * @return size or negative error code.
+   */
+  template<class T> int put(uint8_t key, const T* value)
+  {
+    return (put(key, value, sizeof(T)));
+  }
+
+  /**
+   * Return number of slots in the EEPROM region.
+   * @return slots.
+   */
+  uint16_t slots() const
+  {
+    return (m_slots);
+  }
+
+protected:
+  /**
+   * Record header in EEPROM. Followed by the value (VALUE_MAX bytes
+   * slot space). Checksum is CRC-8 over header and value, seeded with
+   * CRC_SEED so that a zero-filled slot is not a valid record.
+   */
+  struct header_t {
+    uint16_t seq;		//!< Sequence number.
+    uint8_t key;		//!< Key identity.
+    uint8_t len;		//!< Value length.
+    uint8_t crc;		//!< Checksum.
+  };
+
+  /** Non-zero checksum seed. */
+  static const uint8_t CRC_SEED = 0xa5;
+
+  /** Cache entry state. */
+  enum {
+    EMPTY,			//!< No value.
+    CLEAN,			//!< Value is written to EEPROM.
+    DIRTY			//!< Value is not yet written.
+  } __attribute__((packed));
+
+  /**
+   * Cache entry; latest record sequence number, slot and value
+   * length.
+   */
+  struct entry_t {
+    uint16_t seq;		//!< Sequence number of record.
+    uint16_t slot;		//!< Slot of record.
+    uint8_t len;		//!< Value length.
+    uint8_t state;		//!< Cache state.
+  };
+
+  /**
+   * Construct settings store on given device, region and cache
+   * storage. Used by sub-class with cache storage.
+   * @param[in] dev eeprom device.
+   * @param[in] addr start address of region.
+   * @param[in] size of region in bytes.
+   * @param[in] entry cache entry vector.
+   * @param[in] value cache value buffer.
+   * @param[in] keys number of keys.
+   * @param[in] value_max max size of value.
+   */
+  Settings(EEPROM::Device* dev, uint16_t addr, uint16_t size,
+	   entry_t* entry, uint8_t* value,
+	   uint8_t keys, uint8_t value_max) :
+    m_eeprom(dev),
+    m_addr(addr),
+    m_slot_size(sizeof(header_t) + value_max),
+    m_slots(size / (sizeof(header_t) + value_max)),
+    m_entry(entry),
+    m_value(value),
+    m_keys(keys),
+    m_value_max(value_max),
+    m_head(0),
+    m_seq(0)
+  {}
+
+  /** Device access. */
+  EEPROM m_eeprom;
+
+  /** Region start address, slot size and number of slots. */
+  const uint16_t m_addr;
+  const uint8_t m_slot_size;
+  const uint16_t m_slots;
+
+  /** Cache entries and values. */
+  entry_t* const m_entry;
+  uint8_t* const m_value;
+  const uint8_t m_keys;
+  const uint8_t m_value_max;
+
+  /** Latest written slot and sequence number. */
+  uint16_t m_head;
+  uint16_t m_seq;
+
+  /**
+   * Return true(1) if sequence number a is later than b otherwise
+   * false(0). Serial number arithmetic.
+   * @param[in] a sequence number.
+   * @param[in] b sequence number.
+   * @return bool.
+   */
+  static bool is_later(uint16_t a, uint16_t b)
+  {
+    return (((int16_t) (a - b)) > 0);
+  }
+
+  /**
+   * Return EEPROM address of given slot.
+   * @param[in] slot index.
+   * @return address.
+   */
+  void* slot_addr(uint16_t slot) const
+  {
+    return ((void*) (m_addr + slot * m_slot_size));
+  }
+
+  /**
+   * Return checksum of given record header and value.
+   * @param[in] header record header.
+   * @param[in] value buffer.
+   * @return checksum.
+   */
+  static uint8_t checksum(const header_t* header, const uint8_t* value);
+
+  /**
+   * Return next slot after head that does not hold a live record.
+   * Clean live records that are passed are marked dirty and will be
+   * copied forward.
+   * @return slot.
+   */
+  uint16_t next_slot();
+
+  /**
+   * Append record for given key to the next free slot. Return true(1)
+   * if successful otherwise false(0).
+   * @param[in] key identity.
+   * @return bool.
+   */
+  bool write_record(uint8_t key);
+};
+
+/**
+ * Settings store with cache storage for given number of keys and
+ * max value size.
+ * @param[in] KEY_MAX number of keys (0..KEY_MAX-1).
+ * @param[in] VALUE_MAX max size of value (default 4 bytes).
+ */
+template<uint8_t KEY_MAX, uint8_t VALUE_MAX = 4>
+class SettingsStore : public Settings {
+  static_assert(VALUE_MAX <= VALUE_LIMIT, "VALUE_MAX too large");
+public:
+  /**
+   * Construct settings store on given device and region. Default
+   * device is the internal EEPROM.
+   * @param[in] addr start address of region.
+   * @param[in] size of region in bytes.
+   * @param[in] dev eeprom device (default internal EEPROM).
+   */
+  SettingsStore(uint16_t addr, uint16_t size,
+		EEPROM::Device* dev = &EEPROM::Device::eeprom) :
+    Settings(dev, addr, size, m_entry_buf, m_value_buf, KEY_MAX, VALUE_MAX)
+  {}
+
+private:
+  entry_t m_entry_buf[KEY_MAX];
+  uint8_t m_value_buf[KEY_MAX * VALUE_MAX];
+};
+
+#endif
@@ -0,0 +1,83 @@
+/**
+ * @file CosaSettings.ino
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * @section Description
+ * Cosa demonstration of the wear-leveled Settings store on the
+ * internal EEPROM; a boot counter and a frequently updated sample
+ * counter that is flushed every 10 seconds.
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#include <Settings.h>
+
+#include "Cosa/Periodic.hh"
+#include "Cosa/RTT.hh"
+#include "Cosa/Trace.hh"
+#include "Cosa/UART.hh"
+
+// Setting keys
+enum {
+  BOOTS,
+  SAMPLES,
+  PERIOD,
+  KEY_MAX
+};
+
+// Store in the first 512 bytes of the internal EEPROM
+SettingsStore<KEY_MAX> settings(0, 512);
+
+void setup()
+{
+  uart.begin(9600);
+  trace.begin(&uart, PSTR("CosaSettings: started"));
+  RTT::begin();
+
+  // Recover latest values and update the boot counter
+  uint32_t start = RTT::millis();
+  ASSERT(settings.begin());
+  trace << PSTR("begin:") << RTT::since(start) << PSTR(" ms, ")
+	<< settings.slots() << PSTR(" slots") << endl;
+  uint16_t boots = 0;
+  settings.get(BOOTS, &boots);
+  boots += 1;
+  settings.put(BOOTS, &boots);
+  uint16_t period = 100;
+  if (settings.get(PERIOD, &period) < 0) settings.put(PERIOD, &period);
+  settings.flush();
+  TRACE(boots);
+  TRACE(period);
+}
+
+void loop()
+{
+  // Update the sample counter; coalesced in the cache
+  static uint32_t samples = 0;
+  if (samples == 0) settings.get(SAMPLES, &samples);
+  samples += 1;
+  settings.put(SAMPLES, &samples);
+  delay(100);
+
+  // Write back periodically
+  periodic(timer, 10000) {
+    uint32_t start = RTT::millis();
+    int res = settings.flush();
+    trace << PSTR("flush:") << res << ':'
+	  << RTT::since(start) << PSTR(" ms, samples = ")
+	  << samples << endl;
+  }
+}
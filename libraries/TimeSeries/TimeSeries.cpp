@@ -0,0 +1,191 @@
+/**
+ * @file TimeSeries.cpp
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#include "TimeSeries.hh"
+
+uint8_t
+TimeSeries::encode(uint8_t* buf, int32_t value)
+{
+  // Zig-zag map signed to unsigned; small magnitudes to small values
+  uint32_t zz = ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+
+  // Write seven bits per byte; high bit set if more bytes follow
+  uint8_t n = 0;
+  while (zz >= 0x80) {
+    buf[n++] = (zz & 0x7f) | 0x80;
+    zz >>= 7;
+  }
+  buf[n++] = zz;
+  return (n);
+}
+
+uint8_t
+TimeSeries::decode(const uint8_t* buf, size_t size, int32_t& value)
+{
+  uint32_t zz = 0;
+  uint8_t shift = 0;
+  for (uint8_t n = 0; (n < size) && (n < 5); n++, shift += 7) {
+    uint8_t data = buf[n];
+    zz |= (uint32_t) (data & 0x7f) << shift;
+    if (data & 0x80) continue;
+    value = (int32_t) (zz >> 1) ^ -(int32_t) (zz & 1);
+    return (n + 1);
+  }
+  return (0);
+}
+
+void
+TimeSeries::Index::add(uint16_t block, uint32_t timestamp)
+{
+  // Record every stride block in order
+  if (block & ((1 << m_shift) - 1)) return;
+  uint16_t ix = block >> m_shift;
+  if (ix != m_count) return;
+
+  // Double the stride when the index is full; keep every other block
+  if (ix == INDEX_MAX) {
+    m_shift += 1;
+    for (uint8_t i = 0; 2 * i < INDEX_MAX; i++)
+      m_timestamp[i] = m_timestamp[2 * i];
+    m_count = (INDEX_MAX + 1) / 2;
+    if (block & ((1 << m_shift) - 1)) return;
+    ix = block >> m_shift;
+  }
+  m_timestamp[ix] = timestamp;
+  m_count += 1;
+}
+
+uint16_t
+TimeSeries::Index::find(uint32_t timestamp) const
+{
+  uint8_t ix = 0;
+  while ((ix + 1 < m_count) && (m_timestamp[ix + 1] <= timestamp)) ix++;
+  return (ix << m_shift);
+}
+
+int
+TimeSeries::Encoder::write(uint32_t timestamp, int32_t value)
+{
+  header_t* header = (header_t*) m_buf;
+
+  // Start a new block with the sample in the header
+  if (m_pos == 0) {
+    header->timestamp = timestamp;
+    header->value = value;
+    header->count = 1;
+    m_pos = sizeof(header_t);
+    m_timestamp = timestamp;
+    m_delta = 0;
+    m_value = value;
+    m_samples += 1;
+    return (0);
+  }
+
+  // Encode delta-of-delta of timestamp and delta of value; directly
+  // into the block when there is room for the max encoded size
+  int32_t delta = timestamp - m_timestamp;
+  uint8_t buf[SAMPLE_MAX];
+  uint8_t* bp = (BLOCK_MAX - m_pos >= SAMPLE_MAX) ? m_buf + m_pos : buf;
+  uint8_t n = encode(bp, delta - m_delta);
+  n += encode(bp + n, value - m_value);
+
+  // Write the block and start a new block if the sample does not fit
+  if ((m_pos + n > BLOCK_MAX) || (header->count == UINT8_MAX)) {
+    int res = flush();
+    if (res < 0) return (res);
+    return (write(timestamp, value));
+  }
+  if (bp == buf) memcpy(m_buf + m_pos, buf, n);
+  m_pos += n;
+  header->count += 1;
+  m_timestamp = timestamp;
+  m_delta = delta;
+  m_value = value;
+  m_samples += 1;
+  return (0);
+}
+
+int
+TimeSeries::Encoder::flush()
+{
+  if (m_pos == 0) return (0);
+
+  // Pad and write the block; record first timestamp in index
+  memset(m_buf + m_pos, 0, BLOCK_MAX - m_pos);
+  if (m_dev->write(m_buf, BLOCK_MAX) != (int) BLOCK_MAX) return (EIO);
+  if (m_index != NULL)
+    m_index->add(m_blocks, ((header_t*) m_buf)->timestamp);
+  m_blocks += 1;
+  m_pos = 0;
+  return (0);
+}
+
+int
+TimeSeries::Decoder::read(uint32_t& timestamp, int32_t& value)
+{
+  // Read next block when the current is consumed
+  if (m_count == 0) {
+    size_t size = 0;
+    while (size < BLOCK_MAX) {
+      int res = m_dev->read(m_buf + size, BLOCK_MAX - size);
+      if (res < 0) return (res);
+      if (res == 0) break;
+      size += res;
+    }
+    if (size == 0) return (0);
+    header_t* header = (header_t*) m_buf;
+    if ((size != BLOCK_MAX) || (header->count == 0)) return (EINVAL);
+
+    // Return the first sample from the header
+    m_timestamp = header->timestamp;
+    m_delta = 0;
+    m_value = header->value;
+    m_count = header->count - 1;
+    m_pos = sizeof(header_t);
+    timestamp = m_timestamp;
+    value = m_value;
+    return (1);
+  }
+
+  // Decode delta-of-delta of timestamp and delta of value
+  int32_t dod, delta;
+  uint8_t n = decode(m_buf + m_pos, BLOCK_MAX - m_pos, dod);
+  if (n == 0) return (EINVAL);
+  m_pos += n;
+  n = decode(m_buf + m_pos, BLOCK_MAX - m_pos, delta);
+  if (n == 0) return (EINVAL);
+  m_pos += n;
+  m_count -= 1;
+  m_delta += dod;
+  m_timestamp += m_delta;
+  m_value += delta;
+  timestamp = m_timestamp;
+  value = m_value;
+  return (1);
+}
+
+int
+TimeSeries::Decoder::seek(uint32_t from, uint32_t& timestamp, int32_t& value)
+{
+  int res;
+  while ((res = read(timestamp, value)) == 1)
+    if (timestamp >= from) return (1);
+  return (res);
+}
@@ -0,0 +1,264 @@
+/**
+ * @file TimeSeries.hh
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#ifndef COSA_TIMESERIES_HH
+#define COSA_TIMESERIES_HH
+
+#include "Cosa/Types.h"
+#include "Cosa/IOStream.hh"
+
+/**
+ * Size of time-series blocks in bytes. Default 64.
+ */
+#if !defined(TIMESERIES_BLOCK_MAX)
+#define TIMESERIES_BLOCK_MAX 64
+#endif
+
+/**
+ * Number of entries in the time-series block index. The index holds
+ * the first timestamp of every n:th block, where the stride n is
+ * doubled when the index is full. Default 16 (64 bytes).
+ */
+#if !defined(TIMESERIES_INDEX_MAX)
+#define TIMESERIES_INDEX_MAX 16
+#endif
+
+/**
+ * Compressed time-series sample storage over an IOStream::Device
+ * (FAT16::File, CFFS::File, IOBuffer, etc). Samples (timestamp,
+ * value) are written in fixed-size blocks. Each block starts with
+ * a header with the first sample and the number of samples. The
+ * following samples are encoded as the delta-of-delta of the
+ * timestamp and the delta of the value, both zig-zag varint
+ * encoded. A periodic sample with a slowly changing value is encoded
+ * in two bytes.
+ *
+ * @section Limitations
+ * Blocks are padded and written when full or on flush(). A block
+ * holds max 255 samples.
+ */
+class TimeSeries {
+public:
+  /** Block size in bytes. */
+  static const size_t BLOCK_MAX = TIMESERIES_BLOCK_MAX;
+
+  /** Max size of an encoded sample; two 32-bit varints. */
+  static const uint8_t SAMPLE_MAX = 10;
+
+  /**
+   * Block header; first sample and number of samples in the block
+   * (including the first).
+   */
+  struct header_t {
+    uint32_t timestamp;		//!< First timestamp.
+    int32_t value;		//!< First value.
+    uint8_t count;		//!< Number of samples.
+  };
+  static_assert(BLOCK_MAX >= sizeof(header_t) + SAMPLE_MAX,
+		"TIMESERIES_BLOCK_MAX too small");
+
+  /**
+   * Block index; first timestamp of every n:th block. Used to find
+   * the block to seek to for a time-range query.
+   */
+  class Index {
+  public:
+    /** Number of entries in index. */
+    static const uint8_t INDEX_MAX = TIMESERIES_INDEX_MAX;
+
+    /**
+     * Construct empty block index.
+     */
+    Index() :
+      m_count(0),
+      m_shift(0)
+    {}
+
+    /**
+     * Record the first timestamp of the given block. Blocks are
+     * recorded in order and with the index stride. The stride is
+     * doubled when the index is full.
+     * @param[in] block number.
+     * @param[in] timestamp first timestamp in block.
+     */
+    void add(uint16_t block, uint32_t timestamp);
+
+    /**
+     * Return number of the last indexed block with a first timestamp
+     * less than or equal to the given timestamp. The samples from the
+     * timestamp are in this block or following blocks.
+     * @param[in] timestamp to search for.
+     * @return block number.
+     */
+    uint16_t find(uint32_t timestamp) const;
+
+    /**
+     * Return offset in bytes of the given block.
+     * @param[in] block number.
+     * @return offset.
+     */
+    static uint32_t offset(uint16_t block)
+    {
+      return (block * (uint32_t) BLOCK_MAX);
+    }
+
+  protected:
+    uint32_t m_timestamp[INDEX_MAX];	//!< First timestamp of blocks.
+    uint8_t m_count;			//!< Number of index entries.
+    uint8_t m_shift;			//!< Block stride (log2).
+  };
+
+  /**
+   * Time-series encoder; compress samples into blocks and write to
+   * the output device.
+   */
+  class Encoder {
+  public:
+    /**
+     * Construct encoder for the given output device and optional
+     * block index.
+     * @param[in] dev output device.
+     * @param[in] index block index (default NULL).
+     */
+    Encoder(IOStream::Device* dev, Index* index = NULL) :
+      m_dev(dev),
+      m_index(index),
+      m_pos(0),
+      m_blocks(0),
+      m_samples(0L)
+    {}
+
+    /**
+     * Append sample with given timestamp and value. The block is
+     * written to the device when full. Returns zero(0) if successful
+     * otherwise a negative error code (EIO).
+     * @param[in] timestamp of sample.
+     * @param[in] value of sample.
+     * @return zero or negative error code.
+     */
+    int write(uint32_t timestamp, int32_t value);
+
+    /**
+     * Write the current block, padded to the block size, if not
+     * empty. Returns zero(0) if successful otherwise a negative error
+     * code (EIO).
+     * @return zero or negative error code.
+     */
+    int flush();
+
+    /**
+     * Return number of blocks written.
+     * @return blocks.
+     */
+    uint16_t blocks() const
+    {
+      return (m_blocks);
+    }
+
+    /**
+     * Return number of samples written.
+     * @return samples.
+     */
+    uint32_t samples() const
+    {
+      return (m_samples);
+    }
+
+  protected:
+    IOStream::Device* m_dev;		//!< Output device.
+    Index* m_index;			//!< Block index (or NULL).
+    uint8_t m_buf[BLOCK_MAX];		//!< Current block.
+    uint16_t m_pos;			//!< Next free position in block.
+    uint16_t m_blocks;			//!< Number of blocks written.
+    uint32_t m_samples;			//!< Number of samples written.
+    uint32_t m_timestamp;		//!< Previous timestamp.
+    int32_t m_delta;			//!< Previous timestamp delta.
+    int32_t m_value;			//!< Previous value.
+  };
+
+  /**
+   * Time-series streaming decoder; read blocks from the input device
+   * and decompress samples.
+   */
+  class Decoder {
+  public:
+    /**
+     * Construct decoder for the given input device.
+     * @param[in] dev input device.
+     */
+    Decoder(IOStream::Device* dev) :
+      m_dev(dev),
+      m_pos(0),
+      m_count(0)
+    {}
+
+    /**
+     * Read next sample. Returns one(1) and the sample timestamp and
+     * value, zero(0) at end of input otherwise a negative error code
+     * (EINVAL if a block is malformed).
+     * @param[out] timestamp of sample.
+     * @param[out] value of sample.
+     * @return one, zero or negative error code.
+     */
+    int read(uint32_t& timestamp, int32_t& value);
+
+    /**
+     * Skip samples before the given timestamp. Returns one(1) and the
+     * first sample with a timestamp greater than or equal to the given
+     * timestamp, zero(0) at end of input otherwise a negative error
+     * code (EINVAL).
+     * @param[in] from timestamp to search for.
+     * @param[out] timestamp of sample.
+     * @param[out] value of sample.
+     * @return one, zero or negative error code.
+     */
+    int seek(uint32_t from, uint32_t& timestamp, int32_t& value);
+
+  protected:
+    IOStream::Device* m_dev;		//!< Input device.
+    uint8_t m_buf[BLOCK_MAX];		//!< Current block.
+    uint16_t m_pos;			//!< Next position in block.
+    uint8_t m_count;			//!< Samples left in block.
+    uint32_t m_timestamp;		//!< Previous timestamp.
+    int32_t m_delta;			//!< Previous timestamp delta.
+    int32_t m_value;			//!< Previous value.
+  };
+
+  /**
+   * Encode given signed value as zig-zag varint into the given
+   * buffer. Returns number of bytes.
+   * @param[in] buf buffer (at least five bytes).
+   * @param[in] value to encode.
+   * @return number of bytes.
+   */
+  static uint8_t encode(uint8_t* buf, int32_t value);
+
+  /**
+   * Decode zig-zag varint from the given buffer with given max size.
+   * Returns number of bytes or zero(0) if the varint is not complete.
+   * @param[in] buf buffer.
+   * @param[in] size max number of bytes.
+   * @param[out] value decoded.
+   * @return number of bytes or zero.
+   */
+  static uint8_t decode(const uint8_t* buf, size_t size, int32_t& value);
+};
+
+#endif
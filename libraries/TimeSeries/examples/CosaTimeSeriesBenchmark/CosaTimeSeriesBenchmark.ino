@@ -0,0 +1,130 @@
+/**
+ * @file CosaTimeSeriesBenchmark.ino
+ * @version 1.0
+ *
+ * @section License
+ * Copyright (C) 2015, Mikael Patel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * @section Description
+ * Benchmark of the TimeSeries compressed sample storage; analog
+ * samples with 1 ms period are encoded. Prints the compression
+ * ratio against raw binary records (uint32_t timestamp and uint16_t
+ * sample) and text records, and the encode and decode time and
+ * cycles per sample.
+ *
+ * This file is part of the Arduino Che Cosa project.
+ */
+
+#include <TimeSeries.h>
+
+#include "Cosa/AnalogPin.hh"
+#include "Cosa/IOBuffer.hh"
+#include "Cosa/RTT.hh"
+#include "Cosa/Trace.hh"
+#include "Cosa/UART.hh"
+#include "Cosa/Watchdog.hh"
+
+AnalogPin probe(Board::A0);
+
+// Output device that counts the number of bytes written
+class Counter : public IOStream::Device {
+public:
+  Counter() : IOStream::Device(), bytes(0L) {}
+  virtual int write(const void* buf, size_t size)
+  {
+    UNUSED(buf);
+    bytes += size;
+    return (size);
+  }
+  uint32_t bytes;
+};
+
+// Sample buffer; the samples are encoded repeatedly
+static const uint16_t SAMPLE_MAX = 100;
+static uint16_t sample[SAMPLE_MAX];
+
+void setup()
+{
+  Watchdog::begin();
+  RTT::begin();
+  uart.begin(57600);
+  trace.begin(&uart, PSTR("CosaTimeSeriesBenchmark: started"));
+  AnalogPin::powerup();
+}
+
+void loop()
+{
+  const uint16_t COUNT = 10;
+  uint32_t start, us, timestamp;
+  int32_t value;
+
+  // Sample the analog pin with 1 ms period
+  for (uint16_t i = 0; i < SAMPLE_MAX; i++) {
+    sample[i] = probe.sample();
+    delay(1);
+  }
+
+  // Encode samples; count bytes written and text record size
+  Counter counter;
+  TimeSeries::Index index;
+  TimeSeries::Encoder encoder(&counter, &index);
+  uint32_t text = 0L;
+  timestamp = RTT::millis();
+  start = RTT::micros();
+  for (uint16_t n = 0; n < COUNT; n++) {
+    for (uint16_t i = 0; i < SAMPLE_MAX; i++) {
+      ASSERT(encoder.write(timestamp, sample[i]) == 0);
+      timestamp += 1;
+    }
+  }
+  us = RTT::micros() - start;
+  ASSERT(encoder.flush() == 0);
+  // Text record; 10 digit timestamp, separator, sample and newline
+  for (uint16_t i = 0; i < SAMPLE_MAX; i++)
+    text += (sample[i] < 10 ? 1 : sample[i] < 100 ? 2 : sample[i] < 1000 ? 3 : 4);
+  text = COUNT * (text + SAMPLE_MAX * (10 + 2));
+  uint32_t samples = encoder.samples();
+  uint32_t raw = samples * (sizeof(uint32_t) + sizeof(uint16_t));
+  trace << PSTR("encode:") << samples << PSTR(" samples, ")
+	<< counter.bytes << PSTR(" bytes, ")
+	<< encoder.blocks() << PSTR(" blocks")
+	<< endl;
+  trace << PSTR("ratio:binary ") << (float) raw / counter.bytes
+	<< PSTR(", text ") << (float) text / counter.bytes
+	<< endl;
+  trace << PSTR("encode:") << (float) us / samples << PSTR(" us/sample, ")
+	<< (us * (F_CPU / 1000000L)) / samples << PSTR(" cycles/sample")
+	<< endl;
+
+  // Encode into a buffer and decode
+  IOBuffer<512> buffer;
+  TimeSeries::Encoder encoder2(&buffer);
+  timestamp = RTT::millis();
+  for (uint16_t i = 0; i < SAMPLE_MAX; i++)
+    ASSERT(encoder2.write(timestamp + i, sample[i]) == 0);
+  ASSERT(encoder2.flush() == 0);
+  TimeSeries::Decoder decoder(&buffer);
+  uint16_t i = 0;
+  start = RTT::micros();
+  while (decoder.read(timestamp, value) == 1) {
+    ASSERT(value == sample[i]);
+    i++;
+  }
+  us = RTT::micros() - start;
+  ASSERT(i == SAMPLE_MAX);
+  trace << PSTR("decode:") << (float) us / i << PSTR(" us/sample, ")
+	<< (us * (F_CPU / 1000000L)) / i << PSTR(" cycles/sample")
+	<< endl;
+
+  sleep(5);
+}
@@ -181,8 +181,13 @@ ISR(TIMER1_COMPA_vect)
   if (transmitter != NULL && transmitter->m_sample >= VWI::SAMPLES_PER_BIT)
     transmitter->m_sample = 0;
 
-  // Check if the receiver should run the phase locked loop
-  if (!transmitting && receiving)
-    receiver->PLL();
+  // Check if the receiver should run the phase locked loop; direct
+  // call for the generic receiver, specialized codec otherwise
+  if (!transmitting && receiving) {
+    if (receiver->m_pll == NULL)
+      receiver->PLL();
+    else
+      receiver->m_pll(receiver);
+  }
 }
 
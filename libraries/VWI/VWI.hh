@@ -26,6 +26,7 @@
 #include "Cosa/InputPin.hh"
 #include "Cosa/OutputPin.hh"
 #include "Cosa/Wireless.hh"
+#include "Cosa/CRC.hh"
 
 /**
  * VWI is an Cosa library that provides features to send short
@@ -68,7 +69,10 @@ public:
    * symbol. Supports encode and decoding of data to transmission
    * symbols. Cosa support several transmission codecs. They may be
    * used to optimize performance in a given scenario; speed, noise,
-   * message length, etc.
+   * message length, etc. A codec may hide the symbol definition
+   * members with static constants and define the symbol decoding
+   * inline to allow specialization of the receiver and transmitter
+   * (CodecReceiver and CodecTransmitter).
    */
   class Codec {
   public:
@@ -180,7 +184,8 @@ public:
      */
     Receiver(Board::DigitalPin pin, Codec* codec) :
       InputPin(pin),
-      m_codec(codec)
+      m_codec(codec),
+      m_pll(NULL)
     {
     }
 
@@ -242,7 +247,7 @@ public:
      */
     int link_quality_indicator();
 
-  private:
+  protected:
     /** The size of the receiver ramp. Ramp wraps modulo this number. */
     static const uint8_t RAMP_MAX = 160;
 
@@ -270,9 +275,18 @@ public:
     /** Internal ramp adjustment parameter. */
     static const uint8_t RAMP_INC_ADVANCE = (RAMP_INC + RAMP_ADJUST);
 
-    /** Current receiver sample. */
+    /** Receiver codec. */
     Codec* m_codec;
 
+    /** Phase Locked Loop function type. */
+    typedef void (*PLL_fn)(Receiver* receiver);
+
+    /**
+     * Phase Locked Loop specialized for the codec class (or NULL).
+     * Called from the interrupt handler per sample instead of PLL().
+     */
+    PLL_fn m_pll;
+
     /** Current receiver sample. */
     uint8_t m_sample;
 
@@ -322,14 +336,104 @@ public:
     /**
      * Phase Locked Loop; Synchronizes with the transmitter so that
      * bit transitions occur at about the time (m_pll_ramp) is 0, then
-     * the average is computed over each bit period to deduce the bit value.
+     * the average is computed over each bit period to deduce the bit
+     * value. Called from the interrupt handler per sample. Uses the
+     * virtual codec member functions.
      */
     void PLL();
 
+    /**
+     * Phase Locked Loop for the given codec type. Symbol definition
+     * and decoding are resolved at compile-time for a codec class.
+     * @param[in] CODEC codec class.
+     * @param[in] codec receiver codec.
+     */
+    template<class CODEC> void PLL(CODEC* codec);
+
+    /**
+     * Construct VWI Receiver instance connected to the given pin with
+     * a Phase Locked Loop specialized for the codec class. Used by
+     * CodecReceiver.
+     * @param[in] rx input pin.
+     * @param[in] codec for the receiver.
+     * @param[in] pll phase locked loop function.
+     */
+    Receiver(Board::DigitalPin pin, Codec* codec, PLL_fn pll) :
+      InputPin(pin),
+      m_codec(codec),
+      m_pll(pll)
+    {
+    }
+
+    /**
+     * Phase Locked Loop function for the given codec class.
+     * @param[in] CODEC codec class.
+     * @param[in] receiver instance.
+     */
+    template<class CODEC>
+    static void codec_PLL(Receiver* receiver)
+    {
+      receiver->PLL((CODEC*) receiver->m_codec);
+    }
+
+    /**
+     * Decode two packed symbols to a byte with the virtual codec
+     * member function.
+     * @param[in] codec receiver codec.
+     * @param[in] symbol to decode.
+     * @return data.
+     */
+    static uint8_t decode8(Codec* codec, uint16_t symbol)
+    {
+      return (codec->decode8(symbol));
+    }
+
+    /**
+     * Decode two packed symbols to a byte with the codec class
+     * member function (inline).
+     * @param[in] CODEC codec class.
+     * @param[in] codec receiver codec.
+     * @param[in] symbol to decode.
+     * @return data.
+     */
+    template<class CODEC>
+    static uint8_t decode8(CODEC* codec, uint16_t symbol)
+    {
+      return ((codec->CODEC::decode4(symbol) << 4)
+	      | (codec->CODEC::decode4(symbol >> CODEC::BITS_PER_SYMBOL)));
+    }
+
     /** Interrupt Service Routine. */
     friend void TIMER1_COMPA_vect(void);
   };
 
+  /**
+   * Virtual Wire Receiver specialized for the given codec class. The
+   * symbol decoding is inlined in the phase locked loop; no virtual
+   * codec member function calls in the interrupt handler.
+   * @param[in] CODEC codec class.
+   *
+   * @section Usage
+   * @code
+   * VirtualWireCodec codec;
+   * VWI::CodecReceiver<VirtualWireCodec> rx(Board::D7, &codec);
+   * VWI rf(NETWORK, DEVICE, SPEED, &rx);
+   * @endcode
+   */
+  template<class CODEC>
+  class CodecReceiver : public Receiver {
+  public:
+    /**
+     * Construct VWI Receiver instance connected to the given pin.
+     * @param[in] rx input pin.
+     * @param[in] codec for the receiver.
+     */
+    CodecReceiver(Board::DigitalPin pin, CODEC* codec) :
+      Receiver(pin, codec, &Receiver::codec_PLL<CODEC>)
+    {
+    }
+  };
+
   /**
    * Internal Virtual Wire Transmitter.
    */
@@ -391,7 +495,7 @@ public:
      * @param[in] vec null terminated io vector.
      * @return number of bytes transmitted or negative error code.
      */
-    int send(uint8_t dest, uint8_t port, const iovec_t* vec);
+    virtual int send(uint8_t dest, uint8_t port, const iovec_t* vec);
 
     /**
      * Send a message with the given length. Returns almost
@@ -407,7 +511,7 @@ public:
      */
     int send(uint8_t dest, uint8_t port, const void* buf, size_t len);
 
-  private:
+  protected:
     /** Max size of preamble and start symbol. Codec provides actual size. */
     static const uint8_t PREAMBLE_MAX = 8;
 
@@ -432,6 +536,46 @@ public:
     /** Flag to indicated the transmitter is active. */
     volatile uint8_t m_enabled;
 
+    /**
+     * Encode message in null terminated io vector to transmission
+     * buffer with given codec type. Returns number of bytes to be
+     * transmitted or negative error code (see send()).
+     * @param[in] CODEC codec class.
+     * @param[in] codec transmitter codec.
+     * @param[in] dest destination network address.
+     * @param[in] port device port (or message type).
+     * @param[in] vec null terminated io vector.
+     * @return number of bytes transmitted or negative error code.
+     */
+    template<class CODEC>
+    int encode(CODEC* codec, uint8_t dest, uint8_t port, const iovec_t* vec);
+
+    /**
+     * Encode 4 bits (nibble) to a symbol with the virtual codec member
+     * function.
+     * @param[in] codec transmitter codec.
+     * @param[in] nibble data to encode.
+     * @return symbol.
+     */
+    static uint8_t encode4(Codec* codec, uint8_t nibble)
+    {
+      return (codec->encode4(nibble));
+    }
+
+    /**
+     * Encode 4 bits (nibble) to a symbol with the codec class member
+     * function (inline).
+     * @param[in] CODEC codec class.
+     * @param[in] codec transmitter codec.
+     * @param[in] nibble data to encode.
+     * @return symbol.
+     */
+    template<class CODEC>
+    static uint8_t encode4(CODEC* codec, uint8_t nibble)
+    {
+      return (codec->CODEC::encode4(nibble));
+    }
+
     /** Interrupt Service Routine. */
     friend void TIMER1_COMPA_vect(void);
 
@@ -439,6 +583,43 @@ public:
     friend class Codec;
   };
 
+  /**
+   * Virtual Wire Transmitter specialized for the given codec
+   * class. The symbol encoding is inlined in the message encoding; no
+   * virtual codec member function calls.
+   * @param[in] CODEC codec class.
+   */
+  template<class CODEC>
+  class CodecTransmitter : public Transmitter {
+  public:
+    /**
+     * Construct VWI Transmitter instance connected to the given
+     * pin. Use given codec for encoding data.
+     * @param[in] pin transmitter input pin.
+     * @param[in] codec for transmitter.
+     */
+    CodecTransmitter(Board::DigitalPin pin, CODEC* codec) :
+      Transmitter(pin, codec)
+    {
+    }
+
+    using Transmitter::send;
+
+    /**
+     * @override{VWI::Transmitter}
+     * Send message using a null terminated io vector message. Message
+     * encoding specialized for the codec class.
+     * @param[in] dest destination network address.
+     * @param[in] port device port (or message type).
+     * @param[in] vec null terminated io vector.
+     * @return number of bytes transmitted or negative error code.
+     */
+    virtual int send(uint8_t dest, uint8_t port, const iovec_t* vec)
+    {
+      return (encode((CODEC*) m_codec, dest, port, vec));
+    }
+  };
+
   /**
    * Construct Virtual Wire Interface with given network, device
    * address and speed (bits per second).
@@ -606,4 +787,147 @@ private:
   /** Interrupt service routine. */
   friend void TIMER1_COMPA_vect(void);
 };
+
+template<class CODEC>
+void
+VWI::Receiver::PLL(CODEC* codec)
+{
+  // Integrate each sample
+  if (m_sample) m_integrator++;
+
+  if (m_sample != m_last_sample) {
+    // Transition, advance if ramp > TRANSITION otherwise retard
+    m_pll_ramp +=
+      ((m_pll_ramp < RAMP_TRANSITION) ? RAMP_INC_RETARD : RAMP_INC_ADVANCE);
+    m_last_sample = m_sample;
+  }
+  else {
+    // No transition: Advance ramp by standard INC (== MAX/BITS samples)
+    m_pll_ramp += RAMP_INC;
+  }
+  if (m_pll_ramp >= RAMP_MAX) {
+    // Add this to the MSB bit of rx_bits, LSB first. The last bits are kept
+    m_bits >>= 1;
+
+    // Check the integrator to see how many samples in this cycle were
+    // high. If < 5 out of 8, then its declared a 0 bit, else a 1;
+    if (m_integrator >= INTEGRATOR_THRESHOLD)
+      m_bits |= codec->BITS_MSB;
+
+    m_pll_ramp -= RAMP_MAX;
+
+    // Clear the integral for the next cycle
+    m_integrator = 0;
+
+    if (m_active) {
+      // We have the start symbol and now we are collecting message
+      // bits for two symbols before decoding to a byte
+      if (++m_bit_count >= (codec->BITS_PER_SYMBOL * 2)) {
+	uint8_t data = decode8(codec, m_bits);
+
+	// The first decoded byte is the byte count of the following
+	// message the count includes the byte count and the 2
+	// trailing FCS bytes.
+	if (m_length == 0) {
+	  // The first byte is the byte count. Check it for
+	  // sensibility. It cant be less than min, since it includes
+	  // the bytes count itself and the 2 byte FCS
+	  m_count = data;
+	  if (m_count < MESSAGE_MIN || m_count > MESSAGE_MAX) {
+	    // Stupid message length, drop the whole thing
+	    m_active = false;
+	    return;
+	  }
+	}
+	m_buffer[m_length++] = data;
+	if (m_length >= m_count) {
+	  // Got all the bytes now
+	  m_active = false;
+	  // Better come get it before the next one starts
+	  m_done = true;
+	}
+	m_bit_count = 0;
+      }
+    }
+
+    // Not in a message, see if we have a start symbol
+    else if (m_bits == codec->START_SYMBOL) {
+      // Have start symbol, start collecting message
+      m_active = true;
+      m_bit_count = 0;
+      m_length = 0;
+      // Too bad if you missed the last message
+      m_done = false;
+    }
+  }
+}
+
+template<class CODEC>
+int
+VWI::Transmitter::encode(CODEC* codec,
+			  uint8_t dest, uint8_t port,
+			  const iovec_t* vec)
+{
+  // Santiy check the io vector
+  if (UNLIKELY(vec == NULL)) return (EINVAL);
+
+  // Check that the message is not too large
+  size_t len = iovec_size(vec);
+  if (UNLIKELY(len > PAYLOAD_MAX)) return (EMSGSIZE);
+
+  uint8_t *tp = m_buffer + codec->PREAMBLE_MAX;
+  uint16_t crc = CRC::CCITT::INIT;
+
+  // Wait for transmitter to become available. Might be transmitting
+  while (m_enabled) yield();
+
+  // Encode the message total length = length(1)+header(4)+payload(len)+crc(2)
+  uint8_t count = 1 + sizeof(header_t) + len + 2;
+  crc = CRC::CCITT::update(crc, count);
+  *tp++ = encode4(codec, count >> 4);
+  *tp++ = encode4(codec, count);
+
+  // Encode the message header
+  header_t header;
+  header.network = s_rf->m_addr.network;
+  header.src = s_rf->m_addr.device;
+  header.dest = dest;
+  header.port = port;
+  uint8_t* bp = (uint8_t*) &header;
+  for (uint8_t i = 0; i < sizeof(header); i++) {
+    uint8_t data = *bp++;
+    crc = CRC::CCITT::update(crc, data);
+    *tp++ = encode4(codec, data >> 4);
+    *tp++ = encode4(codec, data);
+  }
+
+  // Encode the message into symbols. Each byte is converted into
+  // 2 symbols, high nybble first, low nybble second
+  for (const iovec_t* vp = vec; vp->buf != NULL; vp++) {
+    uint8_t *bp = (uint8_t*) vp->buf;
+    for (uint8_t i = 0; i < vp->size; i++) {
+      uint8_t data = *bp++;
+      crc = CRC::CCITT::update(crc, data);
+      *tp++ = encode4(codec, data >> 4);
+      *tp++ = encode4(codec, data);
+    }
+  }
+
+  // Append the FCS, 16 bits before encoding (4 symbols after
+  // encoding) Caution: VWI expects the _ones_complement_ of the CCITT
+  // CRC-16 as the FCS VWI sends FCS as low byte then hi byte
+  crc = ~crc;
+  *tp++ = encode4(codec, crc >> 4);
+  *tp++ = encode4(codec, crc);
+  *tp++ = encode4(codec, crc >> 12);
+  *tp++ = encode4(codec, crc >> 8);
+
+  // Total number of symbols to send
+  m_length = codec->PREAMBLE_MAX + (count * 2);
+
+  // Start the low level interrupt handler sending symbols
+  begin();
+  return (len);
+}
+
 #endif
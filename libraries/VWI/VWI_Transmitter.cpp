@@ -21,71 +21,11 @@
  */
 
 #include "VWI.hh"
-#include <util/crc16.h>
 
 int
 VWI::Transmitter::send(uint8_t dest, uint8_t port, const iovec_t* vec)
 {
-  // Santiy check the io vector
-  if (UNLIKELY(vec == NULL)) return (EINVAL);
-
-  // Check that the message is not too large
-  size_t len = iovec_size(vec);
-  if (UNLIKELY(len > PAYLOAD_MAX)) return (EMSGSIZE);
-
-  uint8_t *tp = m_buffer + m_codec->PREAMBLE_MAX;
-  uint16_t crc = 0xffff;
-
-  // Wait for transmitter to become available. Might be transmitting
-  while (m_enabled) yield();
-
-  // Encode the message total length = length(1)+header(4)+payload(len)+crc(2)
-  uint8_t count = 1 + sizeof(header_t) + len + 2;
-  crc = _crc_ccitt_update(crc, count);
-  *tp++ = m_codec->encode4(count >> 4);
-  *tp++ = m_codec->encode4(count);
-
-  // Encode the message header
-  header_t header;
-  header.network = s_rf->m_addr.network;
-  header.src = s_rf->m_addr.device;
-  header.dest = dest;
-  header.port = port;
-  uint8_t* bp = (uint8_t*) &header;
-  for (uint8_t i = 0; i < sizeof(header); i++) {
-    uint8_t data = *bp++;
-    crc = _crc_ccitt_update(crc, data);
-    *tp++ = m_codec->encode4(data >> 4);
-    *tp++ = m_codec->encode4(data);
-  }
-
-  // Encode the message into symbols. Each byte is converted into
-  // 2 symbols, high nybble first, low nybble second
-  for (const iovec_t* vp = vec; vp->buf != NULL; vp++) {
-    uint8_t *bp = (uint8_t*) vp->buf;
-    for (uint8_t i = 0; i < vp->size; i++) {
-      uint8_t data = *bp++;
-      crc = _crc_ccitt_update(crc, data);
-      *tp++ = m_codec->encode4(data >> 4);
-      *tp++ = m_codec->encode4(data);
-    }
-  }
-
-  // Append the FCS, 16 bits before encoding (4 symbols after
-  // encoding) Caution: VWI expects the _ones_complement_ of the CCITT
-  // CRC-16 as the FCS VWI sends FCS as low byte then hi byte
-  crc = ~crc;
-  *tp++ = m_codec->encode4(crc >> 4);
-  *tp++ = m_codec->encode4(crc);
-  *tp++ = m_codec->encode4(crc >> 12);
-  *tp++ = m_codec->encode4(crc >> 8);
-
-  // Total number of symbols to send
-  m_length = m_codec->PREAMBLE_MAX + (count * 2);
-
-  // Start the low level interrupt handler sending symbols
-  begin();
-  return (len);
+  return (encode(m_codec, dest, port, vec));
 }
 
 int
@@ -26,6 +26,18 @@ const uint8_t VirtualWireCodec::s_symbols[] __PROGMEM = {
   0x23, 0x25, 0x26, 0x29, 0x2a, 0x2c, 0x32, 0x34
 };
 
+// Decoding table; 6-bit symbol to 4-bit code. Illegal symbols are zero
+const uint8_t VirtualWireCodec::s_codes[64] __PROGMEM = {
+   0,  0,  0,  0,  0,  0,  0,  0,	// 0x00
+   0,  0,  0,  0,  0,  0,  1,  0,	// 0x08
+   0,  0,  0,  2,  0,  3,  4,  0,	// 0x10
+   0,  5,  6,  0,  7,  0,  0,  0,	// 0x18
+   0,  0,  0,  8,  0,  9, 10,  0,	// 0x20
+   0, 11, 12,  0, 13,  0,  0,  0,	// 0x28
+   0,  0, 14,  0, 15,  0,  0,  0,	// 0x30
+   0,  0,  0,  0,  0,  0,  0,  0	// 0x38
+};
+
 /*
  * Calculating the start symbol (6-bits per symbol):
  * 0x2a, 0x2a => 10.1010, 10.1010 (preamble 6-bit).
@@ -34,15 +46,3 @@ const uint8_t VirtualWireCodec::s_symbols[] __PROGMEM = {
 const uint8_t VirtualWireCodec::s_preamble[] __PROGMEM = {
   0x2a, 0x2a, 0x2a, 0x2a, 0x2a, 0x2a, 0x38, 0x2c
 };
-
-uint8_t
-VirtualWireCodec::decode4(uint8_t symbol)
-{
-  symbol &= SYMBOL_MASK;
-  // FIX: Binary search for better speed
-  for (uint8_t i = 0; i < membersof(s_symbols); i++)
-    if (symbol == pgm_read_byte(&s_symbols[i]))
-      return (i);
-  return (0);
-}
-
@@ -30,12 +30,24 @@
  */
 class VirtualWireCodec : public VWI::Codec {
 public:
+  /** Bits per symbol. */
+  static const uint8_t BITS_PER_SYMBOL = 6;
+
+  /** Start symbol. */
+  static const uint16_t START_SYMBOL = 0xb38;
+
+  /** Symbol mask. */
+  static const uint8_t SYMBOL_MASK = (1 << BITS_PER_SYMBOL) - 1;
+
+  /** Symbol MSB. */
+  static const uint16_t BITS_MSB = 1 << (BITS_PER_SYMBOL * 2 - 1);
+
   /**
    * Construct VirtualWire codec with given bits per symbol, start symbol,
    * and preamble size.
    */
   VirtualWireCodec() :
-    VWI::Codec(6, 0xb38, 8)
+    VWI::Codec(BITS_PER_SYMBOL, START_SYMBOL, 8)
   {
   }
 
@@ -61,15 +73,22 @@ public:
 
   /**
    * @override{VWI::Codec}
-   * Returns 4-bit data for given symbol.
+   * Returns 4-bit data for given symbol. Illegal symbols are decoded
+   * as zero(0).
    * @return 4-bit data.
    */
-  virtual uint8_t decode4(uint8_t symbol);
+  virtual uint8_t decode4(uint8_t symbol)
+  {
+    return (pgm_read_byte(&s_codes[symbol & SYMBOL_MASK]));
+  }
 
 private:
   /** Symbol mapping table: 4 to 6 bits */
   static const uint8_t s_symbols[] PROGMEM;
 
+  /** Code mapping table: 6 to 4 bits */
+  static const uint8_t s_codes[] PROGMEM;
+
   /** Message preamble with start symbol */
   static const uint8_t s_preamble[] PROGMEM;
 };